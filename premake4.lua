@@ -1,11 +1,33 @@
 solution 'utilities'
     configurations {'release', 'debug'}
     location 'build'
+    project 'benchmarks'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/blocked.hpp', 'source/cpu.hpp', 'source/csv.hpp', 'source/dat.hpp', 'source/frames.hpp', 'source/html.hpp', 'source/stages.hpp', 'source/synthetic.hpp', 'source/benchmarks.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
     project 'crop'
         kind 'ConsoleApp'
         language 'C++'
         location 'build'
-        files {'source/crop.cpp'}
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/stages.hpp', 'source/tiles.hpp', 'source/crop.cpp'}
         configuration 'release'
             targetdir 'build/release'
             defines {'NDEBUG'}
@@ -27,7 +49,7 @@ solution 'utilities'
         kind 'ConsoleApp'
         language 'C++'
         location 'build'
-        files {'source/cut.cpp'}
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/follow.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/stages.hpp', 'source/cut.cpp'}
         configuration 'release'
             targetdir 'build/release'
             defines {'NDEBUG'}
@@ -49,7 +71,139 @@ solution 'utilities'
         kind 'ConsoleApp'
         language 'C++'
         location 'build'
-        files {'source/dat.hpp', 'source/dat_to_es.cpp'}
+        files {'source/blocked.hpp', 'source/cpu.hpp', 'source/dat.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/dat_to_es.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'es_diff'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/es_diff.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'es_filter'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/filters.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/es_filter.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'es_generate'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/cpu.hpp', 'source/dat.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/synthetic.hpp', 'source/es_generate.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'es_merge'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/es_merge.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'es_pipe'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/blocked.hpp', 'source/csv.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/stages.hpp', 'source/es_pipe.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'es_serve'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/es_serve.cpp'}
         configuration 'release'
             targetdir 'build/release'
             defines {'NDEBUG'}
@@ -71,7 +225,73 @@ solution 'utilities'
         kind 'ConsoleApp'
         language 'C++'
         location 'build'
-        files {'source/es_to_csv.cpp'}
+        files {'source/blocked.hpp', 'source/csv.hpp', 'source/follow.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/es_to_csv.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'es_to_dat'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/cpu.hpp', 'source/dat.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/es_to_dat.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'es_to_frames'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/frames.hpp', 'source/io.hpp', 'source/profile.hpp', 'third_party/lodepng/lodepng.cpp', 'source/es_to_frames.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'es_to_tensor'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/tensor.hpp', 'source/es_to_tensor.cpp'}
         configuration 'release'
             targetdir 'build/release'
             defines {'NDEBUG'}
@@ -93,7 +313,7 @@ solution 'utilities'
         kind 'ConsoleApp'
         language 'C++'
         location 'build'
-        files {'source/html.hpp', 'third_party/lodepng/lodepng.cpp', 'source/rainmaker.cpp'}
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/cpu.hpp', 'source/frames.hpp', 'source/html.hpp', 'source/io.hpp', 'source/merkle.hpp', 'source/profile.hpp', 'third_party/lodepng/lodepng.cpp', 'source/rainmaker.cpp'}
         defines {'SEPIA_COMPILER_WORKING_DIRECTORY="' .. project().location .. '"'}
         configuration 'release'
             targetdir 'build/release'
@@ -112,11 +332,55 @@ solution 'utilities'
             linkoptions {'-std=c++11'}
         configuration 'windows'
             files {'.clang-format'}
+    project 'raw_to_es'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/evt.hpp', 'source/io.hpp', 'source/profile.hpp', 'source/raw_to_es.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
     project 'statistics'
         kind 'ConsoleApp'
         language 'C++'
         location 'build'
-        files {'source/statistics.cpp'}
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/follow.hpp', 'source/io.hpp', 'source/merkle.hpp', 'source/profile.hpp', 'source/statistics.cpp'}
+        configuration 'release'
+            targetdir 'build/release'
+            defines {'NDEBUG'}
+            flags {'OptimizeSpeed'}
+        configuration 'debug'
+            targetdir 'build/debug'
+            defines {'DEBUG'}
+            flags {'Symbols'}
+        configuration 'linux'
+            links {'pthread'}
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'macosx'
+            buildoptions {'-std=c++11'}
+            linkoptions {'-std=c++11'}
+        configuration 'windows'
+            files {'.clang-format'}
+    project 'tests'
+        kind 'ConsoleApp'
+        language 'C++'
+        location 'build'
+        files {'source/async.hpp', 'source/blocked.hpp', 'source/cpu.hpp', 'source/csv.hpp', 'source/dat.hpp', 'source/html.hpp', 'source/io.hpp', 'source/synthetic.hpp', 'source/tensor.hpp', 'source/tests.cpp'}
         configuration 'release'
             targetdir 'build/release'
             defines {'NDEBUG'}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace async {
+    /// block_size is the default size (in bytes) of the blocks exchanged with the I/O threads.
+    constexpr std::size_t block_size = 1 << 20;
+
+    /// blocks is the default number of blocks in flight between the main thread and an I/O thread.
+    constexpr std::size_t blocks = 4;
+
+    /// bounded_queue is a blocking first-in first-out queue with a maximum size.
+    /// push blocks while the queue is full, which provides backpressure to the producer.
+    template <typename Element>
+    class bounded_queue {
+        public:
+        bounded_queue(std::size_t capacity) : _capacity(capacity), _closed(false) {}
+        bounded_queue(const bounded_queue&) = delete;
+        bounded_queue(bounded_queue&&) = delete;
+        bounded_queue& operator=(const bounded_queue&) = delete;
+        bounded_queue& operator=(bounded_queue&&) = delete;
+        virtual ~bounded_queue() {}
+
+        /// push adds an element to the queue, and returns false if the queue is closed.
+        virtual bool push(Element element) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_full.wait(lock, [&]() { return _closed || _elements.size() < _capacity; });
+            if (_closed) {
+                return false;
+            }
+            _elements.push_back(std::move(element));
+            _not_empty.notify_one();
+            return true;
+        }
+
+        /// pop retrieves an element from the queue, and returns false if the queue is closed and empty.
+        virtual bool pop(Element& element) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_empty.wait(lock, [&]() { return _closed || !_elements.empty(); });
+            if (_elements.empty()) {
+                return false;
+            }
+            element = std::move(_elements.front());
+            _elements.pop_front();
+            _not_full.notify_one();
+            return true;
+        }
+
+        /// close wakes up the waiting threads, pending elements can still be popped.
+        virtual void close() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _not_empty.notify_all();
+            _not_full.notify_all();
+        }
+
+        protected:
+        const std::size_t _capacity;
+        bool _closed;
+        std::deque<Element> _elements;
+        std::mutex _mutex;
+        std::condition_variable _not_empty;
+        std::condition_variable _not_full;
+    };
+
+    /// prefetch_streambuf reads blocks from a source stream on a dedicated thread.
+    /// The main thread decodes a block while the next ones are read, hence disk reads overlap with computations.
+    class prefetch_streambuf : public std::streambuf {
+        public:
+        prefetch_streambuf(std::unique_ptr<std::istream> source, std::size_t block_size, std::size_t blocks) :
+            _source(std::move(source)),
+            _filled(blocks),
+            _free(blocks) {
+            for (std::size_t index = 0; index < blocks; ++index) {
+                _free.push(std::vector<char>(block_size));
+            }
+            setg(nullptr, nullptr, nullptr);
+            _reader = std::thread([this, block_size]() {
+                try {
+                    std::vector<char> block;
+                    while (_free.pop(block)) {
+                        block.resize(block_size);
+                        const auto count =
+                            _source->rdbuf()->sgetn(block.data(), static_cast<std::streamsize>(block.size()));
+                        if (count <= 0) {
+                            break;
+                        }
+                        block.resize(static_cast<std::size_t>(count));
+                        if (!_filled.push(std::move(block))) {
+                            break;
+                        }
+                    }
+                } catch (...) {
+                    _exception = std::current_exception();
+                }
+                _filled.close();
+            });
+        }
+        prefetch_streambuf(const prefetch_streambuf&) = delete;
+        prefetch_streambuf(prefetch_streambuf&&) = delete;
+        prefetch_streambuf& operator=(const prefetch_streambuf&) = delete;
+        prefetch_streambuf& operator=(prefetch_streambuf&&) = delete;
+        virtual ~prefetch_streambuf() {
+            _free.close();
+            _filled.close();
+            _reader.join();
+        }
+
+        protected:
+        /// underflow recycles the current block and waits for the next one.
+        virtual int_type underflow() override {
+            if (gptr() < egptr()) {
+                return traits_type::to_int_type(*gptr());
+            }
+            if (!_block.empty()) {
+                _free.push(std::move(_block));
+                _block = std::vector<char>();
+            }
+            if (!_filled.pop(_block)) {
+                if (_exception) {
+                    std::rethrow_exception(_exception);
+                }
+                return traits_type::eof();
+            }
+            setg(_block.data(), _block.data(), _block.data() + _block.size());
+            return traits_type::to_int_type(*gptr());
+        }
+
+        std::unique_ptr<std::istream> _source;
+        bounded_queue<std::vector<char>> _filled;
+        bounded_queue<std::vector<char>> _free;
+        std::vector<char> _block;
+        std::exception_ptr _exception;
+        std::thread _reader;
+    };
+
+    /// prefetch_istream is an input stream reading from a source stream through a prefetch_streambuf.
+    class prefetch_istream : public std::istream {
+        public:
+        prefetch_istream(
+            std::unique_ptr<std::istream> source,
+            std::size_t block_size = async::block_size,
+            std::size_t blocks = async::blocks) :
+            std::istream(nullptr),
+            _streambuf(std::move(source), block_size, blocks) {
+            rdbuf(&_streambuf);
+        }
+        prefetch_istream(const prefetch_istream&) = delete;
+        prefetch_istream(prefetch_istream&&) = delete;
+        prefetch_istream& operator=(const prefetch_istream&) = delete;
+        prefetch_istream& operator=(prefetch_istream&&) = delete;
+        virtual ~prefetch_istream() {}
+
+        protected:
+        prefetch_streambuf _streambuf;
+    };
+
+    /// make_prefetch wraps a stream so that it is read ahead on a dedicated thread.
+    inline std::unique_ptr<std::istream> make_prefetch(std::unique_ptr<std::istream> source) {
+        return std::unique_ptr<std::istream>(new prefetch_istream(std::move(source)));
+    }
+
+    /// write_behind_streambuf fills blocks on the main thread, and writes them to a sink stream on a dedicated thread.
+    /// The main thread only waits when all the blocks are in flight.
+    class write_behind_streambuf : public std::streambuf {
+        public:
+        write_behind_streambuf(std::unique_ptr<std::ostream> sink, std::size_t block_size, std::size_t blocks) :
+            _sink(std::move(sink)),
+            _block_size(block_size),
+            _filled(blocks),
+            _free(blocks),
+            _block(block_size),
+            _failed(false),
+            _closed(false) {
+            for (std::size_t index = 1; index < blocks; ++index) {
+                _free.push(std::vector<char>(block_size));
+            }
+            setp(_block.data(), _block.data() + _block.size());
+            _writer = std::thread([this]() {
+                std::vector<char> block;
+                while (_filled.pop(block)) {
+                    if (!_failed) {
+                        const auto count =
+                            _sink->rdbuf()->sputn(block.data(), static_cast<std::streamsize>(block.size()));
+                        if (count != static_cast<std::streamsize>(block.size())) {
+                            _failed = true;
+                        }
+                    }
+                    _free.push(std::move(block));
+                    block = std::vector<char>();
+                }
+                if (!_failed && _sink->rdbuf()->pubsync() != 0) {
+                    _failed = true;
+                }
+            });
+        }
+        write_behind_streambuf(const write_behind_streambuf&) = delete;
+        write_behind_streambuf(write_behind_streambuf&&) = delete;
+        write_behind_streambuf& operator=(const write_behind_streambuf&) = delete;
+        write_behind_streambuf& operator=(write_behind_streambuf&&) = delete;
+        virtual ~write_behind_streambuf() {
+            close();
+        }
+
+        /// close hands over the last block, waits for the writer thread, and returns false if a write failed.
+        virtual bool close() {
+            if (!_closed) {
+                _closed = true;
+                hand_over();
+                _filled.close();
+                _writer.join();
+            }
+            return !_failed;
+        }
+
+        protected:
+        /// hand_over sends the current block to the writer thread, and waits for a free block.
+        virtual bool hand_over() {
+            if (pptr() > pbase()) {
+                _block.resize(static_cast<std::size_t>(pptr() - pbase()));
+                _filled.push(std::move(_block));
+                _block = std::vector<char>();
+                if (!_closed) {
+                    _free.pop(_block);
+                    _block.resize(_block_size);
+                }
+                setp(_block.data(), _block.data() + _block.size());
+            }
+            return !_failed;
+        }
+
+        /// overflow is called when the current block is full.
+        virtual int_type overflow(int_type character) override {
+            if (!hand_over()) {
+                return traits_type::eof();
+            }
+            if (!traits_type::eq_int_type(character, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(character);
+                pbump(1);
+            }
+            return traits_type::not_eof(character);
+        }
+
+        /// sync hands over the current block without waiting for the disk.
+        virtual int sync() override {
+            return hand_over() ? 0 : -1;
+        }
+
+        std::unique_ptr<std::ostream> _sink;
+        const std::size_t _block_size;
+        bounded_queue<std::vector<char>> _filled;
+        bounded_queue<std::vector<char>> _free;
+        std::vector<char> _block;
+        std::atomic<bool> _failed;
+        bool _closed;
+        std::thread _writer;
+    };
+
+    /// write_behind_ostream is an output stream writing to a sink stream through a write_behind_streambuf.
+    class write_behind_ostream : public std::ostream {
+        public:
+        write_behind_ostream(
+            std::unique_ptr<std::ostream> sink,
+            std::size_t block_size = async::block_size,
+            std::size_t blocks = async::blocks) :
+            std::ostream(nullptr),
+            _streambuf(std::move(sink), block_size, blocks) {
+            rdbuf(&_streambuf);
+        }
+        write_behind_ostream(const write_behind_ostream&) = delete;
+        write_behind_ostream(write_behind_ostream&&) = delete;
+        write_behind_ostream& operator=(const write_behind_ostream&) = delete;
+        write_behind_ostream& operator=(write_behind_ostream&&) = delete;
+        virtual ~write_behind_ostream() {}
+
+        /// close writes the pending blocks, and throws if a write failed.
+        virtual void close() {
+            if (!_streambuf.close()) {
+                throw std::runtime_error("writing the output failed");
+            }
+        }
+
+        protected:
+        write_behind_streambuf _streambuf;
+    };
+
+    /// events_per_chunk is the default number of events handed over at once by a reader thread.
+    constexpr std::size_t events_per_chunk = 1 << 14;
+
+    /// reader decodes a plain Event Stream on a dedicated thread, and hands over its events in chunks.
+    /// The thread decodes ahead of the caller, hence reading and decoding overlap with the caller's work,
+    /// and several readers decode their inputs in parallel. Events are dispatched as decoded.
+    template <sepia::type event_stream_type>
+    class reader {
+        public:
+        reader(std::unique_ptr<std::istream> stream, std::size_t chunks = blocks) :
+            _filled(chunks),
+            _index(0),
+            _stream(std::move(stream)) {
+            _thread = std::thread([this]() {
+                try {
+                    std::vector<sepia::event<event_stream_type>> chunk;
+                    chunk.reserve(events_per_chunk);
+                    sepia::join_observable<event_stream_type>(
+                        std::move(_stream), [&](sepia::event<event_stream_type> event) {
+                            chunk.push_back(event);
+                            if (chunk.size() == events_per_chunk) {
+                                if (!_filled.push(std::move(chunk))) {
+                                    throw sepia::end_of_file();
+                                }
+                                chunk = std::vector<sepia::event<event_stream_type>>();
+                                chunk.reserve(events_per_chunk);
+                            }
+                        });
+                    if (!chunk.empty()) {
+                        _filled.push(std::move(chunk));
+                    }
+                } catch (...) {
+                    _exception = std::current_exception();
+                }
+                _filled.close();
+            });
+        }
+        reader(const reader&) = delete;
+        reader(reader&&) = delete;
+        reader& operator=(const reader&) = delete;
+        reader& operator=(reader&&) = delete;
+        virtual ~reader() {
+            _filled.close();
+            _thread.join();
+        }
+
+        /// next retrieves the next event, and returns false once the stream is exhausted.
+        virtual bool next(sepia::event<event_stream_type>& event) {
+            if (_index == _chunk.size()) {
+                _index = 0;
+                _chunk.clear();
+                if (!_filled.pop(_chunk)) {
+                    if (_exception) {
+                        std::rethrow_exception(_exception);
+                    }
+                    return false;
+                }
+            }
+            event = _chunk[_index];
+            ++_index;
+            return true;
+        }
+
+        protected:
+        bounded_queue<std::vector<sepia::event<event_stream_type>>> _filled;
+        std::vector<sepia::event<event_stream_type>> _chunk;
+        std::size_t _index;
+        std::unique_ptr<std::istream> _stream;
+        std::exception_ptr _exception;
+        std::thread _thread;
+    };
+
+    /// parallel_for calls the given function for each index in the range [0, size[, with one thread per index.
+    template <typename Function>
+    inline void parallel_for(std::size_t size, Function function) {
+        std::vector<std::thread> threads;
+        threads.reserve(size);
+        std::vector<std::exception_ptr> exceptions(size);
+        for (std::size_t index = 0; index < size; ++index) {
+            threads.emplace_back([&, index]() {
+                try {
+                    function(index);
+                } catch (...) {
+                    exceptions[index] = std::current_exception();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (const auto& exception : exceptions) {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+    }
+}
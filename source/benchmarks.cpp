@@ -0,0 +1,561 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "../third_party/tarsier/source/convert.hpp"
+#include "../third_party/tarsier/source/hash.hpp"
+#include "../third_party/tarsier/source/replicate.hpp"
+#include "cpu.hpp"
+#include "csv.hpp"
+#include "dat.hpp"
+#include "frames.hpp"
+#include "html.hpp"
+#include "stages.hpp"
+#include "synthetic.hpp"
+#include <chrono>
+#include <iomanip>
+
+/// null_streambuf discards its output after buffering it, to measure formatting without disk writes.
+class null_streambuf : public std::streambuf {
+    public:
+    null_streambuf() : _buffer(1 << 16) {
+        setp(_buffer.data(), _buffer.data() + _buffer.size());
+    }
+    null_streambuf(const null_streambuf&) = delete;
+    null_streambuf(null_streambuf&&) = delete;
+    null_streambuf& operator=(const null_streambuf&) = delete;
+    null_streambuf& operator=(null_streambuf&&) = delete;
+    virtual ~null_streambuf() {}
+
+    protected:
+    virtual int_type overflow(int_type character) override {
+        setp(_buffer.data(), _buffer.data() + _buffer.size());
+        if (!traits_type::eq_int_type(character, traits_type::eof())) {
+            sputc(traits_type::to_char_type(character));
+        }
+        return traits_type::not_eof(character);
+    }
+
+    std::vector<char> _buffer;
+};
+
+/// measurement holds the result of a benchmark.
+struct measurement {
+    std::string name;
+    uint64_t events;
+    uint64_t bytes;
+    double duration;
+};
+
+/// measure runs the given loop several times and keeps the fastest run.
+/// The loop must return the number of processed events.
+template <typename Loop>
+measurement measure(const std::string& name, uint64_t bytes, std::size_t repeat, Loop loop) {
+    measurement result{name, 0, bytes, std::numeric_limits<double>::infinity()};
+    for (std::size_t index = 0; index < repeat; ++index) {
+        const auto begin = std::chrono::steady_clock::now();
+        result.events = loop();
+        const auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        if (duration < result.duration) {
+            result.duration = duration;
+        }
+    }
+    std::cerr << name << ": " << static_cast<uint64_t>(result.events / result.duration) << " events/s" << std::endl;
+    return result;
+}
+
+/// type_to_string returns a text representation of the type enum.
+std::string type_to_string(sepia::type type) {
+    switch (type) {
+        case sepia::type::generic:
+            return "generic";
+        case sepia::type::dvs:
+            return "dvs";
+        case sepia::type::atis:
+            return "atis";
+        case sepia::type::color:
+            return "color";
+    }
+    return "unknown";
+}
+
+/// string_to_istream wraps an in-memory Event Stream in a stream compatible with sepia observables.
+std::unique_ptr<std::istream> string_to_istream(const std::string& bytes) {
+    return std::unique_ptr<std::istream>(new std::istringstream(bytes));
+}
+
+/// generate_recording encodes a deterministic synthetic recording.
+template <sepia::type event_stream_type>
+std::string generate_recording(uint64_t number_of_events, uint16_t width, uint16_t height, uint64_t seed) {
+    std::ostringstream stream;
+    {
+        sepia::write_to_reference<event_stream_type> write(stream, width, height);
+        synthetic::poisson<event_stream_type>(
+            number_of_events, width, height, 1.0, seed, [&](sepia::event<event_stream_type> event) { write(event); });
+    }
+    return stream.str();
+}
+
+/// hash_events hashes events as statistics does.
+/// The timestamps and the spatial coordinates are hashed independently.
+template <sepia::type event_stream_type>
+struct hash_events {
+    static uint64_t run(const std::string& recording, std::pair<uint64_t, uint64_t>& hash_value) {
+        uint64_t events = 0;
+        sepia::join_observable<event_stream_type>(
+            string_to_istream(recording),
+            tarsier::make_replicate<sepia::event<event_stream_type>>(
+                [&](sepia::event<event_stream_type>) { ++events; },
+                tarsier::make_convert<sepia::event<event_stream_type>>(
+                    [](sepia::event<event_stream_type> event) -> uint64_t { return event.t; },
+                    tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> value) { hash_value = value; })),
+                tarsier::make_convert<sepia::event<event_stream_type>>(
+                    [](sepia::event<event_stream_type> event) -> uint16_t { return event.x; },
+                    tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> value) { hash_value = value; })),
+                tarsier::make_convert<sepia::event<event_stream_type>>(
+                    [](sepia::event<event_stream_type> event) -> uint16_t { return event.y; },
+                    tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> value) { hash_value = value; }))));
+        return events;
+    }
+};
+template <>
+struct hash_events<sepia::type::generic> {
+    static uint64_t run(const std::string& recording, std::pair<uint64_t, uint64_t>& hash_value) {
+        uint64_t events = 0;
+        sepia::join_observable<sepia::type::generic>(
+            string_to_istream(recording),
+            tarsier::make_replicate<sepia::generic_event>(
+                [&](sepia::generic_event) { ++events; },
+                tarsier::make_convert<sepia::generic_event>(
+                    [](sepia::generic_event generic_event) -> uint64_t { return generic_event.t; },
+                    tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> value) { hash_value = value; }))));
+        return events;
+    }
+};
+
+/// format_csv runs es_to_csv's loop, which formats batches of events with the formatter specialized
+/// for the selected columns, and returns the number of events.
+template <sepia::type event_stream_type>
+uint64_t format_csv(const std::string& recording, uint32_t selected) {
+    const std::size_t events_per_batch = 1 << 14;
+    const auto format = csv::make_formatter<event_stream_type>(selected);
+    uint64_t events = 0;
+    null_streambuf streambuf;
+    std::ostream output(&streambuf);
+    std::vector<sepia::event<event_stream_type>> batch;
+    batch.reserve(events_per_batch);
+    std::string buffer;
+    const auto flush = [&]() {
+        format(batch, buffer);
+        output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+        batch.clear();
+    };
+    output << csv::header<event_stream_type>(selected);
+    sepia::join_observable<event_stream_type>(
+        string_to_istream(recording), [&](const sepia::event<event_stream_type>& event) {
+            ++events;
+            batch.push_back(event);
+            if (batch.size() == events_per_batch) {
+                flush();
+            }
+        });
+    flush();
+    return events;
+}
+
+/// benchmark_type measures the decode loops behind cut, es_to_csv and statistics for one event type.
+template <sepia::type event_stream_type>
+void benchmark_type(
+    uint64_t number_of_events,
+    uint16_t width,
+    uint16_t height,
+    uint64_t seed,
+    std::size_t repeat,
+    std::vector<measurement>& measurements) {
+    const auto recording = generate_recording<event_stream_type>(number_of_events, width, height, seed);
+    const auto name = type_to_string(event_stream_type);
+    measurements.push_back(measure("decode/" + name, recording.size(), repeat, [&]() {
+        uint64_t events = 0;
+        sepia::join_observable<event_stream_type>(
+            string_to_istream(recording), [&](sepia::event<event_stream_type>) { ++events; });
+        return events;
+    }));
+    measurements.push_back(measure("cut/" + name, recording.size(), repeat, [&]() {
+        const uint64_t begin = number_of_events / 4;
+        const uint64_t end = begin + number_of_events / 2;
+        uint64_t events = 0;
+        std::ostringstream output;
+        sepia::write_to_reference<event_stream_type> write(output, width, height);
+        auto cut = stages::make_cut<sepia::event<event_stream_type>>(
+            begin, end, [&](sepia::event<event_stream_type> event) { write(event); });
+        sepia::join_observable<event_stream_type>(
+            string_to_istream(recording), [&](sepia::event<event_stream_type> event) {
+                ++events;
+                cut(event);
+            });
+        return events;
+    }));
+    measurements.push_back(measure("es_to_csv/" + name, recording.size(), repeat, [&]() {
+        return format_csv<event_stream_type>(recording, (1u << csv::columns<event_stream_type>().size()) - 1);
+    }));
+    if (event_stream_type != sepia::type::generic) {
+        measurements.push_back(measure("es_to_csv/" + name + "/t,x,y", recording.size(), repeat, [&]() {
+            return format_csv<event_stream_type>(recording, csv::parse_columns<event_stream_type>("t,x,y"));
+        }));
+    }
+    measurements.push_back(measure("statistics/" + name, recording.size(), repeat, [&]() {
+        std::pair<uint64_t, uint64_t> hash_value;
+        return hash_events<event_stream_type>::run(recording, hash_value);
+    }));
+}
+
+/// benchmark_crop measures crop's decode loop, which does not support generic events.
+template <sepia::type event_stream_type>
+void benchmark_crop(
+    uint64_t number_of_events,
+    uint16_t width,
+    uint16_t height,
+    uint64_t seed,
+    std::size_t repeat,
+    std::vector<measurement>& measurements) {
+    const auto recording = generate_recording<event_stream_type>(number_of_events, width, height, seed);
+    measurements.push_back(measure("crop/" + type_to_string(event_stream_type), recording.size(), repeat, [&]() {
+        const uint16_t left = width / 4;
+        const uint16_t bottom = height / 4;
+        uint64_t events = 0;
+        std::ostringstream output;
+        sepia::write_to_reference<event_stream_type> write(output, width / 2, height / 2);
+        auto crop = stages::make_crop<sepia::event<event_stream_type>>(
+            left, bottom, width / 2, height / 2, false, [&](sepia::event<event_stream_type> event) {
+                write(event);
+            });
+        sepia::join_observable<event_stream_type>(
+            string_to_istream(recording), [&](sepia::event<event_stream_type> event) {
+                ++events;
+                crop(event);
+            });
+        return events;
+    }));
+}
+
+/// benchmark_dat measures the .dat observables used by dat_to_es.
+void benchmark_dat(
+    uint64_t number_of_events,
+    uint16_t width,
+    uint16_t height,
+    uint64_t seed,
+    std::size_t repeat,
+    std::vector<measurement>& measurements) {
+    const dat::header header{2, width, height};
+    std::string td;
+    std::string aps;
+    {
+        std::ostringstream td_stream;
+        std::ostringstream aps_stream;
+        dat::write_header(td_stream, header);
+        dat::write_header(aps_stream, header);
+        synthetic::poisson<sepia::type::atis>(
+            number_of_events, width, height, 1.0, seed, [&](sepia::atis_event atis_event) {
+                const auto bytes = dat::dvs_event_to_bytes(
+                    {atis_event.t, atis_event.x, atis_event.y, atis_event.polarity}, header);
+                (atis_event.is_threshold_crossing ? aps_stream : td_stream)
+                    .write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            });
+        td = td_stream.str();
+        aps = aps_stream.str();
+    }
+    measurements.push_back(measure("dat_to_es/td", td.size(), repeat, [&]() {
+        uint64_t events = 0;
+        std::istringstream stream(td);
+        const auto stream_header = dat::read_header(stream);
+        dat::reorder_counts counts{};
+        dat::td_observable(stream, stream_header, 0, counts, [&](sepia::dvs_event) { ++events; });
+        return events;
+    }));
+    measurements.push_back(measure("dat_to_es/td_aps", td.size() + aps.size(), repeat, [&]() {
+        uint64_t events = 0;
+        std::istringstream td_stream(td);
+        std::istringstream aps_stream(aps);
+        const auto stream_header = dat::read_header(td_stream);
+        dat::read_header(aps_stream);
+        dat::reorder_counts counts{};
+        dat::td_aps_observable(
+            td_stream, aps_stream, stream_header, 0, counts, [&](sepia::atis_event) { ++events; });
+        return events;
+    }));
+}
+
+/// benchmark_rainmaker measures the base64 encoding and the frame generation used by rainmaker.
+void benchmark_rainmaker(
+    uint64_t number_of_events,
+    uint16_t width,
+    uint16_t height,
+    uint64_t seed,
+    std::size_t repeat,
+    std::vector<measurement>& measurements) {
+    std::vector<sepia::color_event> color_events;
+    color_events.reserve(number_of_events);
+    synthetic::poisson<sepia::type::color>(
+        number_of_events, width, height, 1.0, seed, [&](sepia::color_event color_event) {
+            color_events.push_back(color_event);
+        });
+    {
+        std::vector<uint8_t> bytes(number_of_events * sizeof(sepia::color_event));
+        synthetic::random random(seed);
+        for (auto& byte : bytes) {
+            byte = static_cast<uint8_t>(random.below(256));
+        }
+        measurements.push_back(measure("html/bytes_to_encoded_characters", bytes.size(), repeat, [&]() {
+            return static_cast<uint64_t>(html::bytes_to_encoded_characters(bytes).size());
+        }));
+    }
+    measurements.push_back(
+        measure("rainmaker/frames", color_events.size() * sizeof(sepia::color_event), repeat, [&]() {
+            const uint64_t begin_t = 0;
+            const uint64_t end_t = color_events.empty() ? 1 : color_events.back().t + 1;
+            auto frametime = (end_t - begin_t) / std::max(
+                static_cast<uint64_t>(1),
+                static_cast<uint64_t>(color_events.size() / (static_cast<std::size_t>(width) * height)));
+            if (frametime == 0) {
+                frametime = 1;
+            }
+            uint64_t checksum = 0;
+            auto frame_generator = frames::make_generator(
+                std::vector<uint8_t>(static_cast<std::size_t>(width) * height * 4, 0),
+                width,
+                height,
+                begin_t,
+                end_t,
+                frametime,
+                [&](const std::vector<uint8_t>& frame) { checksum += frame[frame.size() / 2] + 1; });
+            for (auto color_event : color_events) {
+                frame_generator(color_event);
+            }
+            frame_generator.close();
+            if (checksum == 0) {
+                throw std::logic_error("rainmaker/frames did not generate frames");
+            }
+            return static_cast<uint64_t>(color_events.size());
+        }));
+}
+
+/// benchmark_kernels measures every variant of the dispatched kernels supported by the machine.
+/// The tests executable checks that each variant produces the same output as the scalar variant.
+void benchmark_kernels(
+    uint64_t number_of_events,
+    uint16_t width,
+    uint16_t height,
+    uint64_t seed,
+    std::size_t repeat,
+    std::vector<measurement>& measurements) {
+    std::vector<uint8_t> bytes(number_of_events * 8);
+    synthetic::random random(seed);
+    for (auto& byte : bytes) {
+        byte = static_cast<uint8_t>(random.below(256));
+    }
+    const auto selected = cpu::selected();
+    for (const auto level : cpu::levels()) {
+        if (!cpu::is_supported(level)) {
+            continue;
+        }
+        cpu::select(level);
+        const auto name = cpu::level_to_string(level);
+        for (const uint8_t version : {1, 2}) {
+            const dat::header header{version, width, height};
+            dat::records records;
+            records.resize(number_of_events);
+            measurements.push_back(measure(
+                "kernels/decode_records/v" + std::to_string(version) + "/" + name, bytes.size(), repeat, [&]() {
+                    dat::decode_records(bytes.data(), number_of_events, header, records);
+                    return number_of_events;
+                }));
+        }
+        std::string characters((bytes.size() / 3) * 4, '\0');
+        measurements.push_back(measure("kernels/encode_base64/" + name, bytes.size(), repeat, [&]() {
+            html::encode_base64(bytes.data(), bytes.size() / 3, &characters[0]);
+            return static_cast<uint64_t>(bytes.size() / 3);
+        }));
+    }
+    cpu::select(selected);
+}
+
+/// read_baseline retrieves the events rate of each benchmark from a previous JSON report.
+std::unordered_map<std::string, double> read_baseline(const std::string& filename) {
+    auto stream = sepia::filename_to_ifstream(filename);
+    const std::string json((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+    std::unordered_map<std::string, double> name_to_rate;
+    const std::string key("\"events_per_second\": ");
+    for (auto position = json.find("\"name\": \""); position != std::string::npos;
+         position = json.find("\"name\": \"", position)) {
+        position += 9;
+        const auto name_end = json.find('"', position);
+        const auto key_position = json.find(key, name_end);
+        if (name_end == std::string::npos || key_position == std::string::npos) {
+            throw std::runtime_error(std::string("the baseline '") + filename + "' is not a benchmarks report");
+        }
+        name_to_rate[json.substr(position, name_end - position)] = std::stod(json.substr(key_position + key.size()));
+        position = key_position;
+    }
+    return name_to_rate;
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {"benchmarks measures the throughput of each tool's hot path on synthetic recordings",
+         "Syntax: ./benchmarks [options]",
+         "Available options:",
+         "    -e [events], --events [events]            sets the number of events per recording",
+         "                                                  defaults to 1000000",
+         "    -x [width], --width [width]               sets the sensor width",
+         "                                                  defaults to 320",
+         "    -y [height], --height [height]            sets the sensor height",
+         "                                                  defaults to 240",
+         "    -s [seed], --seed [seed]                  sets the pseudo-random generator seed",
+         "                                                  defaults to 0",
+         "    -r [repeat], --repeat [repeat]            sets the number of runs per benchmark (the fastest is kept)",
+         "                                                  defaults to 3",
+         "    -o [path], --output [path]                writes the JSON report to a file instead of stdout",
+         "    -b [path], --baseline [path]              compares the results with a previous JSON report",
+         "    -t [threshold], --threshold [threshold]   sets the tolerated slowdown ratio in compare mode",
+         "                                                  defaults to 0.1",
+         "    -c [level], --cpu [level]                 sets the instruction set of the .dat decoding and base64",
+         "                                                  encoding kernels (scalar, sse4.2, avx2 or avx512),",
+         "                                                  every supported variant is measured separately",
+         "                                                  defaults to the best level supported by the processor",
+         "    -h, --help                                shows this help message"},
+        argc,
+        argv,
+        0,
+        {
+            {"events", {"e"}},
+            {"width", {"x"}},
+            {"height", {"y"}},
+            {"seed", {"s"}},
+            {"repeat", {"r"}},
+            {"output", {"o"}},
+            {"baseline", {"b"}},
+            {"threshold", {"t"}},
+            {"cpu", {"c"}},
+        },
+        {},
+        [](pontella::command command) {
+            cpu::select_from_command(command);
+            uint64_t number_of_events = 1000000;
+            {
+                const auto name_and_argument = command.options.find("events");
+                if (name_and_argument != command.options.end()) {
+                    number_of_events = std::stoull(name_and_argument->second);
+                }
+            }
+            uint16_t width = 320;
+            {
+                const auto name_and_argument = command.options.find("width");
+                if (name_and_argument != command.options.end()) {
+                    width = static_cast<uint16_t>(std::stoull(name_and_argument->second));
+                }
+            }
+            uint16_t height = 240;
+            {
+                const auto name_and_argument = command.options.find("height");
+                if (name_and_argument != command.options.end()) {
+                    height = static_cast<uint16_t>(std::stoull(name_and_argument->second));
+                }
+            }
+            if (width == 0 || height == 0) {
+                throw std::runtime_error("[width] and [height] must be strictly positive");
+            }
+            uint64_t seed = 0;
+            {
+                const auto name_and_argument = command.options.find("seed");
+                if (name_and_argument != command.options.end()) {
+                    seed = std::stoull(name_and_argument->second);
+                }
+            }
+            std::size_t repeat = 3;
+            {
+                const auto name_and_argument = command.options.find("repeat");
+                if (name_and_argument != command.options.end()) {
+                    repeat = std::stoull(name_and_argument->second);
+                    if (repeat == 0) {
+                        throw std::runtime_error("[repeat] must be strictly positive");
+                    }
+                }
+            }
+            auto threshold = 0.1;
+            {
+                const auto name_and_argument = command.options.find("threshold");
+                if (name_and_argument != command.options.end()) {
+                    threshold = std::stod(name_and_argument->second);
+                    if (threshold < 0 || threshold >= 1) {
+                        throw std::runtime_error("[threshold] must be a real number in the range [0, 1[");
+                    }
+                }
+            }
+            std::unordered_map<std::string, double> name_to_baseline_rate;
+            {
+                const auto name_and_argument = command.options.find("baseline");
+                if (name_and_argument != command.options.end()) {
+                    name_to_baseline_rate = read_baseline(name_and_argument->second);
+                }
+            }
+            std::unique_ptr<std::ostream> output;
+            {
+                const auto name_and_argument = command.options.find("output");
+                if (name_and_argument != command.options.end()) {
+                    output = sepia::filename_to_ofstream(name_and_argument->second);
+                }
+            }
+
+            std::vector<measurement> measurements;
+            benchmark_type<sepia::type::generic>(number_of_events, width, height, seed, repeat, measurements);
+            benchmark_type<sepia::type::dvs>(number_of_events, width, height, seed, repeat, measurements);
+            benchmark_type<sepia::type::atis>(number_of_events, width, height, seed, repeat, measurements);
+            benchmark_type<sepia::type::color>(number_of_events, width, height, seed, repeat, measurements);
+            benchmark_crop<sepia::type::dvs>(number_of_events, width, height, seed, repeat, measurements);
+            benchmark_crop<sepia::type::atis>(number_of_events, width, height, seed, repeat, measurements);
+            benchmark_crop<sepia::type::color>(number_of_events, width, height, seed, repeat, measurements);
+            benchmark_dat(number_of_events, width, height, seed, repeat, measurements);
+            benchmark_rainmaker(number_of_events, width, height, seed, repeat, measurements);
+            benchmark_kernels(number_of_events, width, height, seed, repeat, measurements);
+
+            // write the report
+            std::size_t regressions = 0;
+            std::ostringstream json;
+            json << std::fixed << std::setprecision(3);
+            json << "{\n    \"events\": " << number_of_events << ",\n    \"width\": " << width
+                 << ",\n    \"height\": " << height << ",\n    \"seed\": " << seed << ",\n    \"cpu\": \""
+                 << cpu::level_to_string(cpu::selected()) << "\",\n    \"benchmarks\": [\n";
+            for (std::size_t index = 0; index < measurements.size(); ++index) {
+                const auto& measurement = measurements[index];
+                const auto events_per_second = measurement.events / measurement.duration;
+                json << "        {\n            \"name\": \"" << measurement.name
+                     << "\",\n            \"events\": " << measurement.events
+                     << ",\n            \"bytes\": " << measurement.bytes
+                     << ",\n            \"duration\": " << measurement.duration
+                     << ",\n            \"events_per_second\": " << events_per_second
+                     << ",\n            \"megabytes_per_second\": " << measurement.bytes / measurement.duration / 1e6;
+                const auto name_and_baseline_rate = name_to_baseline_rate.find(measurement.name);
+                if (name_and_baseline_rate != name_to_baseline_rate.end()) {
+                    const auto ratio = events_per_second / name_and_baseline_rate->second;
+                    const auto is_regression = ratio < 1.0 - threshold;
+                    if (is_regression) {
+                        ++regressions;
+                        std::cerr << measurement.name << " is " << std::setprecision(1) << (1.0 - ratio) * 100.0
+                                  << "% slower than the baseline" << std::setprecision(3) << std::endl;
+                    }
+                    json << ",\n            \"baseline_events_per_second\": " << name_and_baseline_rate->second
+                         << ",\n            \"ratio\": " << ratio
+                         << ",\n            \"regression\": " << (is_regression ? "true" : "false");
+                }
+                json << "\n        }" << (index < measurements.size() - 1 ? "," : "") << "\n";
+            }
+            json << "    ]\n}\n";
+            if (output) {
+                *output << json.str();
+            } else {
+                std::cout << json.str();
+            }
+            if (regressions > 0) {
+                throw std::runtime_error(std::to_string(regressions) + " benchmark(s) regressed beyond the threshold");
+            }
+        });
+}
@@ -0,0 +1,390 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+/// blocked implements a block-structured container for Event Streams.
+/// A blocked file starts with a signature, a version byte, and a plain Event Stream header (prefixed by its size).
+/// It is followed by blocks, each made of a zone map and a payload.
+/// A payload contains the bytes of a plain Event Stream, encoded relative to the zone map's base timestamp
+/// (the timestamp of the last event before the block), hence each block can be decoded on its own,
+/// and the concatenation of the header and the payloads is exactly the equivalent plain Event Stream.
+/// The zone map precedes the payload (rather than following it) so that readers can skip blocks on pipes too.
+namespace blocked {
+    /// signature starts every blocked file.
+    const std::string signature = "Blocked Event Stream";
+
+    /// version is the container version.
+    constexpr uint8_t version = 1;
+
+    /// events_per_block is the default number of events in a block.
+    constexpr std::size_t events_per_block = 1 << 16;
+
+    /// zone_map summarizes the events of a block.
+    struct zone_map {
+        uint64_t payload_size;
+        uint64_t base_t;
+        uint64_t begin_t;
+        uint64_t end_t;
+        uint64_t events;
+        uint64_t dvs_events;
+        uint64_t increase_events;
+        uint64_t second_events;
+        uint16_t left;
+        uint16_t bottom;
+        uint16_t right;
+        uint16_t top;
+    };
+
+    /// zone_map_size is the size of a serialized zone map in bytes.
+    constexpr std::size_t zone_map_size = 8 * 8 + 2 * 4;
+
+    /// zone_map_to_bytes serializes a zone map (little endian).
+    inline std::array<uint8_t, zone_map_size> zone_map_to_bytes(const zone_map& map) {
+        std::array<uint8_t, zone_map_size> bytes;
+        auto byte_iterator = bytes.begin();
+        for (const auto value : {map.payload_size,
+                                 map.base_t,
+                                 map.begin_t,
+                                 map.end_t,
+                                 map.events,
+                                 map.dvs_events,
+                                 map.increase_events,
+                                 map.second_events}) {
+            for (std::size_t index = 0; index < 8; ++index) {
+                *byte_iterator = static_cast<uint8_t>((value >> (index * 8)) & 0xff);
+                ++byte_iterator;
+            }
+        }
+        for (const auto value : {map.left, map.bottom, map.right, map.top}) {
+            *byte_iterator = static_cast<uint8_t>(value & 0xff);
+            ++byte_iterator;
+            *byte_iterator = static_cast<uint8_t>((value >> 8) & 0xff);
+            ++byte_iterator;
+        }
+        return bytes;
+    }
+
+    /// bytes_to_zone_map parses a serialized zone map.
+    inline zone_map bytes_to_zone_map(const std::array<uint8_t, zone_map_size>& bytes) {
+        zone_map map;
+        auto byte_iterator = bytes.begin();
+        for (auto value : {&map.payload_size,
+                           &map.base_t,
+                           &map.begin_t,
+                           &map.end_t,
+                           &map.events,
+                           &map.dvs_events,
+                           &map.increase_events,
+                           &map.second_events}) {
+            *value = 0;
+            for (std::size_t index = 0; index < 8; ++index) {
+                *value |= static_cast<uint64_t>(*byte_iterator) << (index * 8);
+                ++byte_iterator;
+            }
+        }
+        for (auto value : {&map.left, &map.bottom, &map.right, &map.top}) {
+            *value = static_cast<uint16_t>(*byte_iterator | (*std::next(byte_iterator) << 8));
+            std::advance(byte_iterator, 2);
+        }
+        return map;
+    }
+
+    /// update_zone_map adds an event to a zone map (except for the payload size).
+    inline void update_zone_map(zone_map& map, const sepia::generic_event& generic_event) {
+        map.end_t = generic_event.t;
+    }
+    inline void update_zone_map(zone_map& map, sepia::dvs_event dvs_event) {
+        map.end_t = dvs_event.t;
+        ++map.dvs_events;
+        if (dvs_event.is_increase) {
+            ++map.increase_events;
+        }
+        map.left = std::min(map.left, dvs_event.x);
+        map.bottom = std::min(map.bottom, dvs_event.y);
+        map.right = std::max(map.right, dvs_event.x);
+        map.top = std::max(map.top, dvs_event.y);
+    }
+    inline void update_zone_map(zone_map& map, sepia::atis_event atis_event) {
+        map.end_t = atis_event.t;
+        if (atis_event.is_threshold_crossing) {
+            if (atis_event.polarity) {
+                ++map.second_events;
+            }
+        } else {
+            ++map.dvs_events;
+            if (atis_event.polarity) {
+                ++map.increase_events;
+            }
+        }
+        map.left = std::min(map.left, atis_event.x);
+        map.bottom = std::min(map.bottom, atis_event.y);
+        map.right = std::max(map.right, atis_event.x);
+        map.top = std::max(map.top, atis_event.y);
+    }
+    inline void update_zone_map(zone_map& map, sepia::color_event color_event) {
+        map.end_t = color_event.t;
+        map.left = std::min(map.left, color_event.x);
+        map.bottom = std::min(map.bottom, color_event.y);
+        map.right = std::max(map.right, color_event.x);
+        map.top = std::max(map.top, color_event.y);
+    }
+
+    /// write_to_reference writes events to a blocked container.
+    /// Events are buffered until a block is full, and the last block is written by the destructor.
+    template <sepia::type event_stream_type>
+    class write_to_reference {
+        public:
+        write_to_reference(
+            std::ostream& event_stream,
+            uint16_t width,
+            uint16_t height,
+            std::size_t events_per_block = blocked::events_per_block) :
+            _event_stream(event_stream),
+            _width(width),
+            _height(height),
+            _events_per_block(events_per_block),
+            _base_t(0) {
+            if (_events_per_block == 0) {
+                throw std::runtime_error("the number of events per block must be strictly positive");
+            }
+            std::ostringstream header_stream;
+            { sepia::write_to_reference<event_stream_type> write(header_stream, _width, _height); }
+            _header_bytes = header_stream.str();
+            _event_stream.write(signature.data(), signature.size());
+            _event_stream.put(static_cast<char>(version));
+            _event_stream.put(static_cast<char>(_header_bytes.size()));
+            _event_stream.write(_header_bytes.data(), _header_bytes.size());
+            _events.reserve(_events_per_block);
+        }
+        write_to_reference(const write_to_reference&) = delete;
+        write_to_reference(write_to_reference&&) = default;
+        write_to_reference& operator=(const write_to_reference&) = delete;
+        write_to_reference& operator=(write_to_reference&&) = delete;
+        virtual ~write_to_reference() {
+            flush();
+        }
+
+        /// operator() handles an event.
+        virtual void operator()(sepia::event<event_stream_type> event) {
+            if (!_events.empty() && event.t < _events.back().t) {
+                throw std::logic_error("the events must be sorted by timestamp");
+            }
+            _events.push_back(event);
+            if (_events.size() == _events_per_block) {
+                flush();
+            }
+        }
+
+        /// flush writes the buffered events as a block.
+        virtual void flush() {
+            if (_events.empty()) {
+                return;
+            }
+            zone_map map{0,
+                         _base_t,
+                         _events.front().t,
+                         _events.front().t,
+                         _events.size(),
+                         0,
+                         0,
+                         0,
+                         std::numeric_limits<uint16_t>::max(),
+                         std::numeric_limits<uint16_t>::max(),
+                         0,
+                         0};
+            std::ostringstream payload_stream;
+            {
+                sepia::write_to_reference<event_stream_type> write(payload_stream, _width, _height);
+                for (auto event : _events) {
+                    update_zone_map(map, event);
+                    event.t -= _base_t;
+                    write(event);
+                }
+            }
+            const auto payload = payload_stream.str().substr(_header_bytes.size());
+            map.payload_size = payload.size();
+            if (event_stream_type == sepia::type::generic) {
+                map.left = 0;
+                map.bottom = 0;
+            }
+            const auto bytes = zone_map_to_bytes(map);
+            _event_stream.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            _event_stream.write(payload.data(), payload.size());
+            _base_t = _events.back().t;
+            _events.clear();
+        }
+
+        protected:
+        std::ostream& _event_stream;
+        const uint16_t _width;
+        const uint16_t _height;
+        const std::size_t _events_per_block;
+        uint64_t _base_t;
+        std::string _header_bytes;
+        std::vector<sepia::event<event_stream_type>> _events;
+    };
+
+    /// has_signature reads the beginning of a stream and returns true if it is a blocked container.
+    inline bool has_signature(std::istream& stream) {
+        std::string bytes(signature.size(), '\0');
+        stream.read(&bytes[0], bytes.size());
+        return stream.gcount() == static_cast<std::streamsize>(bytes.size()) && bytes == signature;
+    }
+
+    /// read_header consumes a blocked container's header, and returns the embedded Event Stream header bytes.
+    inline std::string read_header(std::istream& stream) {
+        if (!has_signature(stream)) {
+            throw std::runtime_error("the stream is not a blocked Event Stream");
+        }
+        const auto container_version = stream.get();
+        if (container_version != version) {
+            throw std::runtime_error("unsupported blocked Event Stream version");
+        }
+        const auto header_size = stream.get();
+        if (!stream.good() || header_size <= 0) {
+            throw std::runtime_error("the blocked Event Stream header is corrupted");
+        }
+        std::string header_bytes(static_cast<std::size_t>(header_size), '\0');
+        stream.read(&header_bytes[0], header_bytes.size());
+        if (stream.gcount() != header_size) {
+            throw std::runtime_error("the blocked Event Stream header is corrupted");
+        }
+        return header_bytes;
+    }
+
+    /// read_zone_map reads the next zone map, and returns false at the end of the stream.
+    inline bool read_zone_map(std::istream& stream, zone_map& map) {
+        std::array<uint8_t, zone_map_size> bytes;
+        stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+        if (stream.gcount() == 0) {
+            return false;
+        }
+        if (stream.gcount() != static_cast<std::streamsize>(bytes.size())) {
+            throw std::runtime_error("the blocked Event Stream is truncated");
+        }
+        map = bytes_to_zone_map(bytes);
+        return true;
+    }
+
+    /// skip_payload moves past a payload, seeking if the stream supports it.
+    inline void skip_payload(std::istream& stream, const zone_map& map) {
+        if (stream.tellg() != std::istream::pos_type(-1)) {
+            stream.seekg(static_cast<std::istream::off_type>(map.payload_size), std::istream::cur);
+            if (stream.good()) {
+                return;
+            }
+            throw std::runtime_error("the blocked Event Stream is truncated");
+        }
+        stream.clear();
+        stream.ignore(static_cast<std::streamsize>(map.payload_size));
+        if (stream.gcount() != static_cast<std::streamsize>(map.payload_size)) {
+            throw std::runtime_error("the blocked Event Stream is truncated");
+        }
+    }
+
+    /// observe_zone_maps dispatches the zone maps of a blocked container without decoding the payloads.
+    template <typename HandleZoneMap>
+    inline void observe_zone_maps(std::istream& stream, HandleZoneMap handle_zone_map) {
+        read_header(stream);
+        zone_map map;
+        while (read_zone_map(stream, map)) {
+            handle_zone_map(map);
+            skip_payload(stream, map);
+        }
+    }
+
+    /// join_observable decodes the blocks for which keep_block returns true, and dispatches their events.
+    /// Both keep_block and handle_event can throw sepia::end_of_file to stop reading.
+    template <sepia::type event_stream_type, typename KeepBlock, typename HandleEvent>
+    inline void
+    join_observable(std::unique_ptr<std::istream> stream, KeepBlock keep_block, HandleEvent&& handle_event) {
+        const auto header_bytes = read_header(*stream);
+        zone_map map;
+        auto stopped = false;
+        try {
+            while (!stopped && read_zone_map(*stream, map)) {
+                if (!keep_block(map)) {
+                    skip_payload(*stream, map);
+                    continue;
+                }
+                std::string bytes(header_bytes);
+                bytes.resize(header_bytes.size() + map.payload_size);
+                stream->read(&bytes[header_bytes.size()], static_cast<std::streamsize>(map.payload_size));
+                if (stream->gcount() != static_cast<std::streamsize>(map.payload_size)) {
+                    throw std::runtime_error("the blocked Event Stream is truncated");
+                }
+                const auto base_t = map.base_t;
+                sepia::join_observable<event_stream_type>(
+                    std::unique_ptr<std::istream>(new std::istringstream(bytes)),
+                    [&](sepia::event<event_stream_type> event) {
+                        event.t += base_t;
+                        try {
+                            handle_event(event);
+                        } catch (const sepia::end_of_file&) {
+                            stopped = true;
+                            throw;
+                        }
+                    });
+            }
+        } catch (const sepia::end_of_file&) {
+        }
+    }
+
+    /// plain_streambuf presents a blocked container as a plain Event Stream.
+    class plain_streambuf : public std::streambuf {
+        public:
+        plain_streambuf(std::unique_ptr<std::istream> source) : _source(std::move(source)) {
+            const auto header_bytes = read_header(*_source);
+            _buffer.assign(header_bytes.begin(), header_bytes.end());
+            setg(_buffer.data(), _buffer.data(), _buffer.data() + _buffer.size());
+        }
+        plain_streambuf(const plain_streambuf&) = delete;
+        plain_streambuf(plain_streambuf&&) = delete;
+        plain_streambuf& operator=(const plain_streambuf&) = delete;
+        plain_streambuf& operator=(plain_streambuf&&) = delete;
+        virtual ~plain_streambuf() {}
+
+        protected:
+        /// underflow reads the next block's payload.
+        virtual int_type underflow() override {
+            if (gptr() < egptr()) {
+                return traits_type::to_int_type(*gptr());
+            }
+            zone_map map;
+            do {
+                if (!read_zone_map(*_source, map)) {
+                    return traits_type::eof();
+                }
+            } while (map.payload_size == 0);
+            _buffer.resize(static_cast<std::size_t>(map.payload_size));
+            _source->read(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+            if (_source->gcount() != static_cast<std::streamsize>(_buffer.size())) {
+                throw std::runtime_error("the blocked Event Stream is truncated");
+            }
+            setg(_buffer.data(), _buffer.data(), _buffer.data() + _buffer.size());
+            return traits_type::to_int_type(*gptr());
+        }
+
+        std::unique_ptr<std::istream> _source;
+        std::vector<char> _buffer;
+    };
+
+    /// plain_istream is an input stream reading a blocked container through a plain_streambuf.
+    class plain_istream : public std::istream {
+        public:
+        plain_istream(std::unique_ptr<std::istream> source) : std::istream(nullptr), _streambuf(std::move(source)) {
+            rdbuf(&_streambuf);
+        }
+        plain_istream(const plain_istream&) = delete;
+        plain_istream(plain_istream&&) = delete;
+        plain_istream& operator=(const plain_istream&) = delete;
+        plain_istream& operator=(plain_istream&&) = delete;
+        virtual ~plain_istream() {}
+
+        protected:
+        plain_streambuf _streambuf;
+    };
+}
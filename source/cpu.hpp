@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../third_party/pontella/source/pontella.hpp"
+#include <string>
+#include <vector>
+
+/// CPU_TARGET compiles a function for the given instruction set, regardless of the compiler flags.
+/// Kernels are written once as inline functions, and wrapped in one function per instruction set,
+/// so that the compiler vectorizes each wrapper with the instructions it targets.
+/// Only GCC and Clang on x86 support per-function targets, other platforms always run the scalar variant.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_HAS_TARGETS 1
+#define CPU_TARGET(name) __attribute__((target(name)))
+#define CPU_INLINE inline __attribute__((always_inline))
+#else
+#define CPU_HAS_TARGETS 0
+#define CPU_TARGET(name)
+#define CPU_INLINE inline
+#endif
+
+/// cpu selects kernel variants at runtime, so that a single binary uses the vector units of recent processors.
+/// The dispatched kernels are the .dat decoding (dat::decode_records) and base64 encoding (html::encode_base64).
+/// The best supported level is detected on the first call to cpu::selected,
+/// and tools can override it with the --cpu option (for example to compare variants).
+namespace cpu {
+    /// level lists the instruction sets with dedicated kernel variants, from the most portable to the most recent.
+    enum class level {
+        scalar,
+        sse42,
+        avx2,
+        avx512,
+    };
+
+    /// levels lists every level, in the same order as the enum.
+    inline std::vector<level> levels() {
+        return {level::scalar, level::sse42, level::avx2, level::avx512};
+    }
+
+    /// level_to_string returns the name of a level.
+    inline std::string level_to_string(level value) {
+        switch (value) {
+            case level::scalar:
+                return "scalar";
+            case level::sse42:
+                return "sse4.2";
+            case level::avx2:
+                return "avx2";
+            case level::avx512:
+                return "avx512";
+        }
+        return "unknown";
+    }
+
+    /// parse_level converts a name ('scalar', 'sse4.2', 'avx2' or 'avx512') to a level.
+    inline level parse_level(const std::string& name) {
+        for (const auto candidate : levels()) {
+            if (name == level_to_string(candidate)) {
+                return candidate;
+            }
+        }
+        throw std::runtime_error(
+            "unknown CPU level '" + name + "' (expected 'scalar', 'sse4.2', 'avx2' or 'avx512')");
+    }
+
+    /// detect returns the most recent level supported by the processor and the operating system.
+    inline level detect() {
+#if CPU_HAS_TARGETS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("avx512vl")) {
+            return level::avx512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return level::avx2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return level::sse42;
+        }
+#endif
+        return level::scalar;
+    }
+
+    /// is_supported returns true if the kernels of the given level can run on this machine.
+    inline bool is_supported(level value) {
+        return static_cast<int>(value) <= static_cast<int>(detect());
+    }
+
+    /// selected returns the level used by the kernels.
+    inline level& selected() {
+        static level value = detect();
+        return value;
+    }
+
+    /// select overrides the detected level, and throws if the machine does not support the given level.
+    inline void select(level value) {
+        if (!is_supported(value)) {
+            throw std::runtime_error(
+                "this machine does not support the CPU level '" + level_to_string(value)
+                + "' (the best supported level is '" + level_to_string(detect()) + "')");
+        }
+        selected() = value;
+    }
+
+    /// select_from_command applies a command's cpu option, if present.
+    inline void select_from_command(const pontella::command& command) {
+        const auto name_and_argument = command.options.find("cpu");
+        if (name_and_argument != command.options.end()) {
+            select(parse_level(name_and_argument->second));
+        }
+    }
+}
@@ -1,39 +1,115 @@
 #include "../third_party/pontella/source/pontella.hpp"
 #include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include "stages.hpp"
+#include "tiles.hpp"
+
+/// crop_to dispatches the events from the given region to a writer.
+/// The blocks of a blocked input which do not overlap with the region are skipped without being decoded.
+/// If a tiles index is provided, the blocks without events in the region's tiles are skipped as well.
+template <sepia::type event_stream_type, typename Write>
+void crop_to(
+    io::event_stream input,
+    uint16_t left,
+    uint16_t bottom,
+    uint16_t width,
+    uint16_t height,
+    bool keep_offset,
+    const tiles::index* tiles_index,
+    Write& write) {
+    auto& session = profile::current();
+    const auto is_blocked = input.is_blocked;
+    const auto mask =
+        tiles_index ? tiles::region_mask(*tiles_index, left, bottom, width, height) : std::vector<uint8_t>();
+    std::size_t blocks = 0;
+    std::size_t skipped_blocks = 0;
+    auto sampled_write = profile::make_sampled<sepia::event<event_stream_type>>(
+        "write", [&](sepia::event<event_stream_type> event) { write(event); });
+    auto crop = stages::make_crop<sepia::event<event_stream_type>>(
+        left, bottom, width, height, keep_offset, [&](sepia::event<event_stream_type> event) {
+            ++session.events_out;
+            sampled_write(event);
+        });
+    profile::scope scope("decode");
+    io::join_observable<event_stream_type>(
+        std::move(input),
+        [&](const blocked::zone_map& zone_map) {
+            auto keep = zone_map.right >= left && zone_map.left < left + width && zone_map.top >= bottom
+                        && zone_map.bottom < bottom + height;
+            if (tiles_index) {
+                if (!tiles::matches(*tiles_index, blocks, zone_map)) {
+                    throw std::runtime_error("The tiles index does not match the input (delete it to rebuild it)");
+                }
+                keep = keep && tiles::intersects(tiles_index->blocks[blocks].bitmap, mask);
+            }
+            ++blocks;
+            if (!keep) {
+                ++skipped_blocks;
+            }
+            return keep;
+        },
+        [&](sepia::event<event_stream_type> event) {
+            ++session.events_in;
+            crop(event);
+        });
+    if (is_blocked) {
+        session.property("blocks", std::to_string(blocks));
+        session.property("skipped_blocks", std::to_string(skipped_blocks));
+        session.property(
+            "pruning_ratio",
+            std::to_string(blocks == 0 ? 0.0 : static_cast<double>(skipped_blocks) / static_cast<double>(blocks)));
+    }
+}
 
 /// crop creates a new Event Stream file with only events from the given region.
+/// The input is read and the output is written on dedicated threads, to overlap I/O with decoding and encoding.
 template <sepia::type event_stream_type>
-void crop(sepia::header header, const pontella::command& command) {
+void crop(io::event_stream input, const pontella::command& command) {
     const uint16_t left = std::stoull(command.arguments[2]);
     const uint16_t bottom = std::stoull(command.arguments[3]);
     const uint16_t width = std::stoull(command.arguments[4]);
     const uint16_t height = std::stoull(command.arguments[5]);
-    const uint16_t right = left + width;
-    const uint16_t top = bottom + height;
-
-    if (command.arguments[6] == "true") {
-    sepia::write<event_stream_type> write(
-        sepia::filename_to_ofstream(command.arguments[1]), header.width, header.height);
-    sepia::join_observable<event_stream_type>(
-        sepia::filename_to_ifstream(command.arguments[0]), [&](sepia::event<event_stream_type> event) {
-            if (event.x >= left && event.x < right && event.y >= bottom && event.y < top) {
-                write(event);
+    const auto keep_offset = stages::string_to_keep_offset(command.arguments[6]);
+    const uint16_t output_width = keep_offset ? input.header.width : width;
+    const uint16_t output_height = keep_offset ? input.header.height : height;
+    std::unique_ptr<tiles::index> tiles_index;
+    {
+        const auto name_and_argument = command.options.find("index");
+        if (name_and_argument != command.options.end()) {
+            if (!input.is_blocked || io::is_standard(command.arguments[0])) {
+                throw std::runtime_error(
+                    "The tiles index requires a blocked Event Stream file as input (see es_pipe --blocked)");
             }
-        });
-    } else if (command.arguments[6] == "false") {
-    sepia::write<event_stream_type> write(
-        sepia::filename_to_ofstream(command.arguments[1]), width, height);
-    sepia::join_observable<event_stream_type>(
-        sepia::filename_to_ifstream(command.arguments[0]), [&](sepia::event<event_stream_type> event) {
-            if (event.x >= left && event.x < right && event.y >= bottom && event.y < top) {
-                event.x -= left;
-                event.y -= bottom;
-                write(event);
+            tiles_index.reset(new tiles::index());
+            if (!tiles::read_index(name_and_argument->second, *tiles_index)) {
+                profile::scope scope("index");
+                auto stream = sepia::filename_to_ifstream(command.arguments[0]);
+                *tiles_index = tiles::build<event_stream_type>(
+                    *stream,
+                    input.header.width,
+                    input.header.height,
+                    std::max(1u, std::thread::hardware_concurrency()));
+                tiles::write_index(name_and_argument->second, *tiles_index);
             }
-        });
+            const auto expected_index = tiles::make_index(input.header.width, input.header.height);
+            if (tiles_index->columns != expected_index.columns || tiles_index->rows != expected_index.rows) {
+                throw std::runtime_error("The tiles index does not match the input (delete it to rebuild it)");
+            }
+        }
+    }
+    async::write_behind_ostream output(io::open_output(command.arguments[1]));
+    if (command.flags.find("blocked") != command.flags.end()) {
+        blocked::write_to_reference<event_stream_type> write(output, output_width, output_height);
+        crop_to<event_stream_type>(
+            std::move(input), left, bottom, width, height, keep_offset, tiles_index.get(), write);
     } else {
-        throw std::runtime_error("Please specify if keeps offset (true) or not (false)");
+        sepia::write_to_reference<event_stream_type> write(output, output_width, output_height);
+        crop_to<event_stream_type>(
+            std::move(input), left, bottom, width, height, keep_offset, tiles_index.get(), write);
     }
+    output.close();
 }
 
 int main(int argc, char* argv[]) {
@@ -41,41 +117,53 @@ int main(int argc, char* argv[]) {
         {
             "crop generates a new Event Stream file with only events from the given region.",
             "Syntax: ./crop [options] /path/to/input.es /path/to/output.es left bottom width height offset",
+            "    The string '-' (without quotes) can be used for the standard input and output",
             "Available options:",
-            "    -h, --help    shows this help message",
+            "    -b, --blocked              writes a blocked Event Stream, whose blocks can be skipped by readers",
+            "    -i [path], --index [path]  reads the tiles index of a blocked input from a sidecar file",
+            "                                   (the sidecar is created if it does not exist),",
+            "                                   the blocks without events in the region are skipped",
+            "    -p, --profile              prints a JSON profiling report on the standard error",
+            "    -h, --help                 shows this help message",
         },
         argc,
         argv,
         7,
-        {},
-        {},
-        [](pontella::command command) {
-            if (command.arguments[0] == command.arguments[1]) {
-                throw std::runtime_error("The Event Stream input and output must be different files");
+        {{"index", {"i"}}},
+        {{"blocked", {"b"}}, {"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            io::check_different(
+                command.arguments[0],
+                command.arguments[1],
+                "The Event Stream input and output must be different files");
+            profile::current().input(command.arguments[0]);
+            profile::current().output(command.arguments[1]);
+            auto input = io::open_event_stream(io::open_stream(command.arguments[0]), true);
+            if (!input.is_blocked) {
+                input.stream = async::make_prefetch(std::move(input.stream));
             }
-            const auto header = sepia::read_header(sepia::filename_to_ifstream(command.arguments[0]));
-            if (std::stoull(command.arguments[2]) + std::stoull(command.arguments[4]) > header.width
-                || std::stoull(command.arguments[3]) + std::stoull(command.arguments[5]) > header.height) {
+            if (std::stoull(command.arguments[2]) + std::stoull(command.arguments[4]) > input.header.width
+                || std::stoull(command.arguments[3]) + std::stoull(command.arguments[5]) > input.header.height) {
                 throw std::runtime_error("The selected region is out of scope");
             }
-            switch (header.event_stream_type) {
+            switch (input.header.event_stream_type) {
                 case sepia::type::generic: {
                     throw std::runtime_error("Unsupported event type: generic");
                     break;
                 }
                 case sepia::type::dvs: {
-                    crop<sepia::type::dvs>(header, command);
+                    crop<sepia::type::dvs>(std::move(input), command);
                     break;
                 }
                 case sepia::type::atis: {
-                    crop<sepia::type::atis>(header, command);
+                    crop<sepia::type::atis>(std::move(input), command);
                     break;
                 }
                 case sepia::type::color: {
-                    crop<sepia::type::color>(header, command);
+                    crop<sepia::type::color>(std::move(input), command);
                     break;
                 }
             }
-        });
+        }));
     return 0;
 }
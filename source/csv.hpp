@@ -0,0 +1,268 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+#include "blocked.hpp"
+#include <algorithm>
+#include <sstream>
+
+namespace csv {
+    /// header returns the CSV header line for the given event type.
+    template <sepia::type event_stream_type>
+    inline std::string header();
+    template <>
+    inline std::string header<sepia::type::generic>() {
+        return "t,bytes\n";
+    }
+    template <>
+    inline std::string header<sepia::type::dvs>() {
+        return "t,x,y,is_increase\n";
+    }
+    template <>
+    inline std::string header<sepia::type::atis>() {
+        return "t,x,y,is_threshold_crossing,polarity\n";
+    }
+    template <>
+    inline std::string header<sepia::type::color>() {
+        return "t,x,y,r,g,b\n";
+    }
+
+    /// write_line formats an event as a CSV line.
+    inline void write_line(std::ostream& output, const sepia::generic_event& generic_event) {
+        output << generic_event.t << ",";
+        output << std::hex;
+        for (std::size_t index = 0; index < generic_event.bytes.size(); ++index) {
+            output << static_cast<uint32_t>(generic_event.bytes[index]);
+            if (index == generic_event.bytes.size() - 1) {
+                output << "\n";
+            } else {
+                output << " ";
+            }
+        }
+        output << std::dec;
+    }
+    inline void write_line(std::ostream& output, sepia::dvs_event dvs_event) {
+        output << dvs_event.t << "," << dvs_event.x << "," << dvs_event.y << "," << dvs_event.is_increase << "\n";
+    }
+    inline void write_line(std::ostream& output, sepia::atis_event atis_event) {
+        output << atis_event.t << "," << atis_event.x << "," << atis_event.y << ","
+               << atis_event.is_threshold_crossing << "," << atis_event.polarity << "\n";
+    }
+    inline void write_line(std::ostream& output, sepia::color_event color_event) {
+        output << color_event.t << "," << color_event.x << "," << color_event.y << ","
+               << static_cast<uint32_t>(color_event.r) << "," << static_cast<uint32_t>(color_event.g) << ","
+               << static_cast<uint32_t>(color_event.b) << "\n";
+    }
+
+    /// columns returns the names of the columns for the given event type, in output order.
+    template <sepia::type event_stream_type>
+    inline std::vector<std::string> columns();
+    template <>
+    inline std::vector<std::string> columns<sepia::type::generic>() {
+        return {"t", "bytes"};
+    }
+    template <>
+    inline std::vector<std::string> columns<sepia::type::dvs>() {
+        return {"t", "x", "y", "is_increase"};
+    }
+    template <>
+    inline std::vector<std::string> columns<sepia::type::atis>() {
+        return {"t", "x", "y", "is_threshold_crossing", "polarity"};
+    }
+    template <>
+    inline std::vector<std::string> columns<sepia::type::color>() {
+        return {"t", "x", "y", "r", "g", "b"};
+    }
+
+    /// parse_columns converts a comma-separated list of column names to a set of columns,
+    /// where the bit n is set if the n-th column (in output order) is selected.
+    template <sepia::type event_stream_type>
+    inline uint32_t parse_columns(const std::string& names) {
+        const auto available_columns = columns<event_stream_type>();
+        uint32_t selected = 0;
+        std::istringstream stream(names);
+        for (std::string name; std::getline(stream, name, ',');) {
+            const auto column = std::find(available_columns.begin(), available_columns.end(), name);
+            if (column == available_columns.end()) {
+                std::string message("unknown column '" + name + "', the available columns are");
+                for (const auto& available_column : available_columns) {
+                    message += " " + available_column;
+                }
+                throw std::runtime_error(message);
+            }
+            selected |= 1u << static_cast<uint32_t>(column - available_columns.begin());
+        }
+        if (selected == 0) {
+            throw std::runtime_error("at least one column must be selected");
+        }
+        return selected;
+    }
+
+    /// header returns the CSV header line for a set of columns.
+    template <sepia::type event_stream_type>
+    inline std::string header(uint32_t selected) {
+        const auto available_columns = columns<event_stream_type>();
+        std::string line;
+        for (std::size_t index = 0; index < available_columns.size(); ++index) {
+            if ((selected >> index) & 1) {
+                if (!line.empty()) {
+                    line.push_back(',');
+                }
+                line += available_columns[index];
+            }
+        }
+        line.push_back('\n');
+        return line;
+    }
+
+    /// append_unsigned appends the decimal representation of an integer to a buffer.
+    inline void append_unsigned(std::string& buffer, uint64_t value) {
+        char digits[20];
+        std::size_t size = 0;
+        do {
+            digits[size] = static_cast<char>('0' + value % 10);
+            ++size;
+            value /= 10;
+        } while (value > 0);
+        for (; size > 0; --size) {
+            buffer.push_back(digits[size - 1]);
+        }
+    }
+
+    /// append_column appends a column to a buffer, preceded by a comma unless it is the first selected column.
+    /// selected and index are template parameters, hence the tests are resolved at compile time.
+    template <uint32_t selected, uint32_t index>
+    inline void append_column(std::string& buffer, uint64_t value) {
+        if ((selected >> index) & 1) {
+            if ((selected & ((1u << index) - 1)) != 0) {
+                buffer.push_back(',');
+            }
+            append_unsigned(buffer, value);
+        }
+    }
+
+    /// append_line formats the selected columns of an event as a CSV line.
+    template <uint32_t selected>
+    inline void append_line(std::string& buffer, const sepia::generic_event& generic_event) {
+        static const char hexadecimal_digits[] = "0123456789abcdef";
+        append_column<selected, 0>(buffer, generic_event.t);
+        if ((selected >> 1) & 1) {
+            if ((selected & 1) != 0) {
+                buffer.push_back(',');
+            }
+            for (std::size_t index = 0; index < generic_event.bytes.size(); ++index) {
+                if (index > 0) {
+                    buffer.push_back(' ');
+                }
+                if (generic_event.bytes[index] >= 16) {
+                    buffer.push_back(hexadecimal_digits[generic_event.bytes[index] >> 4]);
+                }
+                buffer.push_back(hexadecimal_digits[generic_event.bytes[index] & 0xf]);
+            }
+        }
+        buffer.push_back('\n');
+    }
+    template <uint32_t selected>
+    inline void append_line(std::string& buffer, const sepia::dvs_event& dvs_event) {
+        append_column<selected, 0>(buffer, dvs_event.t);
+        append_column<selected, 1>(buffer, dvs_event.x);
+        append_column<selected, 2>(buffer, dvs_event.y);
+        append_column<selected, 3>(buffer, dvs_event.is_increase);
+        buffer.push_back('\n');
+    }
+    template <uint32_t selected>
+    inline void append_line(std::string& buffer, const sepia::atis_event& atis_event) {
+        append_column<selected, 0>(buffer, atis_event.t);
+        append_column<selected, 1>(buffer, atis_event.x);
+        append_column<selected, 2>(buffer, atis_event.y);
+        append_column<selected, 3>(buffer, atis_event.is_threshold_crossing);
+        append_column<selected, 4>(buffer, atis_event.polarity);
+        buffer.push_back('\n');
+    }
+    template <uint32_t selected>
+    inline void append_line(std::string& buffer, const sepia::color_event& color_event) {
+        append_column<selected, 0>(buffer, color_event.t);
+        append_column<selected, 1>(buffer, color_event.x);
+        append_column<selected, 2>(buffer, color_event.y);
+        append_column<selected, 3>(buffer, color_event.r);
+        append_column<selected, 4>(buffer, color_event.g);
+        append_column<selected, 5>(buffer, color_event.b);
+        buffer.push_back('\n');
+    }
+
+    /// formatter appends the CSV lines of a batch of events to a buffer.
+    template <typename Event>
+    using formatter = void (*)(const std::vector<Event>&, std::string&);
+
+    /// append_lines formats a batch of events with a set of columns known at compile time.
+    template <typename Event, uint32_t selected>
+    inline void append_lines(const std::vector<Event>& events, std::string& buffer) {
+        for (const auto& event : events) {
+            append_line<selected>(buffer, event);
+        }
+    }
+
+    /// formatters maps a set of columns known at runtime to its specialized formatter.
+    /// The table is unrolled at compile time, from the set with every column down to the empty set.
+    template <typename Event, uint32_t selected>
+    struct formatters {
+        static formatter<Event> find(uint32_t columns) {
+            return columns == selected ? &append_lines<Event, selected>
+                                       : formatters<Event, selected - 1>::find(columns);
+        }
+    };
+    template <typename Event>
+    struct formatters<Event, 0> {
+        static formatter<Event> find(uint32_t) {
+            return &append_lines<Event, 0>;
+        }
+    };
+
+    /// make_formatter returns the formatter specialized for a set of columns.
+    template <sepia::type event_stream_type>
+    inline formatter<sepia::event<event_stream_type>> make_formatter(uint32_t selected);
+    template <>
+    inline formatter<sepia::generic_event> make_formatter<sepia::type::generic>(uint32_t selected) {
+        return formatters<sepia::generic_event, (1u << 2) - 1>::find(selected);
+    }
+    template <>
+    inline formatter<sepia::dvs_event> make_formatter<sepia::type::dvs>(uint32_t selected) {
+        return formatters<sepia::dvs_event, (1u << 4) - 1>::find(selected);
+    }
+    template <>
+    inline formatter<sepia::atis_event> make_formatter<sepia::type::atis>(uint32_t selected) {
+        return formatters<sepia::atis_event, (1u << 5) - 1>::find(selected);
+    }
+    template <>
+    inline formatter<sepia::color_event> make_formatter<sepia::type::color>(uint32_t selected) {
+        return formatters<sepia::color_event, (1u << 6) - 1>::find(selected);
+    }
+
+    /// region is a rectangle of pixels, [left, left + width[ x [bottom, bottom + height[.
+    struct region {
+        uint64_t left;
+        uint64_t bottom;
+        uint64_t width;
+        uint64_t height;
+    };
+
+    /// is_in_region returns true if an event belongs to a region, generic events do not have coordinates.
+    template <typename Event>
+    inline bool is_in_region(const Event& event, const region& roi) {
+        return event.x >= roi.left && event.x < roi.left + roi.width && event.y >= roi.bottom
+               && event.y < roi.bottom + roi.height;
+    }
+    template <>
+    inline bool is_in_region<sepia::generic_event>(const sepia::generic_event&, const region&) {
+        return true;
+    }
+
+    /// keep_block returns true if a block may contain events after begin and in the region.
+    /// The bounding box is only compared with the region if has_roi is true, since the zone maps of generic
+    /// streams have an empty bounding box (and generic streams do not support regions).
+    inline bool keep_block(const blocked::zone_map& zone_map, uint64_t begin, const region& roi, bool has_roi) {
+        return zone_map.end_t >= begin
+               && (!has_roi
+                   || (zone_map.right >= roi.left && zone_map.left < roi.left + roi.width
+                       && zone_map.top >= roi.bottom && zone_map.bottom < roi.bottom + roi.height));
+    }
+}
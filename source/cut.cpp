@@ -1,61 +1,362 @@
 #include "../third_party/pontella/source/pontella.hpp"
 #include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include "follow.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <iomanip>
 
-/// cut creates a new Event Stream file with only events from the given time range.
+/// window writes the events from the time range [begin, end[ to its own output.
+/// The output and its writer thread are created on the first event, and released by close,
+/// hence only the windows overlapping the current timestamp hold resources.
 template <sepia::type event_stream_type>
-void cut(sepia::header header, const pontella::command& command) {
-    const uint64_t begin = std::stoull(command.arguments[2]);
-    const uint64_t end = std::stoull(command.arguments[3]) + begin;
-    sepia::write<event_stream_type> write(
-        sepia::filename_to_ofstream(command.arguments[1]), header.width, header.height);
-    sepia::join_observable<event_stream_type>(
-        sepia::filename_to_ifstream(command.arguments[0]), [&](sepia::event<event_stream_type> event) {
-            if (event.t >= begin) {
-                if (event.t < end) {
-                    write(event);
-                } else {
+class window {
+    public:
+    window(std::string filename, uint64_t begin, uint64_t end, uint16_t width, uint16_t height, bool is_blocked) :
+        _filename(std::move(filename)),
+        _begin(begin),
+        _end(end),
+        _width(width),
+        _height(height),
+        _is_blocked(is_blocked),
+        _closed(false) {}
+    window(const window&) = delete;
+    window(window&&) = delete;
+    window& operator=(const window&) = delete;
+    window& operator=(window&&) = delete;
+    virtual ~window() {}
+
+    /// begin returns the first timestamp of the window.
+    virtual uint64_t begin() const {
+        return _begin;
+    }
+
+    /// end returns the timestamp following the window.
+    virtual uint64_t end() const {
+        return _end;
+    }
+
+    /// operator() writes an event, opening the output if needed.
+    virtual void operator()(sepia::event<event_stream_type> event) {
+        if (!_output) {
+            open();
+        }
+        if (_is_blocked) {
+            (*_blocked_write)(event);
+        } else {
+            (*_write)(event);
+        }
+    }
+
+    /// close writes the pending events and releases the output.
+    /// A window without events still produces a valid (empty) Event Stream.
+    virtual void close() {
+        if (_closed) {
+            return;
+        }
+        if (!_output) {
+            open();
+        }
+        _closed = true;
+        _write.reset();
+        _blocked_write.reset();
+        _output->close();
+        _output.reset();
+    }
+
+    protected:
+    /// open creates the output and the writer.
+    virtual void open() {
+        _output.reset(new async::write_behind_ostream(io::open_output(_filename)));
+        if (_is_blocked) {
+            _blocked_write.reset(new blocked::write_to_reference<event_stream_type>(*_output, _width, _height));
+        } else {
+            _write.reset(new sepia::write_to_reference<event_stream_type>(*_output, _width, _height));
+        }
+    }
+
+    const std::string _filename;
+    const uint64_t _begin;
+    const uint64_t _end;
+    const uint16_t _width;
+    const uint16_t _height;
+    const bool _is_blocked;
+    bool _closed;
+    std::unique_ptr<async::write_behind_ostream> _output;
+    std::unique_ptr<sepia::write_to_reference<event_stream_type>> _write;
+    std::unique_ptr<blocked::write_to_reference<event_stream_type>> _blocked_write;
+};
+
+/// window_specification holds a window's output and time range, as given on the command line.
+struct window_specification {
+    std::string filename;
+    uint64_t begin;
+    uint64_t end;
+};
+
+/// cut_windows dispatches the events of every window in a single pass.
+/// Windows can overlap, and the input is not read past the end of the last window.
+/// The blocks of a blocked input which do not overlap with any window are skipped without being decoded.
+/// The input is either an io::event_stream or a follow::event_stream, see follow::observe.
+template <sepia::type event_stream_type, typename Input>
+void cut_windows(Input input, std::vector<window_specification> specifications, bool is_blocked) {
+    auto& session = profile::current();
+    std::stable_sort(
+        specifications.begin(),
+        specifications.end(),
+        [](const window_specification& first, const window_specification& second) {
+            return first.begin < second.begin;
+        });
+    std::vector<std::unique_ptr<window<event_stream_type>>> windows;
+    uint64_t end = 0;
+    for (const auto& specification : specifications) {
+        windows.emplace_back(new window<event_stream_type>(
+            specification.filename,
+            specification.begin,
+            specification.end,
+            input.header.width,
+            input.header.height,
+            is_blocked));
+        end = std::max(end, specification.end);
+    }
+    std::size_t next = 0;
+    std::vector<window<event_stream_type>*> active_windows;
+    auto sampled_write = profile::make_sampled<sepia::event<event_stream_type>>(
+        "write", [&](sepia::event<event_stream_type> event) {
+            for (auto active_window : active_windows) {
+                (*active_window)(event);
+                ++session.events_out;
+            }
+        });
+    {
+        profile::scope scope("decode");
+        follow::observe<event_stream_type>(
+            std::move(input),
+            [&](const blocked::zone_map& zone_map) {
+                if (zone_map.begin_t >= end) {
                     throw sepia::end_of_file();
                 }
-            }
+                return std::any_of(
+                    windows.begin(), windows.end(), [&](const std::unique_ptr<window<event_stream_type>>& window) {
+                        return zone_map.begin_t < window->end() && zone_map.end_t >= window->begin();
+                    });
+            },
+            [&](sepia::event<event_stream_type> event) {
+                ++session.events_in;
+                for (; next < windows.size() && windows[next]->begin() <= event.t; ++next) {
+                    active_windows.push_back(windows[next].get());
+                }
+                active_windows.erase(
+                    std::remove_if(
+                        active_windows.begin(),
+                        active_windows.end(),
+                        [&](window<event_stream_type>* active_window) {
+                            if (event.t >= active_window->end()) {
+                                active_window->close();
+                                return true;
+                            }
+                            return false;
+                        }),
+                    active_windows.end());
+                if (active_windows.empty() && next == windows.size()) {
+                    throw sepia::end_of_file();
+                }
+                if (!active_windows.empty()) {
+                    sampled_write(event);
+                }
+            },
+            []() {});
+    }
+    for (auto& window : windows) {
+        window->close();
+    }
+}
+
+/// segment_filename replaces the first '{}' in the pattern with the zero-padded segment index.
+std::string segment_filename(const std::string& pattern, uint64_t index) {
+    std::stringstream stream;
+    stream << std::setfill('0') << std::setw(4) << index;
+    auto filename = pattern;
+    filename.replace(filename.find("{}"), 2, stream.str());
+    return filename;
+}
+
+/// cut_segments splits the input into consecutive segments with the given duration, in a single pass.
+/// The segment n contains the events from [n * duration, (n + 1) * duration[, and only the segments
+/// between the first and the last event are written (intermediate empty segments included).
+template <sepia::type event_stream_type, typename Input>
+void cut_segments(Input input, uint64_t duration, const std::string& pattern, bool is_blocked) {
+    auto& session = profile::current();
+    const auto width = input.header.width;
+    const auto height = input.header.height;
+    std::unique_ptr<window<event_stream_type>> segment;
+    uint64_t index = 0;
+    const auto open_segment = [&](uint64_t segment_index) {
+        const auto filename = segment_filename(pattern, segment_index);
+        session.output(filename);
+        segment.reset(new window<event_stream_type>(
+            filename, segment_index * duration, (segment_index + 1) * duration, width, height, is_blocked));
+    };
+    auto sampled_write = profile::make_sampled<sepia::event<event_stream_type>>(
+        "write", [&](sepia::event<event_stream_type> event) {
+            (*segment)(event);
+            ++session.events_out;
         });
+    {
+        profile::scope scope("decode");
+        follow::observe<event_stream_type>(
+            std::move(input),
+            [](const blocked::zone_map&) { return true; },
+            [&](sepia::event<event_stream_type> event) {
+                ++session.events_in;
+                if (!segment) {
+                    index = event.t / duration;
+                    open_segment(index);
+                } else if (event.t >= segment->end()) {
+                    segment->close();
+                    for (++index; index < event.t / duration; ++index) {
+                        open_segment(index);
+                        segment->close();
+                    }
+                    open_segment(index);
+                }
+                sampled_write(event);
+            },
+            []() {});
+    }
+    if (segment) {
+        segment->close();
+    }
+}
+
+/// cut_input calls cut_segments if duration is positive, and cut_windows otherwise.
+template <typename Input>
+void cut_input(
+    Input input,
+    uint64_t duration,
+    const std::string& pattern,
+    const std::vector<window_specification>& specifications,
+    bool is_blocked) {
+    switch (input.header.event_stream_type) {
+        case sepia::type::generic: {
+            if (duration > 0) {
+                cut_segments<sepia::type::generic>(std::move(input), duration, pattern, is_blocked);
+            } else {
+                cut_windows<sepia::type::generic>(std::move(input), specifications, is_blocked);
+            }
+            break;
+        }
+        case sepia::type::dvs: {
+            if (duration > 0) {
+                cut_segments<sepia::type::dvs>(std::move(input), duration, pattern, is_blocked);
+            } else {
+                cut_windows<sepia::type::dvs>(std::move(input), specifications, is_blocked);
+            }
+            break;
+        }
+        case sepia::type::atis: {
+            if (duration > 0) {
+                cut_segments<sepia::type::atis>(std::move(input), duration, pattern, is_blocked);
+            } else {
+                cut_windows<sepia::type::atis>(std::move(input), specifications, is_blocked);
+            }
+            break;
+        }
+        case sepia::type::color: {
+            if (duration > 0) {
+                cut_segments<sepia::type::color>(std::move(input), duration, pattern, is_blocked);
+            } else {
+                cut_windows<sepia::type::color>(std::move(input), specifications, is_blocked);
+            }
+            break;
+        }
+    }
 }
 
 int main(int argc, char* argv[]) {
     return pontella::main(
         {
-            "cut generates a new Event Stream file with only events from the given time range.",
-            "Syntax: ./cut [options] /path/to/input.es /path/to/output.es begin duration",
+            "cut generates new Event Stream files with only events from the given time ranges.",
+            "Syntax: ./cut [options] /path/to/input.es /path/to/output.es begin duration [output begin duration]...",
+            "        ./cut [options] --segment duration /path/to/input.es /path/to/output_{}.es",
+            "    Every window is written in a single pass over the input, and windows can overlap",
+            "    The string '-' (without quotes) can be used for the standard input and output",
             "Available options:",
-            "    -h, --help    shows this help message",
+            "    -s [duration], --segment [duration]    splits the input into segments with the given duration",
+            "                                               (in microseconds), '{}' in the output is replaced",
+            "                                               with the segment index",
+            "    -b, --blocked                          writes blocked Event Streams,",
+            "                                               whose blocks can be skipped by readers",
+            "    -f, --follow                           follows a file which is still being written,",
+            "                                               each window is written as soon as it is complete",
+            "    -i [duration], --idle [duration]       stops following once the file has not grown",
+            "                                               for [duration] (in milliseconds), defaults to 0",
+            "                                               (follows until interrupted)",
+            "    -p, --profile                          prints a JSON profiling report on the standard error",
+            "    -h, --help                             shows this help message",
         },
         argc,
         argv,
-        4,
-        {},
-        {},
-        [](pontella::command command) {
-            if (command.arguments[0] == command.arguments[1]) {
-                throw std::runtime_error("The Event Stream input and output must be different files");
-            }
-            const auto header = sepia::read_header(sepia::filename_to_ifstream(command.arguments[0]));
-            switch (header.event_stream_type) {
-                case sepia::type::generic: {
-                    cut<sepia::type::generic>(header, command);
-                    break;
+        -1,
+        {{"segment", {"s"}}, {"idle", {"i"}}},
+        {{"blocked", {"b"}}, {"follow", {"f"}}, {"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            const auto is_blocked = command.flags.find("blocked") != command.flags.end();
+            const auto name_and_argument = command.options.find("segment");
+            uint64_t duration = 0;
+            std::vector<window_specification> specifications;
+            if (name_and_argument != command.options.end()) {
+                if (command.arguments.size() != 2) {
+                    throw std::runtime_error("The segment option expects an input and an output pattern");
+                }
+                duration = std::stoull(name_and_argument->second);
+                if (duration == 0) {
+                    throw std::runtime_error("[duration] must be a positive integer");
                 }
-                case sepia::type::dvs: {
-                    cut<sepia::type::dvs>(header, command);
-                    break;
+                if (command.arguments[1].find("{}") == std::string::npos || io::is_standard(command.arguments[1])) {
+                    throw std::runtime_error("The output pattern must contain '{}'");
                 }
-                case sepia::type::atis: {
-                    cut<sepia::type::atis>(header, command);
-                    break;
+            } else {
+                if (command.arguments.size() < 4 || (command.arguments.size() - 1) % 3 != 0) {
+                    throw std::runtime_error(
+                        "cut expects an input followed by one or several 'output begin duration' triplets");
                 }
-                case sepia::type::color: {
-                    cut<sepia::type::color>(header, command);
-                    break;
+                for (std::size_t index = 1; index < command.arguments.size(); index += 3) {
+                    const uint64_t begin = std::stoull(command.arguments[index + 1]);
+                    const uint64_t end = std::stoull(command.arguments[index + 2]) + begin;
+                    io::check_different(
+                        command.arguments[0],
+                        command.arguments[index],
+                        "The Event Stream input and output must be different files");
+                    if (io::is_standard(command.arguments[index]) && command.arguments.size() > 4) {
+                        throw std::runtime_error("The standard output can only be used with a single window");
+                    }
+                    specifications.push_back({command.arguments[index], begin, end});
+                    profile::current().output(command.arguments[index]);
                 }
             }
-        });
+            profile::current().input(command.arguments[0]);
+            if (command.flags.find("follow") != command.flags.end()) {
+                if (io::is_standard(command.arguments[0])) {
+                    throw std::runtime_error("The follow option requires a file");
+                }
+                follow::handle_signals();
+                cut_input(
+                    follow::open_event_stream(
+                        command.arguments[0],
+                        follow::parse_milliseconds(command, "idle", std::chrono::milliseconds(0))),
+                    duration,
+                    command.arguments[1],
+                    specifications,
+                    is_blocked);
+                return;
+            }
+            auto input = io::open_event_stream(io::open_stream(command.arguments[0]), true);
+            if (!input.is_blocked) {
+                input.stream = async::make_prefetch(std::move(input.stream));
+            }
+            cut_input(std::move(input), duration, command.arguments[1], specifications, is_blocked);
+        }));
     return 0;
 }
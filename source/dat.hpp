@@ -1,7 +1,9 @@
 #pragma once
 
 #include "../third_party/sepia/source/sepia.hpp"
+#include "cpu.hpp"
 #include <algorithm>
+#include <deque>
 
 namespace dat {
     /// header bundles a .dat file header's information.
@@ -102,141 +104,411 @@ namespace dat {
         };
     }
 
-    /// td_observable dispatches DVS events from a td stream.
-    /// The header must be read from the stream before calling this function.
-    template <typename HandleEvent>
-    inline void td_observable(std::istream& stream, header stream_header, HandleEvent handle_event) {
-        uint64_t previous_t = 0;
-        for (;;) {
-            std::array<uint8_t, 8> bytes;
-            stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-            if (stream.eof()) {
-                break;
+    /// records bundles decoded records as a structure of arrays, filled by decode_records.
+    /// y is flipped as in bytes_to_dvs_event, and may wrap around if the record is out of bounds.
+    struct records {
+        std::vector<uint32_t> ts;
+        std::vector<uint16_t> xs;
+        std::vector<uint16_t> ys;
+        std::vector<uint8_t> is_increases;
+
+        /// resize changes the capacity, in records.
+        void resize(std::size_t size) {
+            ts.resize(size);
+            xs.resize(size);
+            ys.resize(size);
+            is_increases.resize(size);
+        }
+    };
+
+    /// decode_records_kernel decodes count 8-byte records, starting at the given offset in the arrays.
+    /// Each record is read as a little-endian 64-bit word and split with shifts and masks,
+    /// which lets the compiler process several records per instruction.
+    CPU_INLINE void
+    decode_records_kernel(const uint8_t* bytes, std::size_t count, header stream_header, records& target) {
+        auto ts = target.ts.data();
+        auto xs = target.xs.data();
+        auto ys = target.ys.data();
+        auto is_increases = target.is_increases.data();
+        const auto flip = static_cast<uint16_t>(stream_header.height - 1);
+        if (stream_header.version < 2) {
+            for (std::size_t index = 0; index < count; ++index) {
+                const auto record = bytes + index * 8;
+                const auto word = static_cast<uint64_t>(record[0]) | (static_cast<uint64_t>(record[1]) << 8)
+                                  | (static_cast<uint64_t>(record[2]) << 16) | (static_cast<uint64_t>(record[3]) << 24)
+                                  | (static_cast<uint64_t>(record[4]) << 32) | (static_cast<uint64_t>(record[5]) << 40)
+                                  | (static_cast<uint64_t>(record[6]) << 48);
+                ts[index] = static_cast<uint32_t>(word);
+                xs[index] = static_cast<uint16_t>((word >> 32) & 0x1ff);
+                ys[index] = static_cast<uint16_t>(flip - ((word >> 41) & 0xff));
+                is_increases[index] = static_cast<uint8_t>((word >> 49) & 1);
             }
-            const auto dvs_event = bytes_to_dvs_event(bytes, stream_header);
-            if (dvs_event.t >= previous_t && dvs_event.x < stream_header.width && dvs_event.y < stream_header.height) {
-                handle_event(dvs_event);
-                previous_t = dvs_event.t;
+        } else {
+            for (std::size_t index = 0; index < count; ++index) {
+                const auto record = bytes + index * 8;
+                const auto word = static_cast<uint64_t>(record[0]) | (static_cast<uint64_t>(record[1]) << 8)
+                                  | (static_cast<uint64_t>(record[2]) << 16) | (static_cast<uint64_t>(record[3]) << 24)
+                                  | (static_cast<uint64_t>(record[4]) << 32) | (static_cast<uint64_t>(record[5]) << 40)
+                                  | (static_cast<uint64_t>(record[6]) << 48) | (static_cast<uint64_t>(record[7]) << 56);
+                ts[index] = static_cast<uint32_t>(word);
+                xs[index] = static_cast<uint16_t>((word >> 32) & 0x3fff);
+                ys[index] = static_cast<uint16_t>(flip - ((word >> 46) & 0x3fff));
+                is_increases[index] = static_cast<uint8_t>((word >> 60) & 1);
             }
         }
     }
 
-    /// aps_observable dispatches ATIS events from an aps stream.
-    /// The header must be read from the stream before calling this function.
-    template <typename HandleEvent>
-    inline void aps_observable(std::istream& stream, header stream_header, HandleEvent handle_event) {
-        uint64_t previous_t = 0;
-        for (;;) {
-            std::array<uint8_t, 8> bytes;
-            stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-            if (stream.eof()) {
+    /// decode_records_* are the instruction set variants of decode_records_kernel.
+    inline void decode_records_scalar(const uint8_t* bytes, std::size_t count, header stream_header, records& target) {
+        decode_records_kernel(bytes, count, stream_header, target);
+    }
+    CPU_TARGET("sse4.2")
+    inline void decode_records_sse42(const uint8_t* bytes, std::size_t count, header stream_header, records& target) {
+        decode_records_kernel(bytes, count, stream_header, target);
+    }
+    CPU_TARGET("avx2")
+    inline void decode_records_avx2(const uint8_t* bytes, std::size_t count, header stream_header, records& target) {
+        decode_records_kernel(bytes, count, stream_header, target);
+    }
+    CPU_TARGET("avx512f,avx512bw,avx512vl")
+    inline void decode_records_avx512(const uint8_t* bytes, std::size_t count, header stream_header, records& target) {
+        decode_records_kernel(bytes, count, stream_header, target);
+    }
+
+    /// decode_records decodes count 8-byte records with the variant of the selected CPU level.
+    /// The target must hold at least count records.
+    inline void decode_records(const uint8_t* bytes, std::size_t count, header stream_header, records& target) {
+        switch (cpu::selected()) {
+            case cpu::level::scalar:
+                decode_records_scalar(bytes, count, stream_header, target);
+                break;
+            case cpu::level::sse42:
+                decode_records_sse42(bytes, count, stream_header, target);
                 break;
+            case cpu::level::avx2:
+                decode_records_avx2(bytes, count, stream_header, target);
+                break;
+            case cpu::level::avx512:
+                decode_records_avx512(bytes, count, stream_header, target);
+                break;
+        }
+    }
+
+    /// reader reads a .dat stream in blocks, and decodes each block with decode_records.
+    /// The header must be read from the stream before creating a reader.
+    class reader {
+        public:
+        /// records_per_block is the number of records read at once.
+        static constexpr std::size_t records_per_block = 1 << 16;
+
+        reader(std::istream& stream, header stream_header) :
+            _stream(stream),
+            _header(stream_header),
+            _bytes(records_per_block * 8),
+            _remainder(0),
+            _index(0),
+            _size(0),
+            _eof(false) {
+            _records.resize(records_per_block);
+        }
+        reader(const reader&) = delete;
+        reader(reader&&) = default;
+        reader& operator=(const reader&) = delete;
+        reader& operator=(reader&&) = delete;
+        virtual ~reader() {}
+
+        /// next retrieves the next record, and returns false at the end of the stream.
+        /// A partial record at the end of the stream is ignored.
+        virtual bool next(sepia::dvs_event& dvs_event) {
+            if (_index == _size) {
+                fill();
+                if (_size == 0) {
+                    _eof = true;
+                    return false;
+                }
             }
-            const auto dvs_event = bytes_to_dvs_event(bytes, stream_header);
-            if (dvs_event.t >= previous_t && dvs_event.x < stream_header.width && dvs_event.y < stream_header.height) {
-                handle_event(sepia::atis_event{dvs_event.t, dvs_event.x, dvs_event.y, true, dvs_event.is_increase});
-                previous_t = dvs_event.t;
+            dvs_event = {
+                _records.ts[_index], _records.xs[_index], _records.ys[_index], _records.is_increases[_index] == 1};
+            ++_index;
+            return true;
+        }
+
+        /// eof returns true once next has returned false.
+        virtual bool eof() const {
+            return _eof;
+        }
+
+        protected:
+        /// fill reads and decodes the next block, a partial record (possible with pipes) is kept for the next block.
+        virtual void fill() {
+            _index = 0;
+            _size = 0;
+            while (_size == 0) {
+                const auto count = _stream.rdbuf()->sgetn(
+                    reinterpret_cast<char*>(_bytes.data() + _remainder),
+                    static_cast<std::streamsize>(_bytes.size() - _remainder));
+                if (count <= 0) {
+                    return;
+                }
+                const auto bytes = _remainder + static_cast<std::size_t>(count);
+                _size = bytes / 8;
+                decode_records(_bytes.data(), _size, _header, _records);
+                std::copy(_bytes.begin() + _size * 8, _bytes.begin() + bytes, _bytes.begin());
+                _remainder = bytes - _size * 8;
+            }
+        }
+
+        std::istream& _stream;
+        const header _header;
+        std::vector<uint8_t> _bytes;
+        std::size_t _remainder;
+        records _records;
+        std::size_t _index;
+        std::size_t _size;
+        bool _eof;
+    };
+
+    /// write_header writes a version 2 .dat header, followed by the event type and size bytes.
+    inline void write_header(std::ostream& stream, header stream_header) {
+        stream << "% Version " << static_cast<uint32_t>(stream_header.version) << "\n% Width " << stream_header.width
+               << "\n% Height " << stream_header.height << "\n";
+        stream.put(0);
+        stream.put(8);
+    }
+
+    /// dvs_event_to_bytes converts a polarized event to raw bytes.
+    /// It is the inverse of bytes_to_dvs_event for version 2 headers, and truncates the timestamp to 32 bits.
+    inline std::array<uint8_t, 8> dvs_event_to_bytes(sepia::dvs_event dvs_event, header stream_header) {
+        const auto y = static_cast<uint16_t>(stream_header.height - 1 - dvs_event.y);
+        return {{
+            static_cast<uint8_t>(dvs_event.t & 0xff),
+            static_cast<uint8_t>((dvs_event.t >> 8) & 0xff),
+            static_cast<uint8_t>((dvs_event.t >> 16) & 0xff),
+            static_cast<uint8_t>((dvs_event.t >> 24) & 0xff),
+            static_cast<uint8_t>(dvs_event.x & 0xff),
+            static_cast<uint8_t>(((dvs_event.x >> 8) & 0b111111) | ((y & 0b11) << 6)),
+            static_cast<uint8_t>((y >> 2) & 0xff),
+            static_cast<uint8_t>(((y >> 10) & 0b1111) | (dvs_event.is_increase ? 0b10000 : 0)),
+        }};
+    }
+
+    /// write_to_reference packs polarized events into large buffers, and writes them to a .dat stream.
+    /// The header is written by the constructor, and the pending events by flush or the destructor.
+    class write_to_reference {
+        public:
+        /// events_per_buffer is the number of events packed before a write.
+        static constexpr std::size_t events_per_buffer = 1 << 16;
+
+        write_to_reference(std::ostream& stream, header stream_header) :
+            _stream(stream),
+            _header(stream_header),
+            _size(0) {
+            write_header(_stream, _header);
+            _buffer.resize(events_per_buffer * 8);
+        }
+        write_to_reference(const write_to_reference&) = delete;
+        write_to_reference(write_to_reference&&) = delete;
+        write_to_reference& operator=(const write_to_reference&) = delete;
+        write_to_reference& operator=(write_to_reference&&) = delete;
+        virtual ~write_to_reference() {
+            flush();
+        }
+
+        /// operator() packs an event.
+        virtual void operator()(sepia::dvs_event dvs_event) {
+            const auto bytes = dvs_event_to_bytes(dvs_event, _header);
+            std::copy(bytes.begin(), bytes.end(), _buffer.begin() + _size);
+            _size += bytes.size();
+            if (_size == _buffer.size()) {
+                flush();
+            }
+        }
+
+        /// flush writes the packed events.
+        virtual void flush() {
+            _stream.write(reinterpret_cast<const char*>(_buffer.data()), static_cast<std::streamsize>(_size));
+            _size = 0;
+        }
+
+        protected:
+        std::ostream& _stream;
+        const header _header;
+        std::vector<uint8_t> _buffer;
+        std::size_t _size;
+    };
+
+    /// reorder_counts reports the events which were not dispatched in their original order.
+    struct reorder_counts {
+        /// reordered counts the events moved before events which preceded them in the file.
+        uint64_t reordered;
+
+        /// dropped counts the events later than the reorder window, which could not be dispatched in order.
+        uint64_t dropped;
+
+        /// wraps counts the wrap-arounds of the 32-bit timestamps (the number of 2^32 microseconds epochs
+        /// after the first one).
+        uint64_t wraps;
+
+        /// out_of_bounds counts the events outside the sensor.
+        uint64_t out_of_bounds;
+    };
+
+    /// ordered_reader dispatches the records of a .dat stream in timestamp order.
+    /// The 32-bit timestamps are extended to 64 bits: a timestamp more than 2^31 microseconds (about 36 minutes)
+    /// before the latest one is considered past a wrap-around, and one more than 2^31 microseconds after the latest
+    /// one is considered late and before a wrap-around.
+    /// Events are held until the latest timestamp exceeds theirs by the given lateness, and released in order.
+    /// In-order events (the common case) are appended to a queue, and only late events go through a min-heap,
+    /// hence an in-order stream costs a push and a pop per event (and bypasses the queue if the lateness is 0).
+    /// Memory and latency are bounded by the number of events in a lateness window.
+    /// Events later than the last released event are dropped, a lateness of 0 drops every out-of-order event.
+    class ordered_reader {
+        public:
+        ordered_reader(std::istream& stream, header stream_header, uint64_t lateness, reorder_counts& counts) :
+            _reader(stream, stream_header),
+            _header(stream_header),
+            _lateness(lateness),
+            _counts(counts),
+            _latest_t(0),
+            _released_t(0),
+            _is_first(true),
+            _ended(false) {}
+        ordered_reader(const ordered_reader&) = delete;
+        ordered_reader(ordered_reader&&) = default;
+        ordered_reader& operator=(const ordered_reader&) = delete;
+        ordered_reader& operator=(ordered_reader&&) = delete;
+        virtual ~ordered_reader() {}
+
+        /// next retrieves the next event in timestamp order, and returns false at the end of the stream.
+        virtual bool next(sepia::dvs_event& dvs_event) {
+            for (;;) {
+                const auto has_queued = !_queue.empty();
+                const auto has_late = !_late.empty();
+                if (has_queued || has_late) {
+                    const auto from_queue = has_queued && (!has_late || _queue.front().t <= _late.front().t);
+                    const auto& candidate = from_queue ? _queue.front() : _late.front();
+                    if (_ended || candidate.t + _lateness <= _latest_t) {
+                        dvs_event = candidate;
+                        _released_t = candidate.t;
+                        if (from_queue) {
+                            _queue.pop_front();
+                        } else {
+                            std::pop_heap(_late.begin(), _late.end(), is_later);
+                            _late.pop_back();
+                        }
+                        return true;
+                    }
+                } else if (_ended) {
+                    return false;
+                }
+                if (!_reader.next(dvs_event)) {
+                    _ended = true;
+                    continue;
+                }
+                if (dvs_event.x >= _header.width || dvs_event.y >= _header.height) {
+                    ++_counts.out_of_bounds;
+                    continue;
+                }
+                if (_is_first) {
+                    _is_first = false;
+                    _latest_t = dvs_event.t;
+                }
+                const auto t =
+                    static_cast<int64_t>(_latest_t)
+                    + static_cast<int32_t>(static_cast<uint32_t>(dvs_event.t) - static_cast<uint32_t>(_latest_t));
+                if (t < static_cast<int64_t>(_released_t)) {
+                    ++_counts.dropped;
+                    continue;
+                }
+                dvs_event.t = static_cast<uint64_t>(t);
+                if (dvs_event.t >= _latest_t) {
+                    _counts.wraps += (dvs_event.t >> 32) - (_latest_t >> 32);
+                    _latest_t = dvs_event.t;
+                    if (_lateness == 0 && _queue.empty() && _late.empty()) {
+                        _released_t = dvs_event.t;
+                        return true;
+                    }
+                    _queue.push_back(dvs_event);
+                } else {
+                    ++_counts.reordered;
+                    _late.push_back(dvs_event);
+                    std::push_heap(_late.begin(), _late.end(), is_later);
+                }
             }
         }
+
+        protected:
+        /// is_later orders the late events' min-heap.
+        static bool is_later(const sepia::dvs_event& first, const sepia::dvs_event& second) {
+            return first.t > second.t;
+        }
+
+        reader _reader;
+        const header _header;
+        const uint64_t _lateness;
+        reorder_counts& _counts;
+        uint64_t _latest_t;
+        uint64_t _released_t;
+        bool _is_first;
+        bool _ended;
+        std::deque<sepia::dvs_event> _queue;
+        std::vector<sepia::dvs_event> _late;
+    };
+
+    /// td_observable dispatches DVS events from a td stream, in timestamp order (see ordered_reader).
+    /// The header must be read from the stream before calling this function.
+    template <typename HandleEvent>
+    inline void td_observable(
+        std::istream& stream,
+        header stream_header,
+        uint64_t lateness,
+        reorder_counts& counts,
+        HandleEvent handle_event) {
+        ordered_reader events(stream, stream_header, lateness, counts);
+        for (sepia::dvs_event dvs_event; events.next(dvs_event);) {
+            handle_event(dvs_event);
+        }
     }
 
-    /// td_aps_observable dispatches ATIS events from a td stream and an aps stream.
+    /// aps_observable dispatches ATIS events from an aps stream, in timestamp order (see ordered_reader).
+    /// The header must be read from the stream before calling this function.
+    template <typename HandleEvent>
+    inline void aps_observable(
+        std::istream& stream,
+        header stream_header,
+        uint64_t lateness,
+        reorder_counts& counts,
+        HandleEvent handle_event) {
+        ordered_reader events(stream, stream_header, lateness, counts);
+        for (sepia::dvs_event dvs_event; events.next(dvs_event);) {
+            handle_event(sepia::atis_event{dvs_event.t, dvs_event.x, dvs_event.y, true, dvs_event.is_increase});
+        }
+    }
+
+    /// td_aps_observable dispatches ATIS events from a td stream and an aps stream, in timestamp order.
+    /// Each stream is ordered on its own (see ordered_reader), and both are merged (td events first on ties).
     /// The headers must be read from both streams before calling this function.
     template <typename HandleEvent>
     inline void td_aps_observable(
         std::istream& td_stream,
         std::istream& aps_stream,
         header stream_header,
+        uint64_t lateness,
+        reorder_counts& counts,
         HandleEvent handle_event) {
+        ordered_reader td_events(td_stream, stream_header, lateness, counts);
+        ordered_reader aps_events(aps_stream, stream_header, lateness, counts);
         sepia::dvs_event td_event = {};
         sepia::dvs_event aps_event = {};
-        uint64_t previous_t = 0;
-        for (;;) {
-            std::array<uint8_t, 8> bytes;
-            td_stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-            if (td_stream.eof()) {
-                break;
-            } else {
-                td_event = bytes_to_dvs_event(bytes, stream_header);
-                if (td_event.x < stream_header.width && td_event.y < stream_header.height) {
-                    break;
-                }
-            }
-        }
-        for (;;) {
-            std::array<uint8_t, 8> bytes;
-            aps_stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-            if (aps_stream.eof()) {
-                break;
-            } else {
-                aps_event = bytes_to_dvs_event(bytes, stream_header);
-                if (aps_event.x < stream_header.width && aps_event.y < stream_header.height) {
-                    break;
-                }
-            }
-        }
-        while (!td_stream.eof() && !aps_stream.eof()) {
-            if (td_event.t <= aps_event.t) {
+        auto has_td_event = td_events.next(td_event);
+        auto has_aps_event = aps_events.next(aps_event);
+        while (has_td_event || has_aps_event) {
+            if (has_td_event && (!has_aps_event || td_event.t <= aps_event.t)) {
                 handle_event(sepia::atis_event{td_event.t, td_event.x, td_event.y, false, td_event.is_increase});
-                previous_t = td_event.t;
-                for (;;) {
-                    std::array<uint8_t, 8> bytes;
-                    td_stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-                    if (td_stream.eof()) {
-                        break;
-                    }
-                    td_event = bytes_to_dvs_event(bytes, stream_header);
-                    if (td_event.t >= previous_t && td_event.x < stream_header.width
-                        && td_event.y < stream_header.height) {
-                        break;
-                    }
-                }
+                has_td_event = td_events.next(td_event);
             } else {
                 handle_event(sepia::atis_event{aps_event.t, aps_event.x, aps_event.y, true, aps_event.is_increase});
-                previous_t = aps_event.t;
-                for (;;) {
-                    std::array<uint8_t, 8> bytes;
-                    aps_stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-                    if (aps_stream.eof()) {
-                        break;
-                    }
-                    aps_event = bytes_to_dvs_event(bytes, stream_header);
-                    if (aps_event.t >= previous_t && aps_event.x < stream_header.width
-                        && aps_event.y < stream_header.height) {
-                        break;
-                    }
-                }
-            }
-        }
-        if (td_stream) {
-            handle_event(sepia::atis_event{td_event.t, td_event.x, td_event.y, false, td_event.is_increase});
-            for (;;) {
-                std::array<uint8_t, 8> bytes;
-                td_stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-                if (td_stream.eof()) {
-                    break;
-                }
-                td_event = bytes_to_dvs_event(bytes, stream_header);
-                if (td_event.t >= previous_t && td_event.x < stream_header.width && td_event.y < stream_header.height) {
-                    handle_event(sepia::atis_event{td_event.t, td_event.x, td_event.y, false, td_event.is_increase});
-                    previous_t = td_event.t;
-                }
-            }
-        } else {
-            handle_event(sepia::atis_event{aps_event.t, aps_event.x, aps_event.y, false, aps_event.is_increase});
-            for (;;) {
-                std::array<uint8_t, 8> bytes;
-                aps_stream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-                if (aps_stream.eof()) {
-                    break;
-                }
-                aps_event = bytes_to_dvs_event(bytes, stream_header);
-                if (aps_event.t >= previous_t && aps_event.x < stream_header.width
-                    && aps_event.y < stream_header.height) {
-                    handle_event(
-                        sepia::atis_event{aps_event.t, aps_event.x, aps_event.y, false, aps_event.is_increase});
-                    previous_t = aps_event.t;
-                }
+                has_aps_event = aps_events.next(aps_event);
             }
         }
     }
@@ -1,5 +1,16 @@
 #include "../third_party/pontella/source/pontella.hpp"
 #include "dat.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+
+/// events_after_header calculates the number of events in a .dat file from its size.
+/// The standard input's size is unknown, hence the function returns 0 in this case.
+uint64_t events_after_header(const std::string& filename, std::istream& stream) {
+    if (io::is_standard(filename)) {
+        return 0;
+    }
+    return (profile::file_size(filename) - static_cast<uint64_t>(stream.tellg())) / 8;
+}
 
 int main(int argc, char* argv[]) {
     return pontella::main(
@@ -7,71 +18,120 @@ int main(int argc, char* argv[]) {
          "Syntax: ./dat_to_es [options] /path/to/input_td.dat /path/to/input_aps.dat /path/to/output.es",
          "    If the string 'none' (without quotes) is used for the td (respectively, aps) file,",
          "    the Event Stream file is build from the aps (respectively, td) file only",
+         "    The string '-' (without quotes) can be used for the standard input (td or aps) and output",
          "Available options:",
-         "    -h, --help    shows this help message"},
+         "    -l [lateness], --lateness [lateness]    reorders the events which are at most [lateness]",
+         "                                                (in microseconds) later than the latest event,",
+         "                                                defaults to 0 (every out-of-order event is dropped)",
+         "    -c [level], --cpu [level]               sets the instruction set of the decoding kernels",
+         "                                                (scalar, sse4.2, avx2 or avx512),",
+         "                                                defaults to the best level supported by the processor",
+         "    -p, --profile                           prints a JSON profiling report on the standard error",
+         "                                                with the number of reordered and dropped events",
+         "    -h, --help                              shows this help message"},
         argc,
         argv,
         3,
-        {},
-        {},
-        [](pontella::command command) {
+        {{"lateness", {"l"}}, {"cpu", {"c"}}},
+        {{"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            cpu::select_from_command(command);
+            uint64_t lateness = 0;
+            {
+                const auto name_and_argument = command.options.find("lateness");
+                if (name_and_argument != command.options.end()) {
+                    lateness = std::stoull(name_and_argument->second);
+                }
+            }
             if (command.arguments[0] == command.arguments[1]) {
                 throw std::runtime_error("The td and aps inputs must be different files, and cannot be both none");
             }
-            if (command.arguments[0] != "none" && command.arguments[0].find("td") == std::string::npos) {
-                std::cout << "The file " << command.arguments[0]
-                          << " does not have 'td' in its name. Do you want to continue anyway? (Y/n)" << '\n';
+            if (command.arguments[0] != "none" && !io::is_standard(command.arguments[0])
+                && command.arguments[0].find("td") == std::string::npos) {
+                if (io::is_standard(command.arguments[1])) {
+                    throw std::runtime_error(
+                        "The file " + command.arguments[0] + " does not have 'td' in its name");
+                }
+                auto& prompt = io::is_standard(command.arguments[2]) ? std::cerr : std::cout;
+                prompt << "The file " << command.arguments[0]
+                       << " does not have 'td' in its name. Do you want to continue anyway? (Y/n)" << '\n';
                 std::string answer;
                 std::getline(std::cin, answer);
                 if (answer == "n") {
                     throw std::runtime_error("Aborting...");
                 } else {
-                    std::cout << "Continuing..." << '\n';
+                    prompt << "Continuing..." << '\n';
                 }
             }
-            if (command.arguments[0] == command.arguments[2]) {
-                throw std::runtime_error("The td input and the Event Stream output must be different files");
-            }
-            if (command.arguments[1] == command.arguments[2]) {
-                throw std::runtime_error("The aps input and the Event Stream output must be different files");
-            }
+            io::check_different(
+                command.arguments[0],
+                command.arguments[2],
+                "The td input and the Event Stream output must be different files");
+            io::check_different(
+                command.arguments[1],
+                command.arguments[2],
+                "The aps input and the Event Stream output must be different files");
             if (command.arguments[0] == "none" && command.arguments[1] == "none") {
                 throw std::runtime_error("none cannot be used for both the td file and aps file");
             }
 
+            auto& session = profile::current();
+            for (std::size_t index = 0; index < 2; ++index) {
+                if (command.arguments[index] != "none") {
+                    session.input(command.arguments[index]);
+                }
+            }
+            session.output(command.arguments[2]);
+            dat::reorder_counts counts{};
+            profile::scope scope("decode");
             if (command.arguments[1] == "none") {
-                auto stream = sepia::filename_to_ifstream(command.arguments[0]);
+                auto stream = io::open_input(command.arguments[0]);
                 const auto header = dat::read_header(*stream);
-                dat::td_observable(
-                    *stream,
-                    header,
-                    sepia::write<sepia::type::dvs>(
-                        sepia::filename_to_ofstream(command.arguments[2]), header.width, header.height));
+                stream->stop_recording();
+                session.events_in = events_after_header(command.arguments[0], *stream);
+                sepia::write<sepia::type::dvs> write(
+                    io::open_output(command.arguments[2]), header.width, header.height);
+                dat::td_observable(*stream, header, lateness, counts, [&](sepia::dvs_event dvs_event) {
+                    ++session.events_out;
+                    write(dvs_event);
+                });
             } else if (command.arguments[0] == "none") {
-                auto stream = sepia::filename_to_ifstream(command.arguments[1]);
+                auto stream = io::open_input(command.arguments[1]);
                 const auto header = dat::read_header(*stream);
-                dat::aps_observable(
-                    *stream,
-                    header,
-                    sepia::write<sepia::type::atis>(
-                        sepia::filename_to_ofstream(command.arguments[2]), header.width, header.height));
+                stream->stop_recording();
+                session.events_in = events_after_header(command.arguments[1], *stream);
+                sepia::write<sepia::type::atis> write(
+                    io::open_output(command.arguments[2]), header.width, header.height);
+                dat::aps_observable(*stream, header, lateness, counts, [&](sepia::atis_event atis_event) {
+                    ++session.events_out;
+                    write(atis_event);
+                });
             } else {
-                auto td_stream = sepia::filename_to_ifstream(command.arguments[0]);
-                auto aps_stream = sepia::filename_to_ifstream(command.arguments[1]);
+                auto td_stream = io::open_input(command.arguments[0]);
+                auto aps_stream = io::open_input(command.arguments[1]);
                 const auto header = dat::read_header(*td_stream);
+                td_stream->stop_recording();
                 {
                     const auto aps_header = dat::read_header(*aps_stream);
+                    aps_stream->stop_recording();
                     if (header.version != aps_header.version || header.width != aps_header.width
                         || header.height != aps_header.height) {
                         throw std::runtime_error("the td and aps file have incompatible headers");
                     }
                 }
+                session.events_in = events_after_header(command.arguments[0], *td_stream)
+                                    + events_after_header(command.arguments[1], *aps_stream);
+                sepia::write<sepia::type::atis> write(
+                    io::open_output(command.arguments[2]), header.width, header.height);
                 dat::td_aps_observable(
-                    *td_stream,
-                    *aps_stream,
-                    header,
-                    sepia::write<sepia::type::atis>(
-                        sepia::filename_to_ofstream(command.arguments[2]), header.width, header.height));
+                    *td_stream, *aps_stream, header, lateness, counts, [&](sepia::atis_event atis_event) {
+                        ++session.events_out;
+                        write(atis_event);
+                    });
             }
-        });
+            session.property("reordered_events", std::to_string(counts.reordered));
+            session.property("dropped_events", std::to_string(counts.dropped));
+            session.property("timestamp_wraps", std::to_string(counts.wraps));
+            session.property("out_of_bounds_events", std::to_string(counts.out_of_bounds));
+        }));
 }
@@ -0,0 +1,393 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/// bytes_per_chunk is the number of bytes compared at once by a thread.
+constexpr std::size_t bytes_per_chunk = 1 << 26;
+
+/// mapped_file maps a file in memory (read-only).
+class mapped_file {
+    public:
+    mapped_file(const std::string& filename) : _filename(filename), _data(nullptr), _size(0) {
+#ifdef _WIN32
+        throw std::runtime_error("es_diff is not available on Windows");
+#else
+        _descriptor = open(filename.c_str(), O_RDONLY);
+        if (_descriptor < 0) {
+            throw sepia::unreadable_file(filename);
+        }
+        struct stat status;
+        if (fstat(_descriptor, &status) != 0) {
+            close(_descriptor);
+            throw sepia::unreadable_file(filename);
+        }
+        _size = static_cast<std::size_t>(status.st_size);
+        if (_size > 0) {
+            auto data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, _descriptor, 0);
+            if (data == MAP_FAILED) {
+                close(_descriptor);
+                throw std::runtime_error("mapping '" + filename + "' failed");
+            }
+            madvise(data, _size, MADV_SEQUENTIAL);
+            _data = static_cast<const uint8_t*>(data);
+        }
+#endif
+    }
+    mapped_file(const mapped_file&) = delete;
+    mapped_file(mapped_file&&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file& operator=(mapped_file&&) = delete;
+    virtual ~mapped_file() {
+#ifndef _WIN32
+        if (_data != nullptr) {
+            munmap(const_cast<uint8_t*>(_data), _size);
+        }
+        close(_descriptor);
+#endif
+    }
+
+    /// data returns the file's bytes.
+    virtual const uint8_t* data() const {
+        return _data;
+    }
+
+    /// size returns the file's size in bytes.
+    virtual std::size_t size() const {
+        return _size;
+    }
+
+    protected:
+    const std::string _filename;
+    const uint8_t* _data;
+    std::size_t _size;
+#ifndef _WIN32
+    int _descriptor;
+#endif
+};
+
+/// first_different_byte compares two files of the same size in parallel, and returns the offset of their first
+/// different byte (or their size if they are identical).
+/// Threads compare chunks in order, and skip the chunks past the first different one found so far,
+/// hence different files return early and identical files are read at memory bandwidth.
+std::size_t first_different_byte(const mapped_file& first, const mapped_file& second, std::size_t threads) {
+    const auto size = first.size();
+    const auto number_of_chunks = (size + bytes_per_chunk - 1) / bytes_per_chunk;
+    std::atomic<std::size_t> next_chunk(0);
+    std::atomic<std::size_t> different_chunk(number_of_chunks);
+    std::vector<std::thread> workers;
+    for (std::size_t index = 0; index < std::min(threads, number_of_chunks); ++index) {
+        workers.emplace_back([&]() {
+            for (;;) {
+                const auto chunk = next_chunk.fetch_add(1);
+                if (chunk >= different_chunk.load()) {
+                    return;
+                }
+                const auto begin = chunk * bytes_per_chunk;
+                const auto length = std::min(bytes_per_chunk, size - begin);
+                if (std::memcmp(first.data() + begin, second.data() + begin, length) != 0) {
+                    auto current = different_chunk.load();
+                    while (chunk < current && !different_chunk.compare_exchange_weak(current, chunk)) {
+                    }
+                    return;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (different_chunk.load() == number_of_chunks) {
+        return size;
+    }
+    const auto begin = different_chunk.load() * bytes_per_chunk;
+    const auto end = std::min(begin + bytes_per_chunk, size);
+    return static_cast<std::size_t>(
+        std::mismatch(first.data() + begin, first.data() + end, second.data() + begin).first - first.data());
+}
+
+/// field_names lists the compared fields of an event type, in the order of the masks returned by compare.
+template <sepia::type event_stream_type>
+std::vector<std::string> field_names();
+template <>
+std::vector<std::string> field_names<sepia::type::generic>() {
+    return {"t", "bytes"};
+}
+template <>
+std::vector<std::string> field_names<sepia::type::dvs>() {
+    return {"t", "x", "y", "is_increase"};
+}
+template <>
+std::vector<std::string> field_names<sepia::type::atis>() {
+    return {"t", "x", "y", "is_threshold_crossing", "polarity"};
+}
+template <>
+std::vector<std::string> field_names<sepia::type::color>() {
+    return {"t", "x", "y", "r", "g", "b"};
+}
+
+/// is_t_different returns true if two timestamps are further apart than the tolerance.
+inline bool is_t_different(uint64_t first, uint64_t second, uint64_t t_tolerance) {
+    return (first > second ? first - second : second - first) > t_tolerance;
+}
+
+/// compare returns a mask with a bit set for each different field, see field_names.
+inline uint32_t compare(const sepia::generic_event& first, const sepia::generic_event& second, uint64_t t_tolerance) {
+    return (is_t_different(first.t, second.t, t_tolerance) ? 1u : 0u) | (first.bytes != second.bytes ? 2u : 0u);
+}
+inline uint32_t compare(sepia::dvs_event first, sepia::dvs_event second, uint64_t t_tolerance) {
+    return (is_t_different(first.t, second.t, t_tolerance) ? 1u : 0u) | (first.x != second.x ? 2u : 0u)
+           | (first.y != second.y ? 4u : 0u) | (first.is_increase != second.is_increase ? 8u : 0u);
+}
+inline uint32_t compare(sepia::atis_event first, sepia::atis_event second, uint64_t t_tolerance) {
+    return (is_t_different(first.t, second.t, t_tolerance) ? 1u : 0u) | (first.x != second.x ? 2u : 0u)
+           | (first.y != second.y ? 4u : 0u)
+           | (first.is_threshold_crossing != second.is_threshold_crossing ? 8u : 0u)
+           | (first.polarity != second.polarity ? 16u : 0u);
+}
+inline uint32_t compare(sepia::color_event first, sepia::color_event second, uint64_t t_tolerance) {
+    return (is_t_different(first.t, second.t, t_tolerance) ? 1u : 0u) | (first.x != second.x ? 2u : 0u)
+           | (first.y != second.y ? 4u : 0u) | (first.r != second.r ? 8u : 0u) | (first.g != second.g ? 16u : 0u)
+           | (first.b != second.b ? 32u : 0u);
+}
+
+/// type_to_string returns a text representation of the type enum.
+std::string type_to_string(sepia::type type) {
+    switch (type) {
+        case sepia::type::generic:
+            return "\"generic\"";
+        case sepia::type::dvs:
+            return "\"dvs\"";
+        case sepia::type::atis:
+            return "\"atis\"";
+        case sepia::type::color:
+            return "\"color\"";
+    }
+    return "\"unknown\"";
+}
+
+/// properties_to_json converts a list of properties to pretty-printed JSON.
+std::string properties_to_json(const std::vector<std::pair<std::string, std::string>>& properties) {
+    std::string json("{\n");
+    for (std::size_t index = 0; index < properties.size(); ++index) {
+        json += std::string("    \"") + properties[index].first + "\": " + properties[index].second
+                + (index < properties.size() - 1 ? "," : "") + "\n";
+    }
+    json += "}";
+    return json;
+}
+
+/// pair_to_json converts two values to a JSON array.
+template <typename Value>
+std::string pair_to_json(Value first, Value second) {
+    return "[" + std::to_string(first) + ", " + std::to_string(second) + "]";
+}
+
+/// diff_events decodes both inputs in lockstep, and compares the events with the same index.
+/// It returns true if the events are identical (within the timestamp tolerance).
+template <sepia::type event_stream_type>
+bool diff_events(
+    io::event_stream first_input,
+    io::event_stream second_input,
+    uint64_t t_tolerance,
+    std::vector<std::pair<std::string, std::string>>& properties) {
+    auto& session = profile::current();
+    const auto names = field_names<event_stream_type>();
+    std::vector<uint64_t> differences(names.size(), 0);
+    std::array<uint64_t, 2> events{0, 0};
+    uint64_t different_events = 0;
+    std::string first_difference;
+    {
+        profile::scope scope("decode");
+        // both inputs are decoded in parallel, and the comparison overlaps with the decoding
+        async::reader<event_stream_type> first_reader(std::move(first_input.stream));
+        async::reader<event_stream_type> second_reader(std::move(second_input.stream));
+        sepia::event<event_stream_type> first_event;
+        sepia::event<event_stream_type> second_event;
+        for (;;) {
+            const auto has_first = first_reader.next(first_event);
+            const auto has_second = second_reader.next(second_event);
+            events[0] += has_first ? 1 : 0;
+            events[1] += has_second ? 1 : 0;
+            if (!has_first || !has_second) {
+                for (; has_first && first_reader.next(first_event); ++events[0]) {
+                }
+                for (; has_second && second_reader.next(second_event); ++events[1]) {
+                }
+                break;
+            }
+            const auto mask = compare(first_event, second_event, t_tolerance);
+            if (mask != 0) {
+                if (different_events == 0) {
+                    first_difference = "{\"index\": " + std::to_string(events[0] - 1)
+                                       + ", \"t\": " + pair_to_json(first_event.t, second_event.t) + ", \"fields\": [";
+                    for (std::size_t index = 0, written = 0; index < names.size(); ++index) {
+                        if ((mask >> index) & 1) {
+                            first_difference += std::string(written > 0 ? ", " : "") + "\"" + names[index] + "\"";
+                            ++written;
+                        }
+                    }
+                    first_difference += "]}";
+                }
+                ++different_events;
+                for (std::size_t index = 0; index < names.size(); ++index) {
+                    differences[index] += (mask >> index) & 1;
+                }
+            }
+        }
+    }
+    session.events_in = events[0] + events[1];
+    properties.emplace_back("events", pair_to_json(events[0], events[1]));
+    if (first_difference.empty() && events[0] != events[1]) {
+        first_difference = "{\"index\": " + std::to_string(std::min(events[0], events[1]))
+                           + ", \"missing_in\": " + (events[0] < events[1] ? "\"first\"" : "\"second\"") + "}";
+    }
+    properties.emplace_back("different_events", std::to_string(different_events));
+    if (!first_difference.empty()) {
+        properties.emplace_back("first_difference", first_difference);
+    }
+    std::string fields("{");
+    for (std::size_t index = 0; index < names.size(); ++index) {
+        fields +=
+            std::string(index > 0 ? ", " : "") + "\"" + names[index] + "\": " + std::to_string(differences[index]);
+    }
+    properties.emplace_back("field_differences", fields + "}");
+    return different_events == 0 && events[0] == events[1];
+}
+
+/// different is set by the command handler if the files differ, and determines the exit code.
+/// It stays false if no comparison ran (for example with --help).
+bool different = false;
+
+int main(int argc, char* argv[]) {
+    const auto result = pontella::main(
+        {
+            "es_diff compares two Event Stream files, and outputs the differences in JSON format.",
+            "Syntax: ./es_diff [options] /path/to/first.es /path/to/second.es",
+            "    The files' bytes are compared in parallel first, and the events are decoded and compared",
+            "    only if the bytes differ. The exit code is 0 if the events are identical, 1 if they differ,",
+            "    and 2 if an error occurred",
+            "Available options:",
+            "    -t [tolerance], --t-tolerance [tolerance]    considers timestamps which differ",
+            "                                                     by at most [tolerance] (in microseconds)",
+            "                                                     identical, defaults to 0",
+            "    -j [threads], --threads [threads]            sets the number of threads for the byte comparison",
+            "                                                     defaults to the number of hardware threads",
+            "    -p, --profile                                prints a JSON profiling report on the standard error",
+            "    -h, --help                                   shows this help message",
+        },
+        argc,
+        argv,
+        2,
+        {
+            {"t-tolerance", {"t"}},
+            {"threads", {"j"}},
+        },
+        {{"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            auto& session = profile::current();
+            if (io::is_standard(command.arguments[0]) || io::is_standard(command.arguments[1])) {
+                throw std::runtime_error("es_diff does not support the standard input");
+            }
+            session.input(command.arguments[0]);
+            session.input(command.arguments[1]);
+            uint64_t t_tolerance = 0;
+            {
+                const auto name_and_argument = command.options.find("t-tolerance");
+                if (name_and_argument != command.options.end()) {
+                    t_tolerance = std::stoull(name_and_argument->second);
+                }
+            }
+            std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+            {
+                const auto name_and_argument = command.options.find("threads");
+                if (name_and_argument != command.options.end()) {
+                    threads = std::stoull(name_and_argument->second);
+                    if (threads == 0) {
+                        throw std::runtime_error("[threads] must be strictly positive");
+                    }
+                }
+            }
+            std::vector<std::pair<std::string, std::string>> properties;
+            {
+                mapped_file first(command.arguments[0]);
+                mapped_file second(command.arguments[1]);
+                properties.emplace_back("size", pair_to_json(first.size(), second.size()));
+                if (first.size() == second.size()) {
+                    std::size_t offset;
+                    {
+                        profile::scope scope("bytes");
+                        offset = first_different_byte(first, second, threads);
+                    }
+                    if (offset == first.size()) {
+                        properties.emplace_back("identical_bytes", "true");
+                        std::cout << properties_to_json(properties) << std::endl;
+                        return;
+                    }
+                    properties.emplace_back("identical_bytes", "false");
+                    properties.emplace_back("first_different_byte", std::to_string(offset));
+                } else {
+                    properties.emplace_back("identical_bytes", "false");
+                }
+            }
+            auto first_input = io::open_event_stream(command.arguments[0]);
+            auto second_input = io::open_event_stream(command.arguments[1]);
+            const auto first_type = first_input.header.event_stream_type;
+            const auto second_type = second_input.header.event_stream_type;
+            if (first_type != second_type) {
+                different = true;
+                properties.emplace_back(
+                    "type", "[" + type_to_string(first_type) + ", " + type_to_string(second_type) + "]");
+                properties.emplace_back("identical_events", "false");
+                std::cout << properties_to_json(properties) << std::endl;
+                return;
+            }
+            auto same_header = true;
+            if (first_input.header.width != second_input.header.width
+                || first_input.header.height != second_input.header.height) {
+                same_header = false;
+                properties.emplace_back("width", pair_to_json(first_input.header.width, second_input.header.width));
+                properties.emplace_back(
+                    "height", pair_to_json(first_input.header.height, second_input.header.height));
+            }
+            if (t_tolerance > 0) {
+                properties.emplace_back("t_tolerance", std::to_string(t_tolerance));
+            }
+            auto same_events = false;
+            switch (first_type) {
+                case sepia::type::generic:
+                    same_events = diff_events<sepia::type::generic>(
+                        std::move(first_input), std::move(second_input), t_tolerance, properties);
+                    break;
+                case sepia::type::dvs:
+                    same_events = diff_events<sepia::type::dvs>(
+                        std::move(first_input), std::move(second_input), t_tolerance, properties);
+                    break;
+                case sepia::type::atis:
+                    same_events = diff_events<sepia::type::atis>(
+                        std::move(first_input), std::move(second_input), t_tolerance, properties);
+                    break;
+                case sepia::type::color:
+                    same_events = diff_events<sepia::type::color>(
+                        std::move(first_input), std::move(second_input), t_tolerance, properties);
+                    break;
+            }
+            different = !same_header || !same_events;
+            properties.emplace_back("identical_events", same_events ? "true" : "false");
+            std::cout << properties_to_json(properties) << std::endl;
+        }));
+    if (result != 0) {
+        return 2;
+    }
+    return different ? 1 : 0;
+}
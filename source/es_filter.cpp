@@ -0,0 +1,180 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include "filters.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+
+/// count_events counts the filtered events (see filters::is_filtered) of each pixel,
+/// and returns the duration of the recording.
+template <sepia::type event_stream_type>
+uint64_t count_events(io::event_stream input, std::vector<uint64_t>& counts) {
+    const auto width = input.header.width;
+    counts.assign(static_cast<std::size_t>(width) * input.header.height, 0);
+    auto first = true;
+    uint64_t begin_t = 0;
+    uint64_t end_t = 0;
+    sepia::join_observable<event_stream_type>(std::move(input.stream), [&](sepia::event<event_stream_type> event) {
+        if (first) {
+            first = false;
+            begin_t = event.t;
+        }
+        end_t = event.t;
+        if (filters::is_filtered(event)) {
+            ++counts[static_cast<std::size_t>(event.x) + static_cast<std::size_t>(event.y) * width];
+        }
+    });
+    return end_t - begin_t;
+}
+
+/// filter_to dispatches the events which pass the filters to a writer.
+/// The hot pixel filter comes first since it is the cheapest, and the background activity filter comes last.
+template <sepia::type event_stream_type, typename Write>
+void filter_to(
+    io::event_stream input,
+    uint64_t activity,
+    uint64_t refractory,
+    std::vector<uint8_t> mask,
+    Write& write) {
+    auto& session = profile::current();
+    const auto width = input.header.width;
+    const auto height = input.header.height;
+    auto filter = filters::make_hot_pixel<sepia::event<event_stream_type>>(
+        width,
+        std::move(mask),
+        filters::make_refractory<sepia::event<event_stream_type>>(
+            width,
+            height,
+            refractory,
+            filters::make_background_activity<sepia::event<event_stream_type>>(
+                width, height, activity, [&](sepia::event<event_stream_type> event) {
+                    ++session.events_out;
+                    write(event);
+                })));
+    profile::scope scope("filter");
+    sepia::join_observable<event_stream_type>(std::move(input.stream), [&](sepia::event<event_stream_type> event) {
+        ++session.events_in;
+        filter(event);
+    });
+}
+
+/// filter writes the events which pass the filters to a new Event Stream, generic events do not have coordinates.
+template <sepia::type event_stream_type>
+void filter(
+    io::event_stream input,
+    const pontella::command& command,
+    uint64_t activity,
+    uint64_t refractory,
+    double hot_pixel_rate) {
+    std::vector<uint8_t> mask;
+    if (hot_pixel_rate > 0) {
+        profile::scope scope("rates");
+        std::vector<uint64_t> counts;
+        const auto duration = count_events<event_stream_type>(io::open_event_stream(command.arguments[0]), counts);
+        mask = filters::rates_to_mask(counts, duration, hot_pixel_rate);
+    }
+    async::write_behind_ostream output(io::open_output(command.arguments[1]));
+    if (command.flags.find("blocked") != command.flags.end()) {
+        blocked::write_to_reference<event_stream_type> write(output, input.header.width, input.header.height);
+        filter_to<event_stream_type>(std::move(input), activity, refractory, std::move(mask), write);
+    } else {
+        sepia::write_to_reference<event_stream_type> write(output, input.header.width, input.header.height);
+        filter_to<event_stream_type>(std::move(input), activity, refractory, std::move(mask), write);
+    }
+    output.close();
+}
+template <>
+void filter<sepia::type::generic>(io::event_stream, const pontella::command&, uint64_t, uint64_t, double) {
+    throw std::runtime_error("generic events are not compatible with this application");
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {
+            "es_filter removes noise events from an Event Stream file.",
+            "Syntax: ./es_filter [options] /path/to/input.es /path/to/output.es",
+            "    The string '-' (without quotes) can be used for the standard input and output",
+            "    At least one filter must be enabled",
+            "Available options:",
+            "    -a [duration], --activity [duration]    enables the background activity filter,",
+            "                                                an event is kept if one of its eight neighbours",
+            "                                                triggered less than [duration] microseconds before",
+            "    -r [period], --refractory [period]      enables the refractory filter,",
+            "                                                an event is removed if it follows the previous kept",
+            "                                                event from the same pixel by less than [period]",
+            "                                                microseconds",
+            "    -k [rate], --hot-pixels [rate]          enables the hot pixel filter, the events of pixels whose",
+            "                                                average rate exceeds [rate] events per second",
+            "                                                are removed (the input is read twice)",
+            "    -b, --blocked                           writes a blocked Event Stream,",
+            "                                                whose blocks can be skipped by readers",
+            "    -p, --profile                           prints a JSON profiling report on the standard error",
+            "    -h, --help                              shows this help message",
+        },
+        argc,
+        argv,
+        2,
+        {
+            {"activity", {"a"}},
+            {"refractory", {"r"}},
+            {"hot-pixels", {"k"}},
+        },
+        {{"blocked", {"b"}}, {"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            io::check_different(
+                command.arguments[0],
+                command.arguments[1],
+                "The Event Stream input and output must be different files");
+            uint64_t activity = 0;
+            {
+                const auto name_and_argument = command.options.find("activity");
+                if (name_and_argument != command.options.end()) {
+                    activity = std::stoull(name_and_argument->second);
+                }
+            }
+            uint64_t refractory = 0;
+            {
+                const auto name_and_argument = command.options.find("refractory");
+                if (name_and_argument != command.options.end()) {
+                    refractory = std::stoull(name_and_argument->second);
+                }
+            }
+            auto hot_pixel_rate = 0.0;
+            {
+                const auto name_and_argument = command.options.find("hot-pixels");
+                if (name_and_argument != command.options.end()) {
+                    hot_pixel_rate = std::stod(name_and_argument->second);
+                    if (hot_pixel_rate <= 0) {
+                        throw std::runtime_error("[rate] must be strictly positive");
+                    }
+                    if (io::is_standard(command.arguments[0])) {
+                        throw std::runtime_error("The hot pixel filter cannot read the standard input");
+                    }
+                }
+            }
+            if (activity == 0 && refractory == 0 && hot_pixel_rate == 0) {
+                throw std::runtime_error("At least one filter must be enabled");
+            }
+            profile::current().input(command.arguments[0]);
+            profile::current().output(command.arguments[1]);
+            auto input = io::open_event_stream(async::make_prefetch(io::open_stream(command.arguments[0])));
+            switch (input.header.event_stream_type) {
+                case sepia::type::generic: {
+                    filter<sepia::type::generic>(std::move(input), command, activity, refractory, hot_pixel_rate);
+                    break;
+                }
+                case sepia::type::dvs: {
+                    filter<sepia::type::dvs>(std::move(input), command, activity, refractory, hot_pixel_rate);
+                    break;
+                }
+                case sepia::type::atis: {
+                    filter<sepia::type::atis>(std::move(input), command, activity, refractory, hot_pixel_rate);
+                    break;
+                }
+                case sepia::type::color: {
+                    filter<sepia::type::color>(std::move(input), command, activity, refractory, hot_pixel_rate);
+                    break;
+                }
+            }
+        }));
+}
@@ -0,0 +1,320 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include "dat.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include "synthetic.hpp"
+#include <thread>
+
+/// chunk_events is the expected number of events per chunk.
+constexpr double chunk_events = 1 << 20;
+
+/// generate writes a synthetic recording in batches of chunks, one chunk per thread.
+/// HandleChunks is called in order with the events of each batch.
+template <sepia::type event_stream_type, typename HandleChunks>
+void generate(const synthetic::scene& scene, uint64_t duration, std::size_t threads, HandleChunks handle_chunks) {
+    const auto chunk_duration = std::max(static_cast<uint64_t>(1), static_cast<uint64_t>(chunk_events / scene.rate));
+    const auto number_of_chunks = (duration + chunk_duration - 1) / chunk_duration;
+    std::vector<std::vector<sepia::event<event_stream_type>>> chunks(threads);
+    for (uint64_t first_chunk = 0; first_chunk < number_of_chunks; first_chunk += threads) {
+        const auto batch_size =
+            static_cast<std::size_t>(std::min(static_cast<uint64_t>(threads), number_of_chunks - first_chunk));
+        {
+            profile::scope scope("generate");
+            async::parallel_for(batch_size, [&](std::size_t index) {
+                const auto chunk_index = first_chunk + index;
+                synthetic::random generator(synthetic::chunk_seed(scene.seed, chunk_index));
+                chunks[index].clear();
+                synthetic::workload<event_stream_type>::generate(
+                    scene,
+                    generator,
+                    chunk_index * chunk_duration,
+                    std::min(duration, (chunk_index + 1) * chunk_duration),
+                    [&](sepia::event<event_stream_type> event) { chunks[index].push_back(event); });
+            });
+        }
+        for (std::size_t index = 0; index < batch_size; ++index) {
+            profile::current().events_out += chunks[index].size();
+        }
+        handle_chunks(chunks, batch_size);
+    }
+}
+
+/// generate_event_stream writes a synthetic Event Stream file.
+/// Chunks are encoded in parallel: each chunk is encoded with timestamps relative to the last event of the previous
+/// chunk, hence the encoded chunks (without their header) can be concatenated.
+template <sepia::type event_stream_type>
+void generate_event_stream(
+    const synthetic::scene& scene,
+    uint64_t duration,
+    std::size_t threads,
+    const std::string& filename) {
+    auto output = io::open_output(filename);
+    std::size_t header_size = 0;
+    {
+        std::ostringstream header_stream;
+        sepia::write_to_reference<event_stream_type> write(header_stream, scene.width, scene.height);
+        header_size = header_stream.str().size();
+    }
+    sepia::write_to_reference<event_stream_type> write_header(*output, scene.width, scene.height);
+    uint64_t previous_t = 0;
+    std::vector<uint64_t> offsets(threads);
+    std::vector<std::string> encoded_chunks(threads);
+    generate<event_stream_type>(
+        scene,
+        duration,
+        threads,
+        [&](std::vector<std::vector<sepia::event<event_stream_type>>>& chunks, std::size_t batch_size) {
+            for (std::size_t index = 0; index < batch_size; ++index) {
+                offsets[index] = previous_t;
+                if (!chunks[index].empty()) {
+                    previous_t = chunks[index].back().t;
+                }
+            }
+            {
+                profile::scope scope("encode");
+                async::parallel_for(batch_size, [&](std::size_t index) {
+                    std::ostringstream chunk_stream;
+                    {
+                        sepia::write_to_reference<event_stream_type> write(chunk_stream, scene.width, scene.height);
+                        for (auto event : chunks[index]) {
+                            event.t -= offsets[index];
+                            write(event);
+                        }
+                    }
+                    encoded_chunks[index] = chunk_stream.str().substr(header_size);
+                });
+            }
+            profile::scope scope("write");
+            for (std::size_t index = 0; index < batch_size; ++index) {
+                output->write(encoded_chunks[index].data(), encoded_chunks[index].size());
+            }
+        });
+}
+
+/// to_dvs_event converts an event to the polarized event stored in .dat files.
+sepia::dvs_event to_dvs_event(sepia::dvs_event dvs_event) {
+    return dvs_event;
+}
+sepia::dvs_event to_dvs_event(sepia::atis_event atis_event) {
+    return {atis_event.t, atis_event.x, atis_event.y, atis_event.polarity};
+}
+
+/// is_aps returns true if the event belongs to the aps file.
+bool is_aps(sepia::dvs_event) {
+    return false;
+}
+bool is_aps(sepia::atis_event atis_event) {
+    return atis_event.is_threshold_crossing;
+}
+
+/// generate_dat writes a synthetic td file, and an aps file for ATIS events.
+/// Timestamps are truncated to 32 bits, as in the .dat format.
+template <sepia::type event_stream_type>
+void generate_dat(const synthetic::scene& scene, uint64_t duration, std::size_t threads, const std::string& prefix) {
+    const dat::header header{2, scene.width, scene.height};
+    auto td_output = sepia::filename_to_ofstream(prefix + "_td.dat");
+    dat::write_header(*td_output, header);
+    std::unique_ptr<std::ofstream> aps_output;
+    if (event_stream_type == sepia::type::atis) {
+        aps_output = sepia::filename_to_ofstream(prefix + "_aps.dat");
+        dat::write_header(*aps_output, header);
+    }
+    std::vector<std::vector<uint8_t>> td_chunks(threads);
+    std::vector<std::vector<uint8_t>> aps_chunks(threads);
+    generate<event_stream_type>(
+        scene,
+        duration,
+        threads,
+        [&](std::vector<std::vector<sepia::event<event_stream_type>>>& chunks, std::size_t batch_size) {
+            {
+                profile::scope scope("encode");
+                async::parallel_for(batch_size, [&](std::size_t index) {
+                    td_chunks[index].clear();
+                    aps_chunks[index].clear();
+                    for (const auto& event : chunks[index]) {
+                        const auto bytes = dat::dvs_event_to_bytes(to_dvs_event(event), header);
+                        auto& target = is_aps(event) ? aps_chunks[index] : td_chunks[index];
+                        target.insert(target.end(), bytes.begin(), bytes.end());
+                    }
+                });
+            }
+            profile::scope scope("write");
+            for (std::size_t index = 0; index < batch_size; ++index) {
+                td_output->write(reinterpret_cast<const char*>(td_chunks[index].data()), td_chunks[index].size());
+                if (aps_output) {
+                    aps_output->write(
+                        reinterpret_cast<const char*>(aps_chunks[index].data()), aps_chunks[index].size());
+                }
+            }
+        });
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {"es_generate writes a synthetic Event Stream file, reproducible from a seed",
+         "Syntax: ./es_generate [options] /path/to/output.es",
+         "    The string '-' (without quotes) can be used for the standard output",
+         "Available options:",
+         "    -e [type], --type [type]                  sets the event type",
+         "                                                  one of generic, dvs, atis, color",
+         "                                                  defaults to dvs",
+         "    -x [width], --width [width]               sets the sensor width",
+         "                                                  defaults to 320",
+         "    -y [height], --height [height]            sets the sensor height",
+         "                                                  defaults to 240",
+         "    -d [duration], --duration [duration]      sets the duration (in microseconds)",
+         "                                                  defaults to 10000000",
+         "    -r [rate], --rate [rate]                  sets the average event rate (in events per second)",
+         "                                                  ATIS exposure measurements come on top of this rate",
+         "                                                  defaults to 1000000",
+         "    -m [model], --model [model]               sets the workload model",
+         "                                                  poisson: uniformly distributed events",
+         "                                                  edge: a vertical edge crossing the sensor every second",
+         "                                                  hot_pixels: half of the events come from 0.1 % of pixels",
+         "                                                  burst: 10 ms bursts every 100 ms, ten times denser",
+         "                                                  defaults to poisson",
+         "    -s [seed], --seed [seed]                  sets the pseudo-random generator seed",
+         "                                                  defaults to 0",
+         "    -j [threads], --threads [threads]         sets the number of generation threads",
+         "                                                  does not change the output",
+         "                                                  defaults to the number of hardware threads",
+         "    -a, --dat                                 writes /path/to/output_td.dat (and output_aps.dat",
+         "                                                  for ATIS events) instead of an Event Stream file",
+         "                                                  timestamps are truncated to 32 bits",
+         "    -p, --profile                             prints a JSON profiling report on the standard error",
+         "    -h, --help                                shows this help message"},
+        argc,
+        argv,
+        1,
+        {
+            {"type", {"e"}},
+            {"width", {"x"}},
+            {"height", {"y"}},
+            {"duration", {"d"}},
+            {"rate", {"r"}},
+            {"model", {"m"}},
+            {"seed", {"s"}},
+            {"threads", {"j"}},
+        },
+        {
+            {"dat", {"a"}},
+            {"profile", {"p"}},
+        },
+        profile::wrap([](pontella::command command) {
+            auto event_stream_type = sepia::type::dvs;
+            {
+                const auto name_and_argument = command.options.find("type");
+                if (name_and_argument != command.options.end()) {
+                    if (name_and_argument->second == "generic") {
+                        event_stream_type = sepia::type::generic;
+                    } else if (name_and_argument->second == "dvs") {
+                        event_stream_type = sepia::type::dvs;
+                    } else if (name_and_argument->second == "atis") {
+                        event_stream_type = sepia::type::atis;
+                    } else if (name_and_argument->second == "color") {
+                        event_stream_type = sepia::type::color;
+                    } else {
+                        throw std::runtime_error("[type] must be one of generic, dvs, atis, color");
+                    }
+                }
+            }
+            uint16_t width = 320;
+            {
+                const auto name_and_argument = command.options.find("width");
+                if (name_and_argument != command.options.end()) {
+                    width = static_cast<uint16_t>(std::stoull(name_and_argument->second));
+                }
+            }
+            uint16_t height = 240;
+            {
+                const auto name_and_argument = command.options.find("height");
+                if (name_and_argument != command.options.end()) {
+                    height = static_cast<uint16_t>(std::stoull(name_and_argument->second));
+                }
+            }
+            if (width == 0 || height == 0) {
+                throw std::runtime_error("[width] and [height] must be strictly positive");
+            }
+            uint64_t duration = 10000000;
+            {
+                const auto name_and_argument = command.options.find("duration");
+                if (name_and_argument != command.options.end()) {
+                    duration = std::stoull(name_and_argument->second);
+                }
+            }
+            auto rate = 1e6;
+            {
+                const auto name_and_argument = command.options.find("rate");
+                if (name_and_argument != command.options.end()) {
+                    rate = std::stod(name_and_argument->second);
+                    if (rate <= 0) {
+                        throw std::runtime_error("[rate] must be strictly positive");
+                    }
+                }
+            }
+            auto workload = synthetic::model::poisson;
+            {
+                const auto name_and_argument = command.options.find("model");
+                if (name_and_argument != command.options.end()) {
+                    workload = synthetic::string_to_model(name_and_argument->second);
+                }
+            }
+            uint64_t seed = 0;
+            {
+                const auto name_and_argument = command.options.find("seed");
+                if (name_and_argument != command.options.end()) {
+                    seed = std::stoull(name_and_argument->second);
+                }
+            }
+            std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+            {
+                const auto name_and_argument = command.options.find("threads");
+                if (name_and_argument != command.options.end()) {
+                    threads = std::stoull(name_and_argument->second);
+                    if (threads == 0) {
+                        throw std::runtime_error("[threads] must be strictly positive");
+                    }
+                }
+            }
+            const auto scene = synthetic::make_scene(workload, width, height, rate / 1e6, seed);
+            if (command.flags.find("dat") != command.flags.end()) {
+                if (io::is_standard(command.arguments[0])) {
+                    throw std::runtime_error("The standard output cannot be used with .dat files");
+                }
+                profile::current().output(command.arguments[0] + "_td.dat");
+                if (event_stream_type == sepia::type::atis) {
+                    profile::current().output(command.arguments[0] + "_aps.dat");
+                }
+                switch (event_stream_type) {
+                    case sepia::type::generic:
+                        throw std::runtime_error("generic events cannot be written to .dat files");
+                    case sepia::type::dvs:
+                        generate_dat<sepia::type::dvs>(scene, duration, threads, command.arguments[0]);
+                        break;
+                    case sepia::type::atis:
+                        generate_dat<sepia::type::atis>(scene, duration, threads, command.arguments[0]);
+                        break;
+                    case sepia::type::color:
+                        throw std::runtime_error("color events cannot be written to .dat files");
+                }
+            } else {
+                profile::current().output(command.arguments[0]);
+                switch (event_stream_type) {
+                    case sepia::type::generic:
+                        generate_event_stream<sepia::type::generic>(scene, duration, threads, command.arguments[0]);
+                        break;
+                    case sepia::type::dvs:
+                        generate_event_stream<sepia::type::dvs>(scene, duration, threads, command.arguments[0]);
+                        break;
+                    case sepia::type::atis:
+                        generate_event_stream<sepia::type::atis>(scene, duration, threads, command.arguments[0]);
+                        break;
+                    case sepia::type::color:
+                        generate_event_stream<sepia::type::color>(scene, duration, threads, command.arguments[0]);
+                        break;
+                }
+            }
+        }));
+}
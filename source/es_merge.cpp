@@ -0,0 +1,239 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+/// input_specification holds an input's filename and offsets, as given on the command line.
+struct input_specification {
+    std::string filename;
+    int64_t t_offset;
+    uint16_t x_offset;
+    uint16_t y_offset;
+};
+
+/// is_integer returns true if a string is a non-empty sequence of digits, with an optional leading '-' if is_signed.
+bool is_integer(const std::string& value, bool is_signed) {
+    const std::size_t first = is_signed && !value.empty() && value.front() == '-' ? 1 : 0;
+    return value.size() > first
+           && std::all_of(value.begin() + first, value.end(), [](char character) {
+                  return character >= '0' && character <= '9';
+              });
+}
+
+/// parse_input_specification parses an input of the form '/path/to/input.es[@t_offset[,x_offset,y_offset]]'.
+/// The text after the last '@' is only read as offsets if it has this syntax,
+/// otherwise the '@' belongs to the filename (for example '/data/run@2/input.es').
+input_specification parse_input_specification(const std::string& argument) {
+    input_specification specification{argument, 0, 0, 0};
+    const auto separator = argument.rfind('@');
+    if (separator == std::string::npos) {
+        return specification;
+    }
+    std::vector<std::string> values;
+    {
+        std::istringstream stream(argument.substr(separator + 1));
+        for (std::string value; std::getline(stream, value, ',');) {
+            values.push_back(value);
+        }
+    }
+    if (!((values.size() == 1 && is_integer(values[0], true))
+          || (values.size() == 3 && is_integer(values[0], true) && is_integer(values[1], false)
+              && is_integer(values[2], false)))) {
+        return specification;
+    }
+    specification.filename = argument.substr(0, separator);
+    try {
+        specification.t_offset = std::stoll(values[0]);
+        if (values.size() == 3) {
+            const auto x_offset = std::stoull(values[1]);
+            const auto y_offset = std::stoull(values[2]);
+            if (x_offset > std::numeric_limits<uint16_t>::max() || y_offset > std::numeric_limits<uint16_t>::max()) {
+                throw std::out_of_range("spatial offset");
+            }
+            specification.x_offset = static_cast<uint16_t>(x_offset);
+            specification.y_offset = static_cast<uint16_t>(y_offset);
+        }
+    } catch (const std::out_of_range&) {
+        throw std::runtime_error("The offsets of '" + argument + "' are out of range");
+    }
+    return specification;
+}
+
+/// shift_event moves an event on the output canvas, generic events do not have coordinates.
+template <typename Event>
+void shift_event(Event& event, const input_specification& specification) {
+    event.x += specification.x_offset;
+    event.y += specification.y_offset;
+}
+template <>
+void shift_event<sepia::generic_event>(sepia::generic_event&, const input_specification&) {}
+
+/// next_shifted retrieves the next event of an input and applies the input's offsets.
+/// Events whose timestamp would become negative are skipped.
+template <sepia::type event_stream_type>
+bool next_shifted(
+    async::reader<event_stream_type>& events,
+    const input_specification& specification,
+    sepia::event<event_stream_type>& event) {
+    while (events.next(event)) {
+        if (specification.t_offset < 0) {
+            if (event.t < static_cast<uint64_t>(-specification.t_offset)) {
+                continue;
+            }
+            event.t -= static_cast<uint64_t>(-specification.t_offset);
+        } else {
+            event.t += static_cast<uint64_t>(specification.t_offset);
+        }
+        shift_event(event, specification);
+        return true;
+    }
+    return false;
+}
+
+/// merge writes the events of every input in timestamp order.
+/// Each input is decoded ahead on a dedicated thread (see async::reader), hence decoding overlaps with the merge.
+/// A min-heap holds the next event of each input, ties are broken by input order so that the output is deterministic.
+template <sepia::type event_stream_type>
+void merge(
+    std::vector<io::event_stream> inputs,
+    const std::vector<input_specification>& specifications,
+    const std::string& output_filename,
+    uint16_t width,
+    uint16_t height) {
+    auto& session = profile::current();
+    std::vector<std::unique_ptr<async::reader<event_stream_type>>> readers;
+    for (std::size_t index = 0; index < inputs.size(); ++index) {
+        readers.emplace_back(new async::reader<event_stream_type>(std::move(inputs[index].stream)));
+    }
+    async::write_behind_ostream output(io::open_output(output_filename));
+    {
+        sepia::write_to_reference<event_stream_type> write(output, width, height);
+        auto sampled_write = profile::make_sampled<sepia::event<event_stream_type>>(
+            "write", [&](sepia::event<event_stream_type> event) { write(event); });
+        profile::scope scope("merge");
+        std::vector<sepia::event<event_stream_type>> heads(readers.size());
+        std::priority_queue<
+            std::pair<uint64_t, std::size_t>,
+            std::vector<std::pair<uint64_t, std::size_t>>,
+            std::greater<std::pair<uint64_t, std::size_t>>>
+            heap;
+        for (std::size_t index = 0; index < readers.size(); ++index) {
+            if (next_shifted(*readers[index], specifications[index], heads[index])) {
+                heap.emplace(static_cast<uint64_t>(heads[index].t), index);
+            }
+        }
+        while (!heap.empty()) {
+            const auto index = heap.top().second;
+            heap.pop();
+            ++session.events_in;
+            ++session.events_out;
+            sampled_write(heads[index]);
+            if (next_shifted(*readers[index], specifications[index], heads[index])) {
+                heap.emplace(static_cast<uint64_t>(heads[index].t), index);
+            }
+        }
+    }
+    output.close();
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {
+            "es_merge combines Event Stream files with the same event type into a single timestamp-ordered file.",
+            "Syntax: ./es_merge [options] /path/to/output.es /path/to/input_0.es /path/to/input_1.es ...",
+            "    Each input can be followed by offsets, with the syntax /path/to/input.es@t_offset,x_offset,y_offset",
+            "    or /path/to/input.es@t_offset, t_offset (in microseconds) can be negative, and events",
+            "    whose timestamp would become negative are discarded",
+            "    The string '-' (without quotes) can be used for the standard output and for one input",
+            "Available options:",
+            "    -p, --profile    prints a JSON profiling report on the standard error",
+            "    -h, --help       shows this help message",
+        },
+        argc,
+        argv,
+        -1,
+        {},
+        {{"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            auto& session = profile::current();
+            if (command.arguments.size() < 2) {
+                throw std::runtime_error("es_merge expects an output and at least one input");
+            }
+            session.output(command.arguments[0]);
+            std::vector<input_specification> specifications;
+            std::vector<io::event_stream> inputs;
+            std::size_t standard_inputs = 0;
+            for (std::size_t index = 1; index < command.arguments.size(); ++index) {
+                specifications.push_back(parse_input_specification(command.arguments[index]));
+                const auto& filename = specifications.back().filename;
+                io::check_different(
+                    filename, command.arguments[0], "The inputs and the output must be different files");
+                if (io::is_standard(filename)) {
+                    ++standard_inputs;
+                    if (standard_inputs > 1) {
+                        throw std::runtime_error("The standard input can only be used once");
+                    }
+                }
+                session.input(filename);
+                inputs.push_back(io::open_event_stream(filename));
+            }
+            const auto event_stream_type = inputs.front().header.event_stream_type;
+            uint64_t width = 0;
+            uint64_t height = 0;
+            for (std::size_t index = 0; index < inputs.size(); ++index) {
+                if (inputs[index].header.event_stream_type != event_stream_type) {
+                    throw std::runtime_error(
+                        "'" + specifications[index].filename + "' does not have the same event type as '"
+                        + specifications.front().filename + "'");
+                }
+                if (event_stream_type == sepia::type::generic
+                    && (specifications[index].x_offset > 0 || specifications[index].y_offset > 0)) {
+                    throw std::runtime_error("Generic events do not support spatial offsets");
+                }
+                width = std::max(
+                    width, static_cast<uint64_t>(specifications[index].x_offset) + inputs[index].header.width);
+                height = std::max(
+                    height, static_cast<uint64_t>(specifications[index].y_offset) + inputs[index].header.height);
+            }
+            if (width > std::numeric_limits<uint16_t>::max() || height > std::numeric_limits<uint16_t>::max()) {
+                throw std::runtime_error("The merged canvas is larger than 65535 x 65535 pixels");
+            }
+            switch (event_stream_type) {
+                case sepia::type::generic: {
+                    merge<sepia::type::generic>(std::move(inputs), specifications, command.arguments[0], 0, 0);
+                    break;
+                }
+                case sepia::type::dvs: {
+                    merge<sepia::type::dvs>(
+                        std::move(inputs),
+                        specifications,
+                        command.arguments[0],
+                        static_cast<uint16_t>(width),
+                        static_cast<uint16_t>(height));
+                    break;
+                }
+                case sepia::type::atis: {
+                    merge<sepia::type::atis>(
+                        std::move(inputs),
+                        specifications,
+                        command.arguments[0],
+                        static_cast<uint16_t>(width),
+                        static_cast<uint16_t>(height));
+                    break;
+                }
+                case sepia::type::color: {
+                    merge<sepia::type::color>(
+                        std::move(inputs),
+                        specifications,
+                        command.arguments[0],
+                        static_cast<uint16_t>(width),
+                        static_cast<uint16_t>(height));
+                    break;
+                }
+            }
+        }));
+}
@@ -0,0 +1,217 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "csv.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include "stages.hpp"
+#include <functional>
+
+/// stage_specification holds a stage's name and arguments, as written in the pipeline.
+struct stage_specification {
+    std::string name;
+    std::vector<std::string> arguments;
+};
+
+/// parse_pipeline splits a pipeline such as "cut 0 1000 | crop 0 0 64 64 false | es output.es" into stages.
+/// The last stage must be a sink (es or csv), and sinks cannot appear anywhere else.
+std::vector<stage_specification> parse_pipeline(const std::string& pipeline) {
+    std::vector<stage_specification> stage_specifications;
+    std::istringstream pipeline_stream(pipeline);
+    std::string part;
+    while (std::getline(pipeline_stream, part, '|')) {
+        std::istringstream part_stream(part);
+        stage_specification specification;
+        if (!(part_stream >> specification.name)) {
+            throw std::runtime_error("The pipeline contains an empty stage");
+        }
+        for (std::string argument; part_stream >> argument;) {
+            specification.arguments.push_back(argument);
+        }
+        std::size_t expected_arguments = 0;
+        if (specification.name == "cut") {
+            expected_arguments = 2;
+        } else if (specification.name == "crop") {
+            expected_arguments = 5;
+        } else if (specification.name == "es" || specification.name == "csv") {
+            expected_arguments = 1;
+        } else {
+            throw std::runtime_error(
+                "Unknown stage '" + specification.name + "' (expected cut, crop, es or csv)");
+        }
+        if (specification.arguments.size() != expected_arguments) {
+            throw std::runtime_error(
+                "The stage '" + specification.name + "' expects " + std::to_string(expected_arguments)
+                + " arguments");
+        }
+        stage_specifications.push_back(specification);
+    }
+    if (stage_specifications.empty()) {
+        throw std::runtime_error("The pipeline is empty");
+    }
+    for (std::size_t index = 0; index < stage_specifications.size(); ++index) {
+        const auto is_sink = stage_specifications[index].name == "es" || stage_specifications[index].name == "csv";
+        if (is_sink != (index == stage_specifications.size() - 1)) {
+            throw std::runtime_error("The pipeline must end with a single sink (es or csv)");
+        }
+    }
+    return stage_specifications;
+}
+
+/// make_crop_stage creates a crop stage, generic events do not have coordinates.
+template <sepia::type event_stream_type>
+std::function<void(sepia::event<event_stream_type>)> make_crop_stage(
+    uint16_t left,
+    uint16_t bottom,
+    uint16_t width,
+    uint16_t height,
+    bool keep_offset,
+    std::function<void(sepia::event<event_stream_type>)> handle_event) {
+    return stages::make_crop<sepia::event<event_stream_type>>(
+        left, bottom, width, height, keep_offset, std::move(handle_event));
+}
+template <>
+std::function<void(sepia::generic_event)> make_crop_stage<sepia::type::generic>(
+    uint16_t,
+    uint16_t,
+    uint16_t,
+    uint16_t,
+    bool,
+    std::function<void(sepia::generic_event)>) {
+    throw std::runtime_error("Unsupported event type for crop: generic");
+}
+
+/// pipe decodes the input once and dispatches its events through the stages, down to the sink.
+/// If blocked_sink is true, the es sink writes a blocked Event Stream instead of a plain one.
+template <sepia::type event_stream_type>
+void pipe(io::event_stream input, const std::vector<stage_specification>& stage_specifications, bool blocked_sink) {
+    auto& session = profile::current();
+
+    // track the sensor size through the stages, since crops without offset shrink it
+    auto width = input.header.width;
+    auto height = input.header.height;
+    for (std::size_t index = 0; index < stage_specifications.size() - 1; ++index) {
+        const auto& specification = stage_specifications[index];
+        if (specification.name == "crop") {
+            const auto left = std::stoull(specification.arguments[0]);
+            const auto bottom = std::stoull(specification.arguments[1]);
+            const auto crop_width = std::stoull(specification.arguments[2]);
+            const auto crop_height = std::stoull(specification.arguments[3]);
+            if (left + crop_width > width || bottom + crop_height > height) {
+                throw std::runtime_error("The region selected by crop is out of scope");
+            }
+            if (!stages::string_to_keep_offset(specification.arguments[4])) {
+                width = static_cast<uint16_t>(crop_width);
+                height = static_cast<uint16_t>(crop_height);
+            }
+        }
+    }
+
+    // create the sink
+    const auto& sink = stage_specifications.back();
+    session.output(sink.arguments[0]);
+    auto output = io::open_output(sink.arguments[0]);
+    std::unique_ptr<sepia::write_to_reference<event_stream_type>> write;
+    std::unique_ptr<blocked::write_to_reference<event_stream_type>> blocked_write;
+    std::function<void(sepia::event<event_stream_type>)> handle_event;
+    if (sink.name == "es" && blocked_sink) {
+        blocked_write.reset(new blocked::write_to_reference<event_stream_type>(*output, width, height));
+        handle_event = profile::make_sampled<sepia::event<event_stream_type>>(
+            "write", [&](sepia::event<event_stream_type> event) {
+                ++session.events_out;
+                (*blocked_write)(event);
+            });
+    } else if (sink.name == "es") {
+        write.reset(new sepia::write_to_reference<event_stream_type>(*output, width, height));
+        handle_event = profile::make_sampled<sepia::event<event_stream_type>>(
+            "write", [&](sepia::event<event_stream_type> event) {
+                ++session.events_out;
+                (*write)(event);
+            });
+    } else {
+        *output << csv::header<event_stream_type>();
+        handle_event = profile::make_sampled<sepia::event<event_stream_type>>(
+            "format", [&](const sepia::event<event_stream_type>& event) {
+                ++session.events_out;
+                csv::write_line(*output, event);
+            });
+    }
+
+    // chain the stages from the sink back to the input
+    for (std::size_t index = stage_specifications.size() - 1; index > 0; --index) {
+        const auto& specification = stage_specifications[index - 1];
+        if (specification.name == "cut") {
+            const uint64_t begin = std::stoull(specification.arguments[0]);
+            const uint64_t end = std::stoull(specification.arguments[1]) + begin;
+            handle_event = stages::make_cut<sepia::event<event_stream_type>>(begin, end, std::move(handle_event));
+        } else {
+            handle_event = make_crop_stage<event_stream_type>(
+                static_cast<uint16_t>(std::stoull(specification.arguments[0])),
+                static_cast<uint16_t>(std::stoull(specification.arguments[1])),
+                static_cast<uint16_t>(std::stoull(specification.arguments[2])),
+                static_cast<uint16_t>(std::stoull(specification.arguments[3])),
+                stages::string_to_keep_offset(specification.arguments[4]),
+                std::move(handle_event));
+        }
+    }
+    profile::scope scope("decode");
+    sepia::join_observable<event_stream_type>(std::move(input.stream), [&](sepia::event<event_stream_type> event) {
+            ++session.events_in;
+            handle_event(event);
+        });
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {
+            "es_pipe applies a pipeline of stages to an Event Stream file in a single pass.",
+            "Syntax: ./es_pipe [options] /path/to/input.es 'stage | stage | ... | sink'",
+            "Stages:",
+            "    cut begin duration                       keeps the events from the given time range",
+            "    crop left bottom width height offset     keeps the events from the given region",
+            "    The string '-' (without quotes) can be used for the standard input",
+            "Sinks:",
+            "    es /path/to/output.es                    writes an Event Stream file",
+            "    csv /path/to/output.csv                  writes a CSV file (compatible with Excel and Matlab)",
+            "    The string '-' (without quotes) can be used for the standard output",
+            "Available options:",
+            "    -b, --blocked    writes a blocked Event Stream (es sink only), whose blocks can be skipped by readers",
+            "    -p, --profile    prints a JSON profiling report on the standard error",
+            "    -h, --help       shows this help message",
+        },
+        argc,
+        argv,
+        2,
+        {},
+        {{"blocked", {"b"}}, {"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            const auto stage_specifications = parse_pipeline(command.arguments[1]);
+            io::check_different(
+                command.arguments[0],
+                stage_specifications.back().arguments[0],
+                "The Event Stream input and output must be different files");
+            profile::current().input(command.arguments[0]);
+            const auto blocked_sink = command.flags.find("blocked") != command.flags.end();
+            if (blocked_sink && stage_specifications.back().name != "es") {
+                throw std::runtime_error("The blocked option requires an es sink");
+            }
+            auto input = io::open_event_stream(command.arguments[0]);
+            switch (input.header.event_stream_type) {
+                case sepia::type::generic: {
+                    pipe<sepia::type::generic>(std::move(input), stage_specifications, blocked_sink);
+                    break;
+                }
+                case sepia::type::dvs: {
+                    pipe<sepia::type::dvs>(std::move(input), stage_specifications, blocked_sink);
+                    break;
+                }
+                case sepia::type::atis: {
+                    pipe<sepia::type::atis>(std::move(input), stage_specifications, blocked_sink);
+                    break;
+                }
+                case sepia::type::color: {
+                    pipe<sepia::type::color>(std::move(input), stage_specifications, blocked_sink);
+                    break;
+                }
+            }
+        }));
+}
@@ -0,0 +1,747 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include "blocked.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include <cerrno>
+#include <csignal>
+#include <list>
+#include <map>
+#include <sstream>
+#ifndef _WIN32
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/// maximum_request_size is the maximum length of a request line in bytes.
+constexpr std::size_t maximum_request_size = 1 << 12;
+
+/// maximum_bins is the maximum number of bins of a rate histogram.
+constexpr uint64_t maximum_bins = 1 << 20;
+
+/// client_timeout is the time (in seconds) after which a silent client is disconnected.
+constexpr int client_timeout = 10;
+
+/// block_entry locates a block's payload in an indexed file.
+struct block_entry {
+    blocked::zone_map zone_map;
+    uint64_t offset;
+};
+
+/// file_index holds what the server knows about a file: its header, and the zone maps of its blocks,
+/// which are sorted by time and carry the statistics of their events.
+/// Blocked files are indexed by reading their zone maps only, and their payloads are read from the disk on demand.
+/// Plain files are converted to an in-memory blocked container when they are indexed.
+struct file_index {
+    std::string filename;
+    uint64_t generation;
+    uint64_t size;
+    int64_t modification_time;
+    sepia::header header;
+    std::string header_bytes;
+    std::vector<block_entry> blocks;
+    blocked::zone_map total;
+    std::string container;
+};
+
+/// decoded_block is a block stored in the cache.
+struct decoded_block {
+    virtual ~decoded_block() {}
+    std::size_t bytes;
+};
+
+/// typed_block holds the decoded events of a block.
+template <sepia::type event_stream_type>
+struct typed_block : public decoded_block {
+    std::vector<sepia::event<event_stream_type>> events;
+};
+
+/// block_cache is a thread-safe least-recently-used cache of decoded blocks, bounded by the blocks' size in bytes.
+/// Blocks are identified by their file's generation (which changes when the file is re-indexed) and their index,
+/// hence the blocks of modified files are never returned, and are evicted once they are the oldest.
+class block_cache {
+    public:
+    typedef std::pair<uint64_t, std::size_t> key;
+
+    block_cache(std::size_t capacity) : _capacity(capacity), _bytes(0), _hits(0), _misses(0) {}
+    block_cache(const block_cache&) = delete;
+    block_cache(block_cache&&) = delete;
+    block_cache& operator=(const block_cache&) = delete;
+    block_cache& operator=(block_cache&&) = delete;
+    virtual ~block_cache() {}
+
+    /// find returns a cached block and marks it as the most recently used, or returns nullptr.
+    virtual std::shared_ptr<const decoded_block> find(key block_key) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto position = _positions.find(block_key);
+        if (position == _positions.end()) {
+            ++_misses;
+            return nullptr;
+        }
+        ++_hits;
+        _entries.splice(_entries.begin(), _entries, position->second);
+        return position->second->second;
+    }
+
+    /// insert adds a block, and evicts the least recently used blocks to stay within the capacity.
+    virtual void insert(key block_key, std::shared_ptr<const decoded_block> block) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_positions.find(block_key) != _positions.end() || block->bytes > _capacity) {
+            return;
+        }
+        _entries.emplace_front(block_key, std::move(block));
+        _positions[block_key] = _entries.begin();
+        _bytes += _entries.front().second->bytes;
+        while (_bytes > _capacity) {
+            _bytes -= _entries.back().second->bytes;
+            _positions.erase(_entries.back().first);
+            _entries.pop_back();
+        }
+    }
+
+    /// to_json returns the cache's statistics.
+    virtual std::string to_json() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::stringstream stream;
+        stream << "\"cached_blocks\": " << _entries.size() << ", \"cached_bytes\": " << _bytes
+               << ", \"capacity\": " << _capacity << ", \"hits\": " << _hits << ", \"misses\": " << _misses;
+        return stream.str();
+    }
+
+    protected:
+    const std::size_t _capacity;
+    std::size_t _bytes;
+    uint64_t _hits;
+    uint64_t _misses;
+    std::list<std::pair<key, std::shared_ptr<const decoded_block>>> _entries;
+    std::map<key, std::list<std::pair<key, std::shared_ptr<const decoded_block>>>::iterator> _positions;
+    std::mutex _mutex;
+};
+
+/// type_to_string returns a text representation of the type enum.
+std::string type_to_string(sepia::type type) {
+    switch (type) {
+        case sepia::type::generic:
+            return "generic";
+        case sepia::type::dvs:
+            return "dvs";
+        case sepia::type::atis:
+            return "atis";
+        case sepia::type::color:
+            return "color";
+    }
+    return "unknown";
+}
+
+/// json_string quotes and escapes a string.
+std::string json_string(const std::string& value) {
+    std::string json("\"");
+    for (const auto character : value) {
+        if (character == '"' || character == '\\') {
+            json.push_back('\\');
+            json.push_back(character);
+        } else if (static_cast<uint8_t>(character) < 0x20) {
+            json.push_back(' ');
+        } else {
+            json.push_back(character);
+        }
+    }
+    json.push_back('"');
+    return json;
+}
+
+/// saturated_end returns begin + duration, or the largest timestamp on overflow.
+uint64_t saturated_end(uint64_t begin, uint64_t duration) {
+    return duration > std::numeric_limits<uint64_t>::max() - begin ? std::numeric_limits<uint64_t>::max()
+                                                                   : begin + duration;
+}
+
+/// read_zone_maps fills an index from a blocked container positioned at its beginning.
+void read_zone_maps(std::istream& stream, file_index& index) {
+    index.header_bytes = blocked::read_header(stream);
+    blocked::zone_map zone_map;
+    while (blocked::read_zone_map(stream, zone_map)) {
+        if (zone_map.events > 0) {
+            if (index.blocks.empty()) {
+                index.total.begin_t = zone_map.begin_t;
+            }
+            index.total.end_t = zone_map.end_t;
+            index.total.events += zone_map.events;
+            index.total.dvs_events += zone_map.dvs_events;
+            index.total.increase_events += zone_map.increase_events;
+            index.total.second_events += zone_map.second_events;
+            index.blocks.push_back({zone_map, static_cast<uint64_t>(stream.tellg())});
+        }
+        blocked::skip_payload(stream, zone_map);
+    }
+}
+
+/// make_container converts a plain Event Stream to an in-memory blocked container.
+template <sepia::type event_stream_type>
+std::string make_container(io::event_stream input) {
+    std::ostringstream container;
+    {
+        blocked::write_to_reference<event_stream_type> write(container, input.header.width, input.header.height);
+        sepia::join_observable<event_stream_type>(
+            std::move(input.stream), [&](sepia::event<event_stream_type> event) { write(event); });
+    }
+    return container.str();
+}
+
+/// make_index reads a file's zone maps (blocked files) or converts it to a blocked container (plain files).
+std::shared_ptr<const file_index>
+make_index(const std::string& filename, uint64_t generation, uint64_t size, int64_t modification_time) {
+    std::shared_ptr<file_index> index(new file_index{});
+    index->filename = filename;
+    index->generation = generation;
+    index->size = size;
+    index->modification_time = modification_time;
+    auto input = io::open_event_stream(filename, true);
+    index->header = input.header;
+    if (input.is_blocked) {
+        auto stream = sepia::filename_to_ifstream(filename);
+        read_zone_maps(*stream, *index);
+    } else {
+        switch (input.header.event_stream_type) {
+            case sepia::type::generic:
+                index->container = make_container<sepia::type::generic>(std::move(input));
+                break;
+            case sepia::type::dvs:
+                index->container = make_container<sepia::type::dvs>(std::move(input));
+                break;
+            case sepia::type::atis:
+                index->container = make_container<sepia::type::atis>(std::move(input));
+                break;
+            case sepia::type::color:
+                index->container = make_container<sepia::type::color>(std::move(input));
+                break;
+        }
+        std::istringstream stream(index->container);
+        read_zone_maps(stream, *index);
+    }
+    return index;
+}
+
+/// decode_block reads and decodes a block's payload.
+template <sepia::type event_stream_type>
+std::shared_ptr<const decoded_block> decode_block(const file_index& index, const block_entry& entry) {
+    auto bytes = index.header_bytes;
+    if (index.container.empty()) {
+        auto stream = sepia::filename_to_ifstream(index.filename);
+        stream->seekg(static_cast<std::istream::off_type>(entry.offset));
+        bytes.resize(index.header_bytes.size() + entry.zone_map.payload_size);
+        stream->read(&bytes[index.header_bytes.size()], static_cast<std::streamsize>(entry.zone_map.payload_size));
+        if (stream->gcount() != static_cast<std::streamsize>(entry.zone_map.payload_size)) {
+            throw std::runtime_error("'" + index.filename + "' is truncated");
+        }
+    } else {
+        bytes.append(index.container, static_cast<std::size_t>(entry.offset), entry.zone_map.payload_size);
+    }
+    std::shared_ptr<typed_block<event_stream_type>> block(new typed_block<event_stream_type>());
+    block->events.reserve(static_cast<std::size_t>(entry.zone_map.events));
+    sepia::join_observable<event_stream_type>(
+        std::unique_ptr<std::istream>(new std::istringstream(bytes)), [&](sepia::event<event_stream_type> event) {
+            event.t += entry.zone_map.base_t;
+            block->events.push_back(event);
+        });
+    block->bytes = block->events.capacity() * sizeof(sepia::event<event_stream_type>);
+    return block;
+}
+
+/// is_in_region returns true if an event belongs to a region, generic events do not have coordinates.
+template <typename Event>
+bool is_in_region(const Event& event, uint64_t left, uint64_t bottom, uint64_t right, uint64_t top) {
+    return event.x >= left && event.x < right && event.y >= bottom && event.y < top;
+}
+template <>
+bool is_in_region<sepia::generic_event>(const sepia::generic_event&, uint64_t, uint64_t, uint64_t, uint64_t) {
+    return true;
+}
+
+/// socket_streambuf writes to a socket through a buffer.
+class socket_streambuf : public std::streambuf {
+    public:
+    socket_streambuf(int socket) : _socket(socket), _buffer(async::block_size / 16) {
+        setp(_buffer.data(), _buffer.data() + _buffer.size());
+    }
+    socket_streambuf(const socket_streambuf&) = delete;
+    socket_streambuf(socket_streambuf&&) = delete;
+    socket_streambuf& operator=(const socket_streambuf&) = delete;
+    socket_streambuf& operator=(socket_streambuf&&) = delete;
+    virtual ~socket_streambuf() {}
+
+    protected:
+    /// overflow sends the buffer when it is full.
+    virtual int_type overflow(int_type character) override {
+        if (!send_buffer()) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(character, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(character);
+            pbump(1);
+        }
+        return traits_type::not_eof(character);
+    }
+
+    /// sync sends the pending bytes.
+    virtual int sync() override {
+        return send_buffer() ? 0 : -1;
+    }
+
+    /// send_buffer writes the pending bytes to the socket, and returns false if the client disconnected.
+    bool send_buffer() {
+#ifndef _WIN32
+        for (auto begin = pbase(); begin < pptr();) {
+            const auto count = send(_socket, begin, static_cast<std::size_t>(pptr() - begin), 0);
+            if (count <= 0) {
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            begin += count;
+        }
+#endif
+        setp(_buffer.data(), _buffer.data() + _buffer.size());
+        return true;
+    }
+
+    const int _socket;
+    std::vector<char> _buffer;
+};
+
+/// server answers the requests of clients, and keeps the files' indexes and recently decoded blocks in memory.
+/// Requests are text lines (the arguments are separated by spaces, and the path is the rest of the line):
+///     stats path                                      JSON statistics aggregated from the zone maps
+///     extract begin duration path                     Event Stream bytes of the events in the time range
+///     count begin duration left,bottom,width,height path    JSON number of events in the time range and region
+///     rate begin duration bin path                    JSON number of events per bin of the time range
+///     status                                          JSON cache statistics
+/// Blocks which are entirely inside (or outside) a count or a rate bin are answered from the zone maps,
+/// only the blocks across a boundary are decoded.
+class server {
+    public:
+    server(std::size_t cache_capacity) : _cache(cache_capacity), _generation(0), _events_out(0) {}
+    server(const server&) = delete;
+    server(server&&) = delete;
+    server& operator=(const server&) = delete;
+    server& operator=(server&&) = delete;
+    virtual ~server() {}
+
+    /// handle answers a request, errors are reported as JSON objects with an 'error' field.
+    virtual void handle(const std::string& request, std::ostream& output) {
+        try {
+            std::istringstream stream(request);
+            std::string command;
+            stream >> command;
+            if (command == "status") {
+                std::lock_guard<std::mutex> lock(_mutex);
+                output << "{\"files\": " << _indexes.size() << ", " << _cache.to_json() << "}\n";
+                return;
+            }
+            if (command != "stats" && command != "extract" && command != "count" && command != "rate") {
+                throw std::runtime_error("unknown request (expected stats, extract, count, rate or status)");
+            }
+            uint64_t begin = 0;
+            uint64_t end = std::numeric_limits<uint64_t>::max();
+            if (command != "stats") {
+                uint64_t duration = 0;
+                if (!(stream >> begin >> duration)) {
+                    throw std::runtime_error("'" + command + "' expects a begin timestamp and a duration");
+                }
+                end = saturated_end(begin, duration);
+            }
+            uint64_t left = 0;
+            uint64_t bottom = 0;
+            uint64_t right = std::numeric_limits<uint16_t>::max() + 1ull;
+            uint64_t top = std::numeric_limits<uint16_t>::max() + 1ull;
+            if (command == "count") {
+                std::string roi;
+                stream >> roi;
+                std::vector<uint64_t> values;
+                std::istringstream roi_stream(roi);
+                for (std::string value; std::getline(roi_stream, value, ',');) {
+                    values.push_back(std::stoull(value));
+                }
+                if (values.size() != 4) {
+                    throw std::runtime_error("the region must have the format left,bottom,width,height");
+                }
+                left = values[0];
+                bottom = values[1];
+                right = values[0] + values[2];
+                top = values[1] + values[3];
+            }
+            uint64_t bin = 0;
+            if (command == "rate") {
+                if (!(stream >> bin) || bin == 0) {
+                    throw std::runtime_error("'rate' expects a strictly positive bin duration");
+                }
+                if ((end - begin) / bin >= maximum_bins) {
+                    throw std::runtime_error("the histogram has too many bins");
+                }
+            }
+            std::string filename;
+            std::getline(stream >> std::ws, filename);
+            if (filename.empty()) {
+                throw std::runtime_error("'" + command + "' expects a path");
+            }
+            const auto index = find_index(filename);
+            const auto event_stream_type = index->header.event_stream_type;
+            if (command == "stats") {
+                stats(*index, output);
+            } else if (command == "extract") {
+                switch (event_stream_type) {
+                    case sepia::type::generic:
+                        extract<sepia::type::generic>(*index, begin, end, output);
+                        break;
+                    case sepia::type::dvs:
+                        extract<sepia::type::dvs>(*index, begin, end, output);
+                        break;
+                    case sepia::type::atis:
+                        extract<sepia::type::atis>(*index, begin, end, output);
+                        break;
+                    case sepia::type::color:
+                        extract<sepia::type::color>(*index, begin, end, output);
+                        break;
+                }
+            } else {
+                if (command == "count" && event_stream_type == sepia::type::generic) {
+                    throw std::runtime_error("generic events do not have coordinates");
+                }
+                std::vector<uint64_t> counts;
+                switch (event_stream_type) {
+                    case sepia::type::generic:
+                        counts = count<sepia::type::generic>(*index, begin, end, bin, left, bottom, right, top);
+                        break;
+                    case sepia::type::dvs:
+                        counts = count<sepia::type::dvs>(*index, begin, end, bin, left, bottom, right, top);
+                        break;
+                    case sepia::type::atis:
+                        counts = count<sepia::type::atis>(*index, begin, end, bin, left, bottom, right, top);
+                        break;
+                    case sepia::type::color:
+                        counts = count<sepia::type::color>(*index, begin, end, bin, left, bottom, right, top);
+                        break;
+                }
+                if (command == "count") {
+                    output << "{\"events\": " << counts.front() << "}\n";
+                } else {
+                    output << "{\"begin_t\": " << begin << ", \"bin\": " << bin << ", \"counts\": [";
+                    for (std::size_t position = 0; position < counts.size(); ++position) {
+                        output << (position > 0 ? ", " : "") << counts[position];
+                    }
+                    output << "]}\n";
+                }
+            }
+        } catch (const std::exception& exception) {
+            output << "{\"error\": " << json_string(exception.what()) << "}\n";
+        }
+    }
+
+    /// events_out returns the number of events sent to the clients.
+    virtual uint64_t events_out() const {
+        return _events_out.load();
+    }
+
+    protected:
+    /// find_index returns a file's index, and re-indexes the file if its size or modification time changed.
+    std::shared_ptr<const file_index> find_index(const std::string& filename) {
+        uint64_t size = 0;
+        int64_t modification_time = 0;
+#ifndef _WIN32
+        struct stat status;
+        if (stat(filename.c_str(), &status) != 0) {
+            throw sepia::unreadable_file(filename);
+        }
+        size = static_cast<uint64_t>(status.st_size);
+        modification_time = static_cast<int64_t>(status.st_mtime);
+#endif
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            const auto name_and_index = _indexes.find(filename);
+            if (name_and_index != _indexes.end() && name_and_index->second->size == size
+                && name_and_index->second->modification_time == modification_time) {
+                return name_and_index->second;
+            }
+        }
+        const auto index = make_index(filename, ++_generation, size, modification_time);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _indexes[filename] = index;
+        return index;
+    }
+
+    /// load returns a block's events, from the cache if possible.
+    template <sepia::type event_stream_type>
+    std::shared_ptr<const typed_block<event_stream_type>> load(const file_index& index, std::size_t block_index) {
+        const block_cache::key block_key{index.generation, block_index};
+        auto block = _cache.find(block_key);
+        if (!block) {
+            block = decode_block<event_stream_type>(index, index.blocks[block_index]);
+            _cache.insert(block_key, block);
+        }
+        return std::static_pointer_cast<const typed_block<event_stream_type>>(block);
+    }
+
+    /// first_block returns the index of the first block which may contain events at or after begin.
+    std::size_t first_block(const file_index& index, uint64_t begin) {
+        return static_cast<std::size_t>(
+            std::lower_bound(
+                index.blocks.begin(),
+                index.blocks.end(),
+                begin,
+                [](const block_entry& entry, uint64_t t) { return entry.zone_map.end_t < t; })
+            - index.blocks.begin());
+    }
+
+    /// stats writes the statistics aggregated from the zone maps.
+    void stats(const file_index& index, std::ostream& output) {
+        const auto event_stream_type = index.header.event_stream_type;
+        output << "{\"type\": \"" << type_to_string(event_stream_type) << "\"";
+        if (event_stream_type != sepia::type::generic) {
+            output << ", \"width\": " << index.header.width << ", \"height\": " << index.header.height;
+        }
+        if (!index.blocks.empty()) {
+            output << ", \"begin_t\": " << index.total.begin_t << ", \"end_t\": " << index.total.end_t;
+        }
+        output << ", \"events\": " << index.total.events;
+        if (event_stream_type == sepia::type::atis) {
+            output << ", \"dvs_events\": " << index.total.dvs_events;
+        }
+        if (event_stream_type == sepia::type::dvs || event_stream_type == sepia::type::atis) {
+            output << ", \"increase_events\": " << index.total.increase_events;
+        }
+        if (event_stream_type == sepia::type::atis) {
+            output << ", \"second_events\": " << index.total.second_events;
+        }
+        output << ", \"blocks\": " << index.blocks.size() << "}\n";
+    }
+
+    /// extract writes the events in [begin, end[ as an Event Stream.
+    template <sepia::type event_stream_type>
+    void extract(const file_index& index, uint64_t begin, uint64_t end, std::ostream& output) {
+        uint64_t events = 0;
+        {
+            sepia::write_to_reference<event_stream_type> write(output, index.header.width, index.header.height);
+            for (auto block_index = first_block(index, begin);
+                 block_index < index.blocks.size() && index.blocks[block_index].zone_map.begin_t < end;
+                 ++block_index) {
+                const auto block = load<event_stream_type>(index, block_index);
+                for (const auto& event : block->events) {
+                    if (event.t >= end) {
+                        break;
+                    }
+                    if (event.t >= begin) {
+                        write(event);
+                        ++events;
+                    }
+                }
+            }
+        }
+        _events_out += events;
+    }
+
+    /// count returns the number of events in [begin, end[ and in the region, per bin if bin is not zero
+    /// (the last bin may be partial).
+    template <sepia::type event_stream_type>
+    std::vector<uint64_t> count(
+        const file_index& index,
+        uint64_t begin,
+        uint64_t end,
+        uint64_t bin,
+        uint64_t left,
+        uint64_t bottom,
+        uint64_t right,
+        uint64_t top) {
+        if (begin >= end) {
+            return std::vector<uint64_t>(1, 0);
+        }
+        if (bin == 0) {
+            bin = end - begin;
+        }
+        std::vector<uint64_t> counts(
+            static_cast<std::size_t>((end - begin) / bin + ((end - begin) % bin == 0 ? 0 : 1)), 0);
+        for (auto block_index = first_block(index, begin);
+             block_index < index.blocks.size() && index.blocks[block_index].zone_map.begin_t < end;
+             ++block_index) {
+            const auto& zone_map = index.blocks[block_index].zone_map;
+            if (zone_map.right < left || zone_map.left >= right || zone_map.top < bottom || zone_map.bottom >= top) {
+                continue;
+            }
+            if (zone_map.begin_t >= begin && zone_map.end_t < end
+                && (zone_map.begin_t - begin) / bin == (zone_map.end_t - begin) / bin && zone_map.left >= left
+                && zone_map.right < right && zone_map.bottom >= bottom && zone_map.top < top) {
+                counts[static_cast<std::size_t>((zone_map.begin_t - begin) / bin)] += zone_map.events;
+                continue;
+            }
+            const auto block = load<event_stream_type>(index, block_index);
+            for (const auto& event : block->events) {
+                if (event.t >= end) {
+                    break;
+                }
+                if (event.t >= begin && is_in_region(event, left, bottom, right, top)) {
+                    ++counts[static_cast<std::size_t>((event.t - begin) / bin)];
+                }
+            }
+        }
+        return counts;
+    }
+
+    block_cache _cache;
+    std::atomic<uint64_t> _generation;
+    std::atomic<uint64_t> _events_out;
+    std::map<std::string, std::shared_ptr<const file_index>> _indexes;
+    std::mutex _mutex;
+};
+
+/// stopped is set by the termination signals' handler.
+volatile std::sig_atomic_t stopped = 0;
+
+/// handle_signal requests the server to stop.
+extern "C" void handle_signal(int) {
+    stopped = 1;
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {"es_serve answers queries about Event Stream files on a Unix domain socket",
+         "Syntax: ./es_serve [options] /path/to/socket",
+         "    Each connection sends one request line, and receives the response before the server closes it:",
+         "        stats /path/to/input.es",
+         "        extract begin duration /path/to/input.es",
+         "        count begin duration left,bottom,width,height /path/to/input.es",
+         "        rate begin duration bin /path/to/input.es",
+         "        status",
+         "    extract returns Event Stream bytes, the other requests return JSON objects",
+         "    Errors are returned as JSON objects with an 'error' field",
+         "Available options:",
+         "    -c [size], --cache [size]          sets the size of the decoded blocks cache in megabytes",
+         "                                           defaults to 1024",
+         "    -j [threads], --threads [threads]  sets the number of threads serving clients",
+         "                                           defaults to the number of hardware threads",
+         "    -p, --profile                      prints a JSON profiling report on the standard error",
+         "                                           when the server stops",
+         "    -h, --help                         shows this help message"},
+        argc,
+        argv,
+        1,
+        {
+            {"cache", {"c"}},
+            {"threads", {"j"}},
+        },
+        {{"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+#ifdef _WIN32
+            throw std::runtime_error("es_serve requires Unix domain sockets, which are not supported on Windows");
+#else
+            std::size_t cache_capacity = 1024;
+            {
+                const auto name_and_argument = command.options.find("cache");
+                if (name_and_argument != command.options.end()) {
+                    cache_capacity = std::stoull(name_and_argument->second);
+                }
+            }
+            std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+            {
+                const auto name_and_argument = command.options.find("threads");
+                if (name_and_argument != command.options.end()) {
+                    threads = std::stoull(name_and_argument->second);
+                    if (threads == 0) {
+                        throw std::runtime_error("[threads] must be strictly positive");
+                    }
+                }
+            }
+            const auto& socket_path = command.arguments[0];
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (socket_path.size() >= sizeof(address.sun_path)) {
+                throw std::runtime_error("the socket path is too long");
+            }
+            std::copy(socket_path.begin(), socket_path.end(), address.sun_path);
+            {
+                struct stat status;
+                if (stat(socket_path.c_str(), &status) == 0) {
+                    if (!S_ISSOCK(status.st_mode)) {
+                        throw std::runtime_error("'" + socket_path + "' exists and is not a socket");
+                    }
+                    unlink(socket_path.c_str());
+                }
+            }
+            const auto listener = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listener < 0) {
+                throw std::runtime_error("creating the socket failed");
+            }
+            if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || listen(listener, SOMAXCONN) != 0) {
+                close(listener);
+                throw std::runtime_error("listening on '" + socket_path + "' failed");
+            }
+
+            // the workers ignore the termination signals, so that they interrupt accept on the main thread
+            std::signal(SIGPIPE, SIG_IGN);
+            sigset_t signals;
+            sigemptyset(&signals);
+            sigaddset(&signals, SIGINT);
+            sigaddset(&signals, SIGTERM);
+            pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+            server events_server(cache_capacity << 20);
+            async::bounded_queue<int> clients(threads * 4);
+            std::vector<std::thread> workers;
+            for (std::size_t index = 0; index < threads; ++index) {
+                workers.emplace_back([&]() {
+                    for (int client; clients.pop(client);) {
+                        timeval timeout{client_timeout, 0};
+                        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                        std::string request;
+                        for (char character; request.size() < maximum_request_size;) {
+                            const auto count = recv(client, &character, 1, 0);
+                            if (count <= 0 || character == '\n') {
+                                break;
+                            }
+                            request.push_back(character);
+                        }
+                        if (!request.empty() && request.back() == '\r') {
+                            request.pop_back();
+                        }
+                        {
+                            socket_streambuf streambuf(client);
+                            std::ostream output(&streambuf);
+                            events_server.handle(request, output);
+                            output.flush();
+                        }
+                        close(client);
+                    }
+                });
+            }
+            struct sigaction action {};
+            action.sa_handler = handle_signal;
+            sigemptyset(&action.sa_mask);
+            action.sa_flags = 0;
+            sigaction(SIGINT, &action, nullptr);
+            sigaction(SIGTERM, &action, nullptr);
+            pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+            {
+                profile::scope scope("serve");
+                while (stopped == 0) {
+                    const auto client = accept(listener, nullptr, nullptr);
+                    if (client < 0) {
+                        continue;
+                    }
+                    clients.push(client);
+                }
+            }
+            clients.close();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            close(listener);
+            unlink(socket_path.c_str());
+            profile::current().events_out += events_server.events_out();
+#endif
+        }));
+}
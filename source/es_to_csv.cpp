@@ -1,61 +1,225 @@
 #include "../third_party/pontella/source/pontella.hpp"
 #include "../third_party/sepia/source/sepia.hpp"
+#include "csv.hpp"
+#include "follow.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+
+/// events_per_batch is the number of events formatted at once.
+constexpr std::size_t events_per_batch = 1 << 14;
+
+/// es_to_csv writes the selected columns of the events in [begin, end[ and in the region as CSV lines.
+/// The decoder stops at the first event past the end, and the blocks of a blocked input which
+/// do not overlap with the time range or the region (if has_roi is true, see csv::keep_block)
+/// are skipped without being decoded.
+/// Events are formatted in batches by a formatter specialized for the selected columns.
+/// The input is either an io::event_stream or a follow::event_stream, see follow::observe. Followed files
+/// flush the pending lines periodically, so that readers see the events shortly after they are written.
+template <sepia::type event_stream_type, typename Input>
+void es_to_csv(
+    Input input,
+    std::ostream& output,
+    uint32_t selected,
+    uint64_t begin,
+    uint64_t end,
+    const csv::region& roi,
+    bool has_roi) {
+    auto& session = profile::current();
+    const auto format = csv::make_formatter<event_stream_type>(selected);
+    std::vector<sepia::event<event_stream_type>> events;
+    events.reserve(events_per_batch);
+    std::string buffer;
+    const auto flush = [&]() {
+        profile::scope scope("format");
+        session.events_out += events.size();
+        format(events, buffer);
+        output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+        events.clear();
+    };
+    output << csv::header<event_stream_type>(selected);
+    {
+        profile::scope scope("decode");
+        follow::observe<event_stream_type>(
+            std::move(input),
+            [&](const blocked::zone_map& zone_map) {
+                if (zone_map.begin_t >= end) {
+                    throw sepia::end_of_file();
+                }
+                return csv::keep_block(zone_map, begin, roi, has_roi);
+            },
+            [&](const sepia::event<event_stream_type>& event) {
+                ++session.events_in;
+                if (event.t >= end) {
+                    throw sepia::end_of_file();
+                }
+                if (event.t >= begin && csv::is_in_region(event, roi)) {
+                    events.push_back(event);
+                    if (events.size() == events_per_batch) {
+                        flush();
+                    }
+                }
+            },
+            [&]() {
+                flush();
+                output.flush();
+            });
+    }
+    flush();
+}
+
+/// es_to_csv_input calls es_to_csv with the input's event type, and the default columns if none are selected.
+template <typename Input>
+void es_to_csv_input(
+    Input input,
+    std::ostream& output,
+    const std::string& columns,
+    uint64_t begin,
+    uint64_t end,
+    const csv::region& roi,
+    bool has_roi) {
+    switch (input.header.event_stream_type) {
+        case sepia::type::generic:
+            es_to_csv<sepia::type::generic>(
+                std::move(input),
+                output,
+                columns.empty() ? (1u << 2) - 1 : csv::parse_columns<sepia::type::generic>(columns),
+                begin,
+                end,
+                roi,
+                has_roi);
+            break;
+        case sepia::type::dvs:
+            es_to_csv<sepia::type::dvs>(
+                std::move(input),
+                output,
+                columns.empty() ? (1u << 4) - 1 : csv::parse_columns<sepia::type::dvs>(columns),
+                begin,
+                end,
+                roi,
+                has_roi);
+            break;
+        case sepia::type::atis:
+            es_to_csv<sepia::type::atis>(
+                std::move(input),
+                output,
+                columns.empty() ? (1u << 5) - 1 : csv::parse_columns<sepia::type::atis>(columns),
+                begin,
+                end,
+                roi,
+                has_roi);
+            break;
+        case sepia::type::color:
+            es_to_csv<sepia::type::color>(
+                std::move(input),
+                output,
+                columns.empty() ? (1u << 6) - 1 : csv::parse_columns<sepia::type::color>(columns),
+                begin,
+                end,
+                roi,
+                has_roi);
+            break;
+    }
+}
 
 int main(int argc, char* argv[]) {
     return pontella::main(
         {"es_to_csv converts an Event Stream file into a csv file (compatible with Excel and Matlab)\n"
          "Syntax: ./es_to_csv [options] /path/to/input.es /path/to/output.csv\n",
+         "    The string '-' (without quotes) can be used for the standard input and output",
          "Available options:",
-         "    -h, --help    shows this help message"},
+         "    -c [columns], --columns [columns]             writes only the given comma-separated columns",
+         "                                                      (for example t,x,y), the columns are",
+         "                                                      always written in the default order",
+         "    -t [timestamp], --begin [timestamp]           skips the events before [timestamp]",
+         "                                                      (in microseconds, defaults to 0)",
+         "    -d [duration], --duration [duration]          writes only the events before begin + [duration]",
+         "                                                      (in microseconds), the rest of the file",
+         "                                                      is not decoded",
+         "    -r [left,bottom,width,height],                writes only the events in the given region",
+         "        --roi [left,bottom,width,height]",
+         "    -f, --follow                                  follows a file which is still being written,",
+         "                                                      the lines are flushed as the events arrive",
+         "    -i [duration], --idle [duration]              stops following once the file has not grown",
+         "                                                      for [duration] (in milliseconds), defaults",
+         "                                                      to 0 (follows until interrupted)",
+         "    -p, --profile                                 prints a JSON profiling report on the standard error",
+         "    -h, --help                                    shows this help message"},
         argc,
         argv,
         2,
-        {},
-        {},
-        [](pontella::command command) {
-            const auto header = sepia::read_header(sepia::filename_to_ifstream(command.arguments[0]));
-            auto input = sepia::filename_to_ifstream(command.arguments[0]);
-            auto output = sepia::filename_to_ofstream(command.arguments[1]);
-            switch (header.event_stream_type) {
-                case sepia::type::generic:
-                    *output << "t,bytes\n";
-                    sepia::join_observable<sepia::type::generic>(
-                        std::move(input), [&](sepia::generic_event generic_event) {
-                            *output << generic_event.t << ",";
-                            *output << std::hex;
-                            for (std::size_t index = 0; index < generic_event.bytes.size(); ++index) {
-                                *output << static_cast<uint32_t>(generic_event.bytes[index]);
-                                if (index == generic_event.bytes.size() - 1) {
-                                    *output << "\n";
-                                } else {
-                                    *output << " ";
-                                }
-                            }
-                            *output << std::dec;
-                        });
-                    break;
-                case sepia::type::dvs:
-                    *output << "t,x,y,is_increase\n";
-                    sepia::join_observable<sepia::type::dvs>(std::move(input), [&](sepia::dvs_event dvs_event) {
-                        *output << dvs_event.t << "," << dvs_event.x << "," << dvs_event.y << ","
-                                << dvs_event.is_increase << "\n";
-                    });
-                    break;
-                case sepia::type::atis:
-                    *output << "t,x,y,is_threshold_crossing,polarity\n";
-                    sepia::join_observable<sepia::type::atis>(std::move(input), [&](sepia::atis_event atis_event) {
-                        *output << atis_event.t << "," << atis_event.x << "," << atis_event.y << ","
-                                << atis_event.is_threshold_crossing << "," << atis_event.polarity << "\n";
-                    });
-                    break;
-                case sepia::type::color:
-                    *output << "t,x,y,r,g,b\n";
-                    sepia::join_observable<sepia::type::color>(std::move(input), [&](sepia::color_event color_event) {
-                        *output << color_event.t << "," << color_event.x << "," << color_event.y << ","
-                                << static_cast<uint32_t>(color_event.r) << "," << static_cast<uint32_t>(color_event.g)
-                                << "," << static_cast<uint32_t>(color_event.b) << "\n";
-                    });
-                    break;
+        {
+            {"columns", {"c"}},
+            {"begin", {"t"}},
+            {"duration", {"d"}},
+            {"roi", {"r"}},
+            {"idle", {"i"}},
+        },
+        {{"follow", {"f"}}, {"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            auto& session = profile::current();
+            session.input(command.arguments[0]);
+            session.output(command.arguments[1]);
+            const auto is_followed = command.flags.find("follow") != command.flags.end();
+            io::event_stream input{};
+            follow::event_stream followed_input{};
+            if (is_followed) {
+                if (io::is_standard(command.arguments[0])) {
+                    throw std::runtime_error("The follow option requires a file");
+                }
+                follow::handle_signals();
+                followed_input = follow::open_event_stream(
+                    command.arguments[0], follow::parse_milliseconds(command, "idle", std::chrono::milliseconds(0)));
+            } else {
+                input = io::open_event_stream(command.arguments[0], true);
+            }
+            const auto header = is_followed ? followed_input.header : input.header;
+            uint64_t begin = 0;
+            {
+                const auto name_and_argument = command.options.find("begin");
+                if (name_and_argument != command.options.end()) {
+                    begin = std::stoull(name_and_argument->second);
+                }
+            }
+            auto end = std::numeric_limits<uint64_t>::max();
+            {
+                const auto name_and_argument = command.options.find("duration");
+                if (name_and_argument != command.options.end()) {
+                    end = begin + std::stoull(name_and_argument->second);
+                }
+            }
+            csv::region roi{0, 0, header.width, header.height};
+            auto has_roi = false;
+            {
+                const auto name_and_argument = command.options.find("roi");
+                if (name_and_argument != command.options.end()) {
+                    has_roi = true;
+                    if (header.event_stream_type == sepia::type::generic) {
+                        throw std::runtime_error("generic events are not compatible with --roi");
+                    }
+                    std::vector<uint64_t> values;
+                    std::istringstream stream(name_and_argument->second);
+                    for (std::string value; std::getline(stream, value, ',');) {
+                        values.push_back(std::stoull(value));
+                    }
+                    if (values.size() != 4) {
+                        throw std::runtime_error("[roi] must have the format left,bottom,width,height");
+                    }
+                    roi = {values[0], values[1], values[2], values[3]};
+                }
+            }
+            std::string columns;
+            {
+                const auto name_and_argument = command.options.find("columns");
+                if (name_and_argument != command.options.end()) {
+                    columns = name_and_argument->second;
+                }
+            }
+            auto output = io::open_output(command.arguments[1]);
+            if (is_followed) {
+                es_to_csv_input(std::move(followed_input), *output, columns, begin, end, roi, has_roi);
+            } else {
+                es_to_csv_input(std::move(input), *output, columns, begin, end, roi, has_roi);
             }
-        });
+        }));
 }
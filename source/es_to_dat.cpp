@@ -0,0 +1,113 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include "dat.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+
+/// open_dat creates a buffered .dat output, or returns nullptr if the filename is 'none'.
+std::unique_ptr<async::write_behind_ostream> open_dat(const std::string& filename) {
+    if (filename == "none") {
+        return nullptr;
+    }
+    return std::unique_ptr<async::write_behind_ostream>(new async::write_behind_ostream(io::open_output(filename)));
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {"es_to_dat converts an Event Stream file into a td file and an aps file",
+         "Syntax: ./es_to_dat [options] /path/to/input.es /path/to/output_td.dat /path/to/output_aps.dat",
+         "    DVS events are written to the td file, and the aps file must be 'none' (without quotes)",
+         "    ATIS change detections are written to the td file, and threshold crossings to the aps file,",
+         "    either can be 'none' (without quotes) to skip it",
+         "    The .dat format stores 32-bit timestamps, hence timestamps wrap around after about 71 minutes",
+         "    The string '-' (without quotes) can be used for the standard input and for one of the outputs",
+         "Available options:",
+         "    -p, --profile    prints a JSON profiling report on the standard error",
+         "    -h, --help       shows this help message"},
+        argc,
+        argv,
+        3,
+        {},
+        {{"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            if (command.arguments[1] == command.arguments[2]) {
+                throw std::runtime_error("The td and aps outputs must be different files, and cannot be both none");
+            }
+            for (std::size_t index = 1; index < 3; ++index) {
+                io::check_different(
+                    command.arguments[0],
+                    command.arguments[index],
+                    "The Event Stream input and the .dat outputs must be different files");
+            }
+            auto& session = profile::current();
+            session.input(command.arguments[0]);
+            for (std::size_t index = 1; index < 3; ++index) {
+                if (command.arguments[index] != "none") {
+                    session.output(command.arguments[index]);
+                }
+            }
+            auto input = io::open_event_stream(async::make_prefetch(io::open_stream(command.arguments[0])));
+            const dat::header header{2, input.header.width, input.header.height};
+            switch (input.header.event_stream_type) {
+                case sepia::type::dvs: {
+                    if (command.arguments[1] == "none" || command.arguments[2] != "none") {
+                        throw std::runtime_error(
+                            "DVS Event Stream files do not have aps events, the aps file must be none");
+                    }
+                    auto td_output = open_dat(command.arguments[1]);
+                    {
+                        dat::write_to_reference td_write(*td_output, header);
+                        profile::scope scope("decode");
+                        sepia::join_observable<sepia::type::dvs>(
+                            std::move(input.stream), [&](sepia::dvs_event dvs_event) {
+                                ++session.events_in;
+                                ++session.events_out;
+                                td_write(dvs_event);
+                            });
+                    }
+                    td_output->close();
+                    break;
+                }
+                case sepia::type::atis: {
+                    auto td_output = open_dat(command.arguments[1]);
+                    auto aps_output = open_dat(command.arguments[2]);
+                    {
+                        std::unique_ptr<dat::write_to_reference> td_write;
+                        if (td_output) {
+                            td_write.reset(new dat::write_to_reference(*td_output, header));
+                        }
+                        std::unique_ptr<dat::write_to_reference> aps_write;
+                        if (aps_output) {
+                            aps_write.reset(new dat::write_to_reference(*aps_output, header));
+                        }
+                        profile::scope scope("decode");
+                        sepia::join_observable<sepia::type::atis>(
+                            std::move(input.stream), [&](sepia::atis_event atis_event) {
+                                ++session.events_in;
+                                const sepia::dvs_event dvs_event{
+                                    atis_event.t, atis_event.x, atis_event.y, atis_event.polarity};
+                                if (atis_event.is_threshold_crossing) {
+                                    if (aps_write) {
+                                        ++session.events_out;
+                                        (*aps_write)(dvs_event);
+                                    }
+                                } else if (td_write) {
+                                    ++session.events_out;
+                                    (*td_write)(dvs_event);
+                                }
+                            });
+                    }
+                    if (td_output) {
+                        td_output->close();
+                    }
+                    if (aps_output) {
+                        aps_output->close();
+                    }
+                    break;
+                }
+                default:
+                    throw std::runtime_error("es_to_dat only supports DVS and ATIS Event Stream files");
+            }
+        }));
+}
@@ -0,0 +1,530 @@
+#include "../third_party/lodepng/lodepng.h"
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "../third_party/tarsier/source/stitch.hpp"
+#include "async.hpp"
+#include "frames.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include <cmath>
+#include <functional>
+#include <iomanip>
+
+/// mode enumerates the frame renderers.
+enum class mode {
+    polarity,
+    color,
+    exposure,
+};
+
+/// format enumerates the output formats.
+enum class format {
+    png,
+    y4m,
+    raw,
+};
+
+/// polarity_step is the gray level change caused by a change detection in polarity mode.
+constexpr uint8_t polarity_step = 32;
+
+/// white_delta_t and black_delta_t are the exposure durations (in microseconds) mapped to white and black.
+constexpr double white_delta_t = 1e2;
+constexpr double black_delta_t = 1e5;
+
+/// exposure_measurement represents an exposure measurement as a time delta.
+SEPIA_PACK(struct exposure_measurement {
+    uint64_t t;
+    uint64_t delta_t;
+    uint16_t x;
+    uint16_t y;
+});
+
+/// delta_t_to_exposure maps an exposure duration to a gray level, with a logarithmic scale.
+uint8_t delta_t_to_exposure(uint64_t delta_t) {
+    if (delta_t == 0) {
+        return 255;
+    }
+    const auto exposure = 255.0 * std::log(black_delta_t / static_cast<double>(delta_t))
+                          / std::log(black_delta_t / white_delta_t);
+    return static_cast<uint8_t>(exposure > 255 ? 255 : (exposure < 0 ? 0 : exposure));
+}
+
+/// frame_filename replaces the first '{}' in the pattern with the zero-padded frame index.
+std::string frame_filename(const std::string& pattern, std::size_t index) {
+    std::stringstream stream;
+    stream << std::setfill('0') << std::setw(6) << index;
+    auto filename = pattern;
+    filename.replace(filename.find("{}"), 2, stream.str());
+    return filename;
+}
+
+/// frame_to_y4m converts a frame to a Y4M frame (full-range BT.601 for color frames).
+std::string frame_to_y4m(const std::vector<uint8_t>& frame, std::size_t channels) {
+    std::string bytes("FRAME\n");
+    if (channels == 1) {
+        bytes.append(frame.begin(), frame.end());
+        return bytes;
+    }
+    const auto pixels = frame.size() / 3;
+    bytes.resize(6 + pixels * 3);
+    for (std::size_t index = 0; index < pixels; ++index) {
+        const auto r = static_cast<double>(frame[index * 3]);
+        const auto g = static_cast<double>(frame[index * 3 + 1]);
+        const auto b = static_cast<double>(frame[index * 3 + 2]);
+        const auto clamp = [](double value) -> char {
+            return static_cast<char>(static_cast<uint8_t>(value > 255 ? 255 : (value < 0 ? 0 : value + 0.5)));
+        };
+        bytes[6 + index] = clamp(0.299 * r + 0.587 * g + 0.114 * b);
+        bytes[6 + pixels + index] = clamp(-0.168736 * r - 0.331264 * g + 0.5 * b + 128);
+        bytes[6 + pixels * 2 + index] = clamp(0.5 * r - 0.418688 * g - 0.081312 * b + 128);
+    }
+    return bytes;
+}
+
+/// encoder encodes batches of frames on worker threads (one frame per thread), while the next batch is rendered.
+/// The encoded frames are written in order, and at most two batches are in memory,
+/// hence the memory usage does not depend on the recording's duration.
+class encoder {
+    public:
+    encoder(
+        std::size_t threads,
+        std::function<std::string(const std::vector<uint8_t>&, std::size_t)> encode,
+        std::function<void(const std::string&)> write) :
+        _threads(threads),
+        _encode(std::move(encode)),
+        _write(std::move(write)),
+        _index(0) {}
+    encoder(const encoder&) = delete;
+    encoder(encoder&&) = delete;
+    encoder& operator=(const encoder&) = delete;
+    encoder& operator=(encoder&&) = delete;
+    virtual ~encoder() {
+        if (_worker.joinable()) {
+            _worker.join();
+        }
+    }
+
+    /// push adds a frame to the current batch, and hands the batch over to the workers once it is full.
+    virtual void push(const std::vector<uint8_t>& frame) {
+        _batch.push_back(frame);
+        if (_batch.size() == _threads) {
+            flush();
+        }
+    }
+
+    /// close encodes and writes the pending frames.
+    virtual void close() {
+        flush();
+        wait();
+    }
+
+    protected:
+    /// wait blocks until the previous batch is written, and rethrows its errors.
+    virtual void wait() {
+        if (_worker.joinable()) {
+            _worker.join();
+        }
+        if (_exception) {
+            std::rethrow_exception(_exception);
+        }
+    }
+
+    /// flush hands over the current batch.
+    virtual void flush() {
+        wait();
+        if (_batch.empty()) {
+            return;
+        }
+        _pending.swap(_batch);
+        _batch.clear();
+        const auto first_index = _index;
+        _index += _pending.size();
+        _worker = std::thread([this, first_index]() {
+            try {
+                std::vector<std::string> encoded_frames(_pending.size());
+                async::parallel_for(_pending.size(), [&](std::size_t index) {
+                    encoded_frames[index] = _encode(_pending[index], first_index + index);
+                });
+                for (const auto& encoded_frame : encoded_frames) {
+                    _write(encoded_frame);
+                }
+            } catch (...) {
+                _exception = std::current_exception();
+            }
+        });
+    }
+
+    const std::size_t _threads;
+    std::function<std::string(const std::vector<uint8_t>&, std::size_t)> _encode;
+    std::function<void(const std::string&)> _write;
+    std::size_t _index;
+    std::vector<std::vector<uint8_t>> _batch;
+    std::vector<std::vector<uint8_t>> _pending;
+    std::exception_ptr _exception;
+    std::thread _worker;
+};
+
+/// renderer draws events on a canvas, and sends a copy of the canvas to an encoder at the end of each frame.
+/// Frames either last frametime microseconds (frame n covers [n * frametime, (n + 1) * frametime[),
+/// or contain events_per_frame events.
+class renderer {
+    public:
+    renderer(
+        uint16_t width,
+        uint16_t height,
+        ::mode mode,
+        uint64_t frametime,
+        uint64_t events_per_frame,
+        encoder& frames_encoder) :
+        _width(width),
+        _height(height),
+        _mode(mode),
+        _channels(mode == ::mode::color ? 3 : 1),
+        _background(mode == ::mode::polarity ? 128 : 0),
+        _canvas(static_cast<std::size_t>(width) * height * _channels, _background),
+        _frametime(frametime),
+        _events_per_frame(events_per_frame),
+        _started(false),
+        _frame_index(0),
+        _events(0),
+        _encoder(frames_encoder) {}
+    renderer(const renderer&) = delete;
+    renderer(renderer&&) = delete;
+    renderer& operator=(const renderer&) = delete;
+    renderer& operator=(renderer&&) = delete;
+    virtual ~renderer() {}
+
+    /// draw_polarity handles a change detection.
+    virtual void draw_polarity(uint64_t t, uint16_t x, uint16_t y, bool is_increase) {
+        advance(t);
+        auto& value = _canvas[frames::pixel_index(_width, _height, x, y, 1)];
+        if (is_increase) {
+            value = value > 255 - polarity_step ? 255 : value + polarity_step;
+        } else {
+            value = value < polarity_step ? 0 : value - polarity_step;
+        }
+    }
+
+    /// draw_color handles a color event.
+    virtual void draw_color(sepia::color_event color_event) {
+        advance(color_event.t);
+        const auto index = frames::pixel_index(_width, _height, color_event.x, color_event.y, 3);
+        _canvas[index] = color_event.r;
+        _canvas[index + 1] = color_event.g;
+        _canvas[index + 2] = color_event.b;
+    }
+
+    /// draw_exposure handles an exposure measurement.
+    virtual void draw_exposure(exposure_measurement measurement) {
+        advance(measurement.t);
+        _canvas[frames::pixel_index(_width, _height, measurement.x, measurement.y, 1)] =
+            delta_t_to_exposure(measurement.delta_t);
+    }
+
+    /// close emits the last (possibly partial) frame.
+    virtual void close() {
+        if (_started && (_frametime > 0 || _events > 0)) {
+            emit();
+        }
+    }
+
+    protected:
+    /// advance emits the frames completed before the given timestamp.
+    virtual void advance(uint64_t t) {
+        if (_frametime > 0) {
+            if (!_started) {
+                _started = true;
+                _frame_index = t / _frametime;
+            }
+            for (; t >= (_frame_index + 1) * _frametime; ++_frame_index) {
+                emit();
+            }
+        } else {
+            _started = true;
+            if (_events == _events_per_frame) {
+                emit();
+                _events = 0;
+            }
+            ++_events;
+        }
+    }
+
+    /// emit sends the canvas to the encoder, and clears it in polarity mode.
+    virtual void emit() {
+        _encoder.push(_canvas);
+        if (_mode == ::mode::polarity) {
+            std::fill(_canvas.begin(), _canvas.end(), _background);
+        }
+    }
+
+    const uint16_t _width;
+    const uint16_t _height;
+    const ::mode _mode;
+    const std::size_t _channels;
+    const uint8_t _background;
+    std::vector<uint8_t> _canvas;
+    const uint64_t _frametime;
+    const uint64_t _events_per_frame;
+    bool _started;
+    uint64_t _frame_index;
+    uint64_t _events;
+    encoder& _encoder;
+};
+
+/// render decodes the input and draws its events, generic events cannot be rendered.
+/// The profile's events out count the drawn events: ATIS threshold crossings are only drawn once stitched into
+/// exposure measurements, and not at all in polarity mode.
+template <sepia::type event_stream_type>
+void render(io::event_stream input, ::mode mode, renderer& frames_renderer);
+template <>
+void render<sepia::type::generic>(io::event_stream, ::mode, renderer&) {
+    throw std::runtime_error("generic events are not compatible with this application");
+}
+template <>
+void render<sepia::type::dvs>(io::event_stream input, ::mode mode, renderer& frames_renderer) {
+    if (mode != ::mode::polarity) {
+        throw std::runtime_error("DVS events are only compatible with the polarity mode");
+    }
+    auto& session = profile::current();
+    sepia::join_observable<sepia::type::dvs>(std::move(input.stream), [&](sepia::dvs_event dvs_event) {
+        ++session.events_in;
+        ++session.events_out;
+        frames_renderer.draw_polarity(dvs_event.t, dvs_event.x, dvs_event.y, dvs_event.is_increase);
+    });
+}
+template <>
+void render<sepia::type::atis>(io::event_stream input, ::mode mode, renderer& frames_renderer) {
+    auto& session = profile::current();
+    if (mode == ::mode::polarity) {
+        sepia::join_observable<sepia::type::atis>(std::move(input.stream), [&](sepia::atis_event atis_event) {
+            ++session.events_in;
+            if (!atis_event.is_threshold_crossing) {
+                ++session.events_out;
+                frames_renderer.draw_polarity(atis_event.t, atis_event.x, atis_event.y, atis_event.polarity);
+            }
+        });
+    } else if (mode == ::mode::exposure) {
+        const auto width = input.header.width;
+        const auto height = input.header.height;
+        auto split = sepia::make_split<sepia::type::atis>(
+            [](sepia::dvs_event) {},
+            tarsier::make_stitch<sepia::threshold_crossing, exposure_measurement>(
+                width,
+                height,
+                [](sepia::threshold_crossing threshold_crossing, uint64_t delta_t) -> exposure_measurement {
+                    return {threshold_crossing.t, delta_t, threshold_crossing.x, threshold_crossing.y};
+                },
+                [&](exposure_measurement measurement) {
+                    ++session.events_out;
+                    frames_renderer.draw_exposure(measurement);
+                }));
+        sepia::join_observable<sepia::type::atis>(std::move(input.stream), [&](sepia::atis_event atis_event) {
+            ++session.events_in;
+            split(atis_event);
+        });
+    } else {
+        throw std::runtime_error("ATIS events are only compatible with the polarity and exposure modes");
+    }
+}
+template <>
+void render<sepia::type::color>(io::event_stream input, ::mode mode, renderer& frames_renderer) {
+    if (mode != ::mode::color) {
+        throw std::runtime_error("color events are only compatible with the color mode");
+    }
+    auto& session = profile::current();
+    sepia::join_observable<sepia::type::color>(std::move(input.stream), [&](sepia::color_event color_event) {
+        ++session.events_in;
+        ++session.events_out;
+        frames_renderer.draw_color(color_event);
+    });
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {
+            "es_to_frames renders the events of an Event Stream file as a sequence of frames.",
+            "Syntax: ./es_to_frames [options] /path/to/input.es /path/to/output",
+            "    The output is a pattern such as /path/to/frame_{}.png for the png format,",
+            "    '{}' is replaced with the frame index",
+            "    The string '-' (without quotes) can be used for the standard input, and for the standard output",
+            "    with the y4m and raw formats",
+            "Available options:",
+            "    -f [format], --format [format]          sets the output format, one of:",
+            "                                                'png' writes a PNG file per frame (default)",
+            "                                                'y4m' writes a raw YUV4MPEG2 video",
+            "                                                'raw' writes the frames' bytes one after the other",
+            "    -m [mode], --mode [mode]                sets the renderer, one of:",
+            "                                                'polarity' accumulates change detections",
+            "                                                    (default for DVS and ATIS events)",
+            "                                                'exposure' shows the latest ATIS exposure measurements",
+            "                                                'color' shows the latest color events",
+            "                                                    (default for color events)",
+            "    -t [frametime], --frametime [frametime] sets the frame duration in microseconds",
+            "                                                defaults to 10000",
+            "    -c [events], --count [events]           creates a frame every [events] events instead,",
+            "                                                ignores the frametime",
+            "    -j [threads], --threads [threads]       sets the number of encoding threads",
+            "                                                defaults to the number of hardware threads",
+            "    -p, --profile                           prints a JSON profiling report on the standard error",
+            "    -h, --help                              shows this help message",
+        },
+        argc,
+        argv,
+        2,
+        {
+            {"format", {"f"}},
+            {"mode", {"m"}},
+            {"frametime", {"t"}},
+            {"count", {"c"}},
+            {"threads", {"j"}},
+        },
+        {{"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            auto& session = profile::current();
+            io::check_different(
+                command.arguments[0],
+                command.arguments[1],
+                "The Event Stream input and the output must be different files");
+            auto output_format = format::png;
+            {
+                const auto name_and_argument = command.options.find("format");
+                if (name_and_argument != command.options.end()) {
+                    if (name_and_argument->second == "png") {
+                        output_format = format::png;
+                    } else if (name_and_argument->second == "y4m") {
+                        output_format = format::y4m;
+                    } else if (name_and_argument->second == "raw") {
+                        output_format = format::raw;
+                    } else {
+                        throw std::runtime_error("[format] must be one of png, y4m and raw");
+                    }
+                }
+            }
+            if (output_format == format::png && command.arguments[1].find("{}") == std::string::npos) {
+                throw std::runtime_error("The output pattern must contain '{}' with the png format");
+            }
+            uint64_t frametime = 10000;
+            {
+                const auto name_and_argument = command.options.find("frametime");
+                if (name_and_argument != command.options.end()) {
+                    frametime = std::stoull(name_and_argument->second);
+                    if (frametime == 0) {
+                        throw std::runtime_error("[frametime] must be strictly positive");
+                    }
+                }
+            }
+            uint64_t events_per_frame = 0;
+            {
+                const auto name_and_argument = command.options.find("count");
+                if (name_and_argument != command.options.end()) {
+                    events_per_frame = std::stoull(name_and_argument->second);
+                    if (events_per_frame == 0) {
+                        throw std::runtime_error("[events] must be strictly positive");
+                    }
+                    frametime = 0;
+                }
+            }
+            std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+            {
+                const auto name_and_argument = command.options.find("threads");
+                if (name_and_argument != command.options.end()) {
+                    threads = std::stoull(name_and_argument->second);
+                    if (threads == 0) {
+                        throw std::runtime_error("[threads] must be strictly positive");
+                    }
+                }
+            }
+            session.input(command.arguments[0]);
+            auto input = io::open_event_stream(command.arguments[0]);
+            const auto header = input.header;
+            auto frames_mode = header.event_stream_type == sepia::type::color ? mode::color : mode::polarity;
+            {
+                const auto name_and_argument = command.options.find("mode");
+                if (name_and_argument != command.options.end()) {
+                    if (name_and_argument->second == "polarity") {
+                        frames_mode = mode::polarity;
+                    } else if (name_and_argument->second == "exposure") {
+                        frames_mode = mode::exposure;
+                    } else if (name_and_argument->second == "color") {
+                        frames_mode = mode::color;
+                    } else {
+                        throw std::runtime_error("[mode] must be one of polarity, exposure and color");
+                    }
+                }
+            }
+            const std::size_t channels = frames_mode == mode::color ? 3 : 1;
+
+            // create the encoder
+            std::unique_ptr<std::ostream> output;
+            std::function<std::string(const std::vector<uint8_t>&, std::size_t)> encode;
+            if (output_format == format::png) {
+                encode = [&](const std::vector<uint8_t>& frame, std::size_t index) {
+                    std::vector<uint8_t> png_bytes;
+                    if (lodepng::encode(
+                            png_bytes, frame, header.width, header.height, channels == 3 ? LCT_RGB : LCT_GREY, 8)
+                        != 0) {
+                        throw std::runtime_error("encoding a frame failed");
+                    }
+                    auto png_output = sepia::filename_to_ofstream(frame_filename(command.arguments[1], index));
+                    png_output->write(reinterpret_cast<const char*>(png_bytes.data()), png_bytes.size());
+                    return std::string();
+                };
+            } else {
+                session.output(command.arguments[1]);
+                output = io::open_output(command.arguments[1]);
+                if (output_format == format::y4m) {
+                    *output << "YUV4MPEG2 W" << header.width << " H" << header.height << " F"
+                            << (frametime > 0 ? 1000000 : 25) << ":" << (frametime > 0 ? frametime : 1)
+                            << " Ip A1:1 " << (channels == 3 ? "C444 XCOLORRANGE=FULL" : "Cmono") << "\n";
+                    encode = [&](const std::vector<uint8_t>& frame, std::size_t) {
+                        return frame_to_y4m(frame, channels);
+                    };
+                } else {
+                    encode = [](const std::vector<uint8_t>& frame, std::size_t) {
+                        return std::string(frame.begin(), frame.end());
+                    };
+                }
+            }
+            encoder frames_encoder(threads, encode, [&](const std::string& bytes) {
+                if (output) {
+                    output->write(bytes.data(), bytes.size());
+                }
+            });
+
+            // render the frames
+            renderer frames_renderer(
+                header.width, header.height, frames_mode, frametime, events_per_frame, frames_encoder);
+            {
+                profile::scope scope("decode");
+                switch (header.event_stream_type) {
+                    case sepia::type::generic: {
+                        render<sepia::type::generic>(std::move(input), frames_mode, frames_renderer);
+                        break;
+                    }
+                    case sepia::type::dvs: {
+                        render<sepia::type::dvs>(std::move(input), frames_mode, frames_renderer);
+                        break;
+                    }
+                    case sepia::type::atis: {
+                        render<sepia::type::atis>(std::move(input), frames_mode, frames_renderer);
+                        break;
+                    }
+                    case sepia::type::color: {
+                        render<sepia::type::color>(std::move(input), frames_mode, frames_renderer);
+                        break;
+                    }
+                }
+                frames_renderer.close();
+            }
+            {
+                profile::scope scope("encode");
+                frames_encoder.close();
+            }
+            if (output) {
+                output->flush();
+                if (!output->good()) {
+                    throw std::runtime_error("writing the output failed");
+                }
+            }
+        }));
+}
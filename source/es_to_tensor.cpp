@@ -0,0 +1,247 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include "tensor.hpp"
+#include <iomanip>
+
+/// format enumerates the output formats.
+enum class format {
+    npy,
+    stack,
+};
+
+/// tensor_filename replaces the first '{}' in the pattern with the zero-padded window index.
+std::string tensor_filename(const std::string& pattern, std::size_t index) {
+    std::stringstream stream;
+    stream << std::setfill('0') << std::setw(6) << index;
+    auto filename = pattern;
+    filename.replace(filename.find("{}"), 2, stream.str());
+    return filename;
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {
+            "es_to_tensor converts windows of an Event Stream file into voxel grids or histograms",
+            "Syntax: ./es_to_tensor [options] /path/to/input.es /path/to/output",
+            "    With the npy format, the output is a pattern such as /path/to/window_{}.npy,",
+            "    '{}' is replaced with the window index",
+            "    With the stack format, the output is a single .npy file",
+            "    The string '-' (without quotes) can be used for the standard input",
+            "Available options:",
+            "    -w [duration], --window [duration]                sets the window duration in microseconds",
+            "                                                          defaults to 50000",
+            "    -s [duration], --stride [duration]                sets the time between two windows' beginnings",
+            "                                                          in microseconds, defaults to the window",
+            "                                                          duration",
+            "    -t [timestamp], --begin [timestamp]               sets the beginning of the first window",
+            "                                                          in microseconds, defaults to 0",
+            "    -r [representation], --representation [representation]",
+            "                                                      sets the tensor layout, one of:",
+            "                                                          'voxel' spreads the events over time bins",
+            "                                                              (bins x 2 x height x width, default)",
+            "                                                          'histogram' counts the events per polarity",
+            "                                                              (2 x height x width)",
+            "    -b [bins], --bins [bins]                          sets the number of time bins of voxel grids",
+            "                                                          defaults to 5",
+            "    -d [type], --dtype [type]                         sets the value type, one of:",
+            "                                                          'float32' (default)",
+            "                                                          'float16'",
+            "    -f [format], --format [format]                    sets the output format, one of:",
+            "                                                          'npy' writes a .npy file per window",
+            "                                                              (default)",
+            "                                                          'stack' writes a single .npy file with",
+            "                                                              a leading window dimension",
+            "    -j [threads], --threads [threads]                 sets the number of windows converted in parallel",
+            "                                                          defaults to the number of hardware threads",
+            "    -p, --profile                                     prints a JSON profiling report on the standard",
+            "                                                          error",
+            "    -h, --help                                        shows this help message",
+        },
+        argc,
+        argv,
+        2,
+        {
+            {"window", {"w"}},
+            {"stride", {"s"}},
+            {"begin", {"t"}},
+            {"representation", {"r"}},
+            {"bins", {"b"}},
+            {"dtype", {"d"}},
+            {"format", {"f"}},
+            {"threads", {"j"}},
+        },
+        {{"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            auto& session = profile::current();
+            io::check_different(
+                command.arguments[0],
+                command.arguments[1],
+                "The Event Stream input and the output must be different files");
+            tensor::parameters parameters{0, 0, tensor::representation::voxel_grid, 5, 50000, tensor::dtype::float32};
+            {
+                const auto name_and_argument = command.options.find("window");
+                if (name_and_argument != command.options.end()) {
+                    parameters.duration = std::stoull(name_and_argument->second);
+                    if (parameters.duration == 0) {
+                        throw std::runtime_error("the window duration must be strictly positive");
+                    }
+                }
+            }
+            auto stride = parameters.duration;
+            {
+                const auto name_and_argument = command.options.find("stride");
+                if (name_and_argument != command.options.end()) {
+                    stride = std::stoull(name_and_argument->second);
+                    if (stride == 0) {
+                        throw std::runtime_error("the stride must be strictly positive");
+                    }
+                }
+            }
+            uint64_t begin_t = 0;
+            {
+                const auto name_and_argument = command.options.find("begin");
+                if (name_and_argument != command.options.end()) {
+                    begin_t = std::stoull(name_and_argument->second);
+                }
+            }
+            {
+                const auto name_and_argument = command.options.find("representation");
+                if (name_and_argument != command.options.end()) {
+                    if (name_and_argument->second == "voxel") {
+                        parameters.representation = tensor::representation::voxel_grid;
+                    } else if (name_and_argument->second == "histogram") {
+                        parameters.representation = tensor::representation::histogram;
+                    } else {
+                        throw std::runtime_error("[representation] must be one of voxel and histogram");
+                    }
+                }
+            }
+            {
+                const auto name_and_argument = command.options.find("bins");
+                if (name_and_argument != command.options.end()) {
+                    parameters.bins = std::stoull(name_and_argument->second);
+                    if (parameters.bins == 0) {
+                        throw std::runtime_error("[bins] must be strictly positive");
+                    }
+                }
+            }
+            {
+                const auto name_and_argument = command.options.find("dtype");
+                if (name_and_argument != command.options.end()) {
+                    if (name_and_argument->second == "float32") {
+                        parameters.dtype = tensor::dtype::float32;
+                    } else if (name_and_argument->second == "float16") {
+                        parameters.dtype = tensor::dtype::float16;
+                    } else {
+                        throw std::runtime_error("[type] must be one of float32 and float16");
+                    }
+                }
+            }
+            auto output_format = format::npy;
+            {
+                const auto name_and_argument = command.options.find("format");
+                if (name_and_argument != command.options.end()) {
+                    if (name_and_argument->second == "npy") {
+                        output_format = format::npy;
+                    } else if (name_and_argument->second == "stack") {
+                        output_format = format::stack;
+                    } else {
+                        throw std::runtime_error("[format] must be one of npy and stack");
+                    }
+                }
+            }
+            if (output_format == format::npy && command.arguments[1].find("{}") == std::string::npos) {
+                throw std::runtime_error("The output pattern must contain '{}' with the npy format");
+            }
+            if (output_format == format::stack && io::is_standard(command.arguments[1])) {
+                throw std::runtime_error(
+                    "The stack format cannot be written to the standard output, since its header is rewritten "
+                    "once the number of windows is known");
+            }
+            std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+            {
+                const auto name_and_argument = command.options.find("threads");
+                if (name_and_argument != command.options.end()) {
+                    threads = std::stoull(name_and_argument->second);
+                    if (threads == 0) {
+                        throw std::runtime_error("[threads] must be strictly positive");
+                    }
+                }
+            }
+            session.input(command.arguments[0]);
+            auto input = io::open_event_stream(async::make_prefetch(io::open_stream(command.arguments[0])));
+            parameters.width = input.header.width;
+            parameters.height = input.header.height;
+
+            // create the output
+            std::unique_ptr<std::ofstream> output;
+            std::size_t header_size = 0;
+            auto shape = parameters.shape();
+            if (output_format == format::stack) {
+                session.output(command.arguments[1]);
+                output = sepia::filename_to_ofstream(command.arguments[1]);
+                shape.insert(shape.begin(), std::numeric_limits<uint64_t>::max());
+                header_size = tensor::npy_header(parameters.dtype, shape, 0).size();
+                shape.front() = 0;
+                const auto header = tensor::npy_header(parameters.dtype, shape, header_size);
+                output->write(header.data(), static_cast<std::streamsize>(header.size()));
+            }
+            const auto npy_header = tensor::npy_header(parameters.dtype, parameters.shape(), 0);
+            auto windows = tensor::make_windows(
+                parameters, begin_t, stride, threads, [&](std::size_t index, const std::string& bytes) {
+                    profile::scope scope("write");
+                    if (output) {
+                        output->write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+                        ++shape.front();
+                    } else {
+                        const auto filename = tensor_filename(command.arguments[1], index);
+                        session.output(filename);
+                        auto npy_output = sepia::filename_to_ofstream(filename);
+                        npy_output->write(npy_header.data(), static_cast<std::streamsize>(npy_header.size()));
+                        npy_output->write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+                        if (!npy_output->good()) {
+                            throw std::runtime_error("writing '" + filename + "' failed");
+                        }
+                    }
+                });
+            const auto keep_block = [&](const blocked::zone_map& zone_map) { return zone_map.end_t >= begin_t; };
+            {
+                profile::scope scope("decode");
+                switch (input.header.event_stream_type) {
+                    case sepia::type::dvs:
+                        io::join_observable<sepia::type::dvs>(
+                            std::move(input), keep_block, [&](sepia::dvs_event dvs_event) {
+                                ++session.events_in;
+                                windows(dvs_event);
+                            });
+                        break;
+                    case sepia::type::atis:
+                        io::join_observable<sepia::type::atis>(
+                            std::move(input), keep_block, [&](sepia::atis_event atis_event) {
+                                ++session.events_in;
+                                if (!atis_event.is_threshold_crossing) {
+                                    windows(sepia::dvs_event{
+                                        atis_event.t, atis_event.x, atis_event.y, atis_event.polarity});
+                                }
+                            });
+                        break;
+                    default:
+                        throw std::runtime_error("es_to_tensor only supports DVS and ATIS Event Stream files");
+                }
+                windows.close();
+            }
+            session.events_out += windows.events_out();
+            if (output) {
+                const auto header = tensor::npy_header(parameters.dtype, shape, header_size);
+                output->seekp(0);
+                output->write(header.data(), static_cast<std::streamsize>(header.size()));
+                output->flush();
+                if (!output->good()) {
+                    throw std::runtime_error("writing the output failed");
+                }
+            }
+        }));
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+#include <algorithm>
+#include <sstream>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// evt decodes Prophesee EVT 2.0 and EVT 3.0 raw streams.
+/// A raw file starts with ASCII header lines beginning with '%', followed by a stream of little-endian words
+/// (32-bit words for EVT 2.0, 16-bit words for EVT 3.0). The timestamps are split between time-high words,
+/// which set the most significant bits, and the events (EVT 2.0) or time-low words (EVT 3.0).
+/// Raw files use a top-left origin, hence y is flipped to match the Event Stream's bottom-left origin.
+namespace evt {
+    /// format lists the supported raw formats.
+    enum class format {
+        evt2,
+        evt3,
+    };
+
+    /// header bundles a raw file header's information.
+    struct header {
+        evt::format format;
+        uint16_t width;
+        uint16_t height;
+    };
+
+    /// buffer_size is the number of bytes read at once from the raw stream.
+    constexpr std::size_t buffer_size = 1 << 20;
+
+    /// parse_format converts a format name ('EVT3', '3.0'...) to a format.
+    inline evt::format parse_format(const std::string& name) {
+        if (name == "EVT2" || name == "2.0") {
+            return format::evt2;
+        }
+        if (name == "EVT3" || name == "3.0") {
+            return format::evt3;
+        }
+        throw std::runtime_error("unsupported raw format '" + name + "' (only EVT 2.0 and EVT 3.0 are supported)");
+    }
+
+    /// read_header retrieves header information from a raw file, and leaves the stream after the header.
+    /// Both header styles are supported: '% format EVT3;height=720;width=1280',
+    /// and '% evt 3.0' with '% geometry 1280x720'.
+    inline header read_header(std::istream& stream) {
+        auto has_format = false;
+        header stream_header{format::evt3, 0, 0};
+        while (stream.peek() == '%') {
+            std::string line;
+            std::getline(stream, line);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            std::istringstream line_stream(line.substr(1));
+            std::string key;
+            std::string value;
+            line_stream >> key >> value;
+            if (key == "end") {
+                break;
+            }
+            try {
+                if (key == "format") {
+                    std::istringstream value_stream(value);
+                    std::string field;
+                    std::getline(value_stream, field, ';');
+                    stream_header.format = parse_format(field);
+                    has_format = true;
+                    while (std::getline(value_stream, field, ';')) {
+                        const auto separator = field.find('=');
+                        if (separator == std::string::npos) {
+                            continue;
+                        }
+                        if (field.substr(0, separator) == "width") {
+                            stream_header.width = static_cast<uint16_t>(std::stoul(field.substr(separator + 1)));
+                        } else if (field.substr(0, separator) == "height") {
+                            stream_header.height = static_cast<uint16_t>(std::stoul(field.substr(separator + 1)));
+                        }
+                    }
+                } else if (key == "evt") {
+                    stream_header.format = parse_format(value);
+                    has_format = true;
+                } else if (key == "geometry") {
+                    const auto separator = value.find('x');
+                    if (separator != std::string::npos) {
+                        stream_header.width = static_cast<uint16_t>(std::stoul(value.substr(0, separator)));
+                        stream_header.height = static_cast<uint16_t>(std::stoul(value.substr(separator + 1)));
+                    }
+                }
+            } catch (const std::invalid_argument&) {
+            } catch (const std::out_of_range&) {
+            }
+        }
+        if (!has_format) {
+            throw std::runtime_error("the raw header does not specify the event format");
+        }
+        if (stream_header.width == 0 || stream_header.height == 0) {
+            throw std::runtime_error("the raw header does not specify the sensor size");
+        }
+        return stream_header;
+    }
+
+    /// count_trailing_zeros returns the index of the lowest set bit of a non-zero mask.
+    inline uint32_t count_trailing_zeros(uint32_t mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<uint32_t>(index);
+#else
+        return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+    }
+
+    /// decoder holds the state shared by the EVT 2.0 and EVT 3.0 decoders.
+    /// Events outside the sensor and events older than the previous event are dropped,
+    /// since an Event Stream's timestamps must be monotonic.
+    template <typename HandleEvent>
+    class decoder {
+        public:
+        decoder(header stream_header, HandleEvent handle_event) :
+            _header(stream_header),
+            _previous_t(0),
+            _handle_event(std::move(handle_event)) {}
+        decoder(const decoder&) = default;
+        decoder(decoder&&) = default;
+        decoder& operator=(const decoder&) = default;
+        decoder& operator=(decoder&&) = default;
+        virtual ~decoder() {}
+
+        protected:
+        /// dispatch flips and validates an event, then sends it to the handler.
+        void dispatch(uint64_t t, uint32_t x, uint32_t y, bool is_increase) {
+            if (x < _header.width && y < _header.height && t >= _previous_t) {
+                _previous_t = t;
+                _handle_event(sepia::dvs_event{
+                    t, static_cast<uint16_t>(x), static_cast<uint16_t>(_header.height - 1 - y), is_increase});
+            }
+        }
+
+        const header _header;
+        uint64_t _previous_t;
+        HandleEvent _handle_event;
+    };
+
+    /// evt2_decoder decodes EVT 2.0 words.
+    /// Time-high words carry the bits [6, 34[ of the timestamp, and events carry the bits [0, 6[.
+    template <typename HandleEvent>
+    class evt2_decoder : public decoder<HandleEvent> {
+        public:
+        /// word_size is the size of an EVT 2.0 word in bytes.
+        static constexpr std::size_t word_size = 4;
+
+        evt2_decoder(header stream_header, HandleEvent handle_event) :
+            decoder<HandleEvent>(stream_header, std::move(handle_event)),
+            _time_high(0),
+            _overflows(0) {}
+        evt2_decoder(const evt2_decoder&) = default;
+        evt2_decoder(evt2_decoder&&) = default;
+        evt2_decoder& operator=(const evt2_decoder&) = default;
+        evt2_decoder& operator=(evt2_decoder&&) = default;
+        virtual ~evt2_decoder() {}
+
+        /// operator() decodes a buffer and returns the number of bytes consumed (a multiple of word_size).
+        virtual std::size_t operator()(const uint8_t* bytes, std::size_t size) {
+            std::size_t index = 0;
+            for (; index + word_size <= size; index += word_size) {
+                const auto word = static_cast<uint32_t>(bytes[index]) | (static_cast<uint32_t>(bytes[index + 1]) << 8)
+                                  | (static_cast<uint32_t>(bytes[index + 2]) << 16)
+                                  | (static_cast<uint32_t>(bytes[index + 3]) << 24);
+                switch (word >> 28) {
+                    case 0x0:
+                    case 0x1:
+                        this->dispatch(
+                            ((_overflows + _time_high) << 6) | ((word >> 22) & 0x3f),
+                            (word >> 11) & 0x7ff,
+                            word & 0x7ff,
+                            (word >> 28) == 0x1);
+                        break;
+                    case 0x8: {
+                        const uint64_t time_high = word & 0xfffffff;
+                        if (time_high < _time_high) {
+                            _overflows += 1ull << 28;
+                        }
+                        _time_high = time_high;
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+            return index;
+        }
+
+        protected:
+        uint64_t _time_high;
+        uint64_t _overflows;
+    };
+
+    /// evt3_decoder decodes EVT 3.0 words.
+    /// The decoder tracks the current y, timestamp, and vector base (x and polarity).
+    /// Vector words hold a mask of 12 or 8 consecutive pixels starting at the base,
+    /// which is expanded with one bit scan per event instead of a loop over every bit.
+    template <typename HandleEvent>
+    class evt3_decoder : public decoder<HandleEvent> {
+        public:
+        /// word_size is the size of an EVT 3.0 word in bytes.
+        static constexpr std::size_t word_size = 2;
+
+        evt3_decoder(header stream_header, HandleEvent handle_event) :
+            decoder<HandleEvent>(stream_header, std::move(handle_event)),
+            _y(0),
+            _base_x(0),
+            _polarity(false),
+            _time_high(0),
+            _overflows(0),
+            _t(0) {}
+        evt3_decoder(const evt3_decoder&) = default;
+        evt3_decoder(evt3_decoder&&) = default;
+        evt3_decoder& operator=(const evt3_decoder&) = default;
+        evt3_decoder& operator=(evt3_decoder&&) = default;
+        virtual ~evt3_decoder() {}
+
+        /// operator() decodes a buffer and returns the number of bytes consumed (a multiple of word_size).
+        virtual std::size_t operator()(const uint8_t* bytes, std::size_t size) {
+            std::size_t index = 0;
+            for (; index + word_size <= size; index += word_size) {
+                const auto word = static_cast<uint32_t>(bytes[index]) | (static_cast<uint32_t>(bytes[index + 1]) << 8);
+                switch (word >> 12) {
+                    case 0x0:
+                        _y = word & 0x7ff;
+                        break;
+                    case 0x2:
+                        this->dispatch(_t, word & 0x7ff, _y, ((word >> 11) & 1) == 1);
+                        break;
+                    case 0x3:
+                        _base_x = word & 0x7ff;
+                        _polarity = ((word >> 11) & 1) == 1;
+                        break;
+                    case 0x4:
+                        expand(word & 0xfff, 12);
+                        break;
+                    case 0x5:
+                        expand(word & 0xff, 8);
+                        break;
+                    case 0x6:
+                        _t = ((_overflows + _time_high) << 12) | (word & 0xfff);
+                        break;
+                    case 0x8: {
+                        const uint64_t time_high = word & 0xfff;
+                        if (time_high < _time_high) {
+                            _overflows += 1ull << 12;
+                        }
+                        _time_high = time_high;
+                        _t = (_overflows + _time_high) << 12;
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+            return index;
+        }
+
+        protected:
+        /// expand dispatches the events of a vector word, and moves the base to the next group of pixels.
+        void expand(uint32_t mask, uint32_t count) {
+            for (; mask != 0; mask &= mask - 1) {
+                this->dispatch(_t, _base_x + count_trailing_zeros(mask), _y, _polarity);
+            }
+            _base_x += count;
+        }
+
+        uint32_t _y;
+        uint32_t _base_x;
+        bool _polarity;
+        uint64_t _time_high;
+        uint64_t _overflows;
+        uint64_t _t;
+    };
+
+    /// decode reads a stream in blocks and hands them over to a decoder.
+    /// A partial word at the end of a block (possible with pipes) is carried over to the next block.
+    template <typename Decoder>
+    inline void decode(std::istream& stream, Decoder& decoder) {
+        std::vector<uint8_t> buffer(buffer_size);
+        std::size_t remainder = 0;
+        for (;;) {
+            const auto count = stream.rdbuf()->sgetn(
+                reinterpret_cast<char*>(buffer.data() + remainder),
+                static_cast<std::streamsize>(buffer.size() - remainder));
+            if (count <= 0) {
+                break;
+            }
+            const auto size = remainder + static_cast<std::size_t>(count);
+            const auto consumed = decoder(buffer.data(), size);
+            std::copy(buffer.begin() + consumed, buffer.begin() + size, buffer.begin());
+            remainder = size - consumed;
+        }
+    }
+
+    /// observable dispatches DVS events from a raw stream.
+    /// The header must be read from the stream before calling this function.
+    template <typename HandleEvent>
+    inline void observable(std::istream& stream, header stream_header, HandleEvent handle_event) {
+        switch (stream_header.format) {
+            case format::evt2: {
+                evt2_decoder<HandleEvent> decoder(stream_header, std::move(handle_event));
+                decode(stream, decoder);
+                break;
+            }
+            case format::evt3: {
+                evt3_decoder<HandleEvent> decoder(stream_header, std::move(handle_event));
+                decode(stream, decoder);
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+#include <algorithm>
+
+/// filters implements streaming noise filters.
+/// The filters store per-pixel state in flat arrays (row-major, one cell per pixel),
+/// and are composed at compile time so that a chain of filters inlines into the decoder's loop.
+/// A filter created with a zero parameter propagates every event, at the cost of a predictable branch.
+namespace filters {
+    /// is_filtered returns true if an event is subject to the time-based filters.
+    /// ATIS threshold crossings are always propagated, since removing them would break exposure measurements.
+    template <typename Event>
+    inline bool is_filtered(const Event&) {
+        return true;
+    }
+    template <>
+    inline bool is_filtered<sepia::atis_event>(const sepia::atis_event& atis_event) {
+        return !atis_event.is_threshold_crossing;
+    }
+
+    /// background_activity propagates only the events which have a neighbour in space and time.
+    /// Each event writes its expiration timestamp (t + duration) to the eight neighbouring cells,
+    /// and passes if its own cell has not expired yet.
+    /// The array has a one-pixel border, hence there are no bounds checks.
+    template <typename Event, typename HandleEvent>
+    class background_activity {
+        public:
+        background_activity(uint16_t width, uint16_t height, uint64_t duration, HandleEvent handle_event) :
+            _stride(static_cast<std::size_t>(width) + 2),
+            _duration(duration),
+            _ts(duration > 0 ? _stride * (static_cast<std::size_t>(height) + 2) : 0, 0),
+            _handle_event(std::move(handle_event)) {}
+        background_activity(const background_activity&) = default;
+        background_activity(background_activity&&) = default;
+        background_activity& operator=(const background_activity&) = default;
+        background_activity& operator=(background_activity&&) = default;
+        virtual ~background_activity() {}
+
+        /// operator() handles an event.
+        virtual void operator()(Event event) {
+            if (_duration == 0 || !is_filtered(event)) {
+                _handle_event(event);
+                return;
+            }
+            const auto index = (static_cast<std::size_t>(event.y) + 1) * _stride + event.x + 1;
+            const auto t = event.t + _duration;
+            const auto is_supported = _ts[index] > event.t;
+            _ts[index - _stride - 1] = t;
+            _ts[index - _stride] = t;
+            _ts[index - _stride + 1] = t;
+            _ts[index - 1] = t;
+            _ts[index + 1] = t;
+            _ts[index + _stride - 1] = t;
+            _ts[index + _stride] = t;
+            _ts[index + _stride + 1] = t;
+            if (is_supported) {
+                _handle_event(event);
+            }
+        }
+
+        protected:
+        std::size_t _stride;
+        uint64_t _duration;
+        std::vector<uint64_t> _ts;
+        HandleEvent _handle_event;
+    };
+
+    /// make_background_activity creates a background activity filter from a duration and a handler.
+    template <typename Event, typename HandleEvent>
+    inline background_activity<Event, HandleEvent>
+    make_background_activity(uint16_t width, uint16_t height, uint64_t duration, HandleEvent handle_event) {
+        return background_activity<Event, HandleEvent>(width, height, duration, std::move(handle_event));
+    }
+
+    /// refractory propagates an event only if the previous propagated event from the same pixel
+    /// is at least period microseconds older.
+    template <typename Event, typename HandleEvent>
+    class refractory {
+        public:
+        refractory(uint16_t width, uint16_t height, uint64_t period, HandleEvent handle_event) :
+            _width(width),
+            _period(period),
+            _ts(period > 0 ? static_cast<std::size_t>(width) * height : 0, 0),
+            _handle_event(std::move(handle_event)) {}
+        refractory(const refractory&) = default;
+        refractory(refractory&&) = default;
+        refractory& operator=(const refractory&) = default;
+        refractory& operator=(refractory&&) = default;
+        virtual ~refractory() {}
+
+        /// operator() handles an event.
+        virtual void operator()(Event event) {
+            if (_period == 0 || !is_filtered(event)) {
+                _handle_event(event);
+                return;
+            }
+            auto& t = _ts[static_cast<std::size_t>(event.x) + static_cast<std::size_t>(event.y) * _width];
+            if (t <= event.t) {
+                t = event.t + _period;
+                _handle_event(event);
+            }
+        }
+
+        protected:
+        std::size_t _width;
+        uint64_t _period;
+        std::vector<uint64_t> _ts;
+        HandleEvent _handle_event;
+    };
+
+    /// make_refractory creates a refractory filter from a period and a handler.
+    template <typename Event, typename HandleEvent>
+    inline refractory<Event, HandleEvent>
+    make_refractory(uint16_t width, uint16_t height, uint64_t period, HandleEvent handle_event) {
+        return refractory<Event, HandleEvent>(width, height, period, std::move(handle_event));
+    }
+
+    /// hot_pixel removes the filtered events (see is_filtered) from the pixels flagged by a mask
+    /// (one byte per pixel, row-major). An empty mask propagates every event.
+    template <typename Event, typename HandleEvent>
+    class hot_pixel {
+        public:
+        hot_pixel(uint16_t width, std::vector<uint8_t> mask, HandleEvent handle_event) :
+            _width(width),
+            _mask(std::move(mask)),
+            _handle_event(std::move(handle_event)) {}
+        hot_pixel(const hot_pixel&) = default;
+        hot_pixel(hot_pixel&&) = default;
+        hot_pixel& operator=(const hot_pixel&) = default;
+        hot_pixel& operator=(hot_pixel&&) = default;
+        virtual ~hot_pixel() {}
+
+        /// operator() handles an event.
+        virtual void operator()(Event event) {
+            if (_mask.empty() || !is_filtered(event)
+                || _mask[static_cast<std::size_t>(event.x) + static_cast<std::size_t>(event.y) * _width] == 0) {
+                _handle_event(event);
+            }
+        }
+
+        protected:
+        std::size_t _width;
+        std::vector<uint8_t> _mask;
+        HandleEvent _handle_event;
+    };
+
+    /// make_hot_pixel creates a hot pixel filter from a mask and a handler.
+    template <typename Event, typename HandleEvent>
+    inline hot_pixel<Event, HandleEvent>
+    make_hot_pixel(uint16_t width, std::vector<uint8_t> mask, HandleEvent handle_event) {
+        return hot_pixel<Event, HandleEvent>(width, std::move(mask), std::move(handle_event));
+    }
+
+    /// rates_to_mask flags the pixels whose event rate (in events per second) exceeds the threshold.
+    inline std::vector<uint8_t>
+    rates_to_mask(const std::vector<uint64_t>& counts, uint64_t duration, double threshold) {
+        std::vector<uint8_t> mask(counts.size(), 0);
+        const auto seconds = std::max(static_cast<double>(duration), 1.0) / 1e6;
+        for (std::size_t index = 0; index < counts.size(); ++index) {
+            if (static_cast<double>(counts[index]) / seconds > threshold) {
+                mask[index] = 1;
+            }
+        }
+        return mask;
+    }
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "io.hpp"
+#include <array>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/// follow reads Event Stream files which are still being written (for example by a recorder).
+/// The end of the file is treated as a pause rather than the end of the stream: the reader waits for the file
+/// to grow (with inotify on Linux, by polling elsewhere), and stops when the file has not grown for a given idle
+/// duration, or on SIGINT and SIGTERM.
+/// Bytes are decoded as soon as they are read, one at a time, hence a partially written trailing event stays in
+/// the decoder's state until its remaining bytes arrive, and is never dispatched truncated.
+namespace follow {
+    /// chunk_size is the maximum number of bytes read at once.
+    constexpr std::size_t chunk_size = 1 << 16;
+
+    /// poll_interval is the maximum duration of a wait, which bounds the latency of the stop signals
+    /// (and of the file changes on platforms without inotify).
+    constexpr std::chrono::milliseconds poll_interval(50);
+
+    /// stopped returns the flag set by SIGINT and SIGTERM once handle_signals has been called.
+    inline volatile std::sig_atomic_t& stopped() {
+        static volatile std::sig_atomic_t value = 0;
+        return value;
+    }
+
+    /// handle_signal requests the readers to stop.
+    inline void handle_signal(int) {
+        stopped() = 1;
+    }
+
+    /// handle_signals stops the readers on SIGINT and SIGTERM, so that tools write complete outputs when interrupted.
+    inline void handle_signals() {
+        std::signal(SIGINT, handle_signal);
+        std::signal(SIGTERM, handle_signal);
+    }
+
+    /// file reads a file which is still being written.
+    class file {
+        public:
+        file(const std::string& filename, std::chrono::milliseconds idle) :
+            _filename(filename),
+            _stream(sepia::filename_to_ifstream(filename)),
+            _idle(idle),
+            _last_growth(std::chrono::steady_clock::now()),
+            _offset(0),
+            _ended(false) {
+#ifdef __linux__
+            _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (_inotify >= 0 && inotify_add_watch(_inotify, filename.c_str(), IN_MODIFY) < 0) {
+                close(_inotify);
+                _inotify = -1;
+            }
+#endif
+        }
+        file(const file&) = delete;
+        file(file&&) = delete;
+        file& operator=(const file&) = delete;
+        file& operator=(file&&) = delete;
+        virtual ~file() {
+#ifdef __linux__
+            if (_inotify >= 0) {
+                close(_inotify);
+            }
+#endif
+        }
+
+        /// read copies up to size bytes, and waits for the file to grow if it has no unread bytes.
+        /// It returns 0 if no bytes were written before the deadline, or if the reader stopped (see ended).
+        virtual std::size_t read(uint8_t* bytes, std::size_t size, std::chrono::steady_clock::time_point deadline) {
+            for (;;) {
+                const auto count =
+                    _stream->rdbuf()->sgetn(reinterpret_cast<char*>(bytes), static_cast<std::streamsize>(size));
+                if (count > 0) {
+                    _offset += static_cast<uint64_t>(count);
+                    _last_growth = std::chrono::steady_clock::now();
+                    return static_cast<std::size_t>(count);
+                }
+                struct stat status;
+                if (stat(_filename.c_str(), &status) == 0 && static_cast<uint64_t>(status.st_size) < _offset) {
+                    throw std::runtime_error("'" + _filename + "' was truncated while being followed");
+                }
+                const auto now = std::chrono::steady_clock::now();
+                if (stopped() != 0 || (_idle.count() > 0 && now - _last_growth >= _idle)) {
+                    _ended = true;
+                    return 0;
+                }
+                if (now >= deadline) {
+                    return 0;
+                }
+                // the durations are rounded up, so that the deadlines have passed when wait returns on timeout
+                using std::chrono::milliseconds;
+                auto timeout =
+                    std::min(poll_interval, std::chrono::duration_cast<milliseconds>(deadline - now) + milliseconds(1));
+                if (_idle.count() > 0) {
+                    timeout = std::min(
+                        timeout,
+                        std::chrono::duration_cast<milliseconds>(_last_growth + _idle - now) + milliseconds(1));
+                }
+                wait(timeout);
+            }
+        }
+
+        /// ended returns true once the file has been idle for too long, or a stop signal was received.
+        virtual bool ended() const {
+            return _ended;
+        }
+
+        /// offset returns the number of bytes read.
+        virtual uint64_t offset() const {
+            return _offset;
+        }
+
+        protected:
+        /// wait returns when the file is modified, a signal is received or the timeout expires.
+        virtual void wait(std::chrono::milliseconds timeout) {
+#ifdef __linux__
+            if (_inotify >= 0) {
+                pollfd descriptor{_inotify, POLLIN, 0};
+                if (poll(&descriptor, 1, static_cast<int>(timeout.count())) > 0) {
+                    std::array<char, 4096> events;
+                    while (::read(_inotify, events.data(), events.size()) > 0) {
+                    }
+                }
+                return;
+            }
+#endif
+            std::this_thread::sleep_for(timeout);
+        }
+
+        const std::string _filename;
+        std::unique_ptr<std::ifstream> _stream;
+        const std::chrono::milliseconds _idle;
+        std::chrono::steady_clock::time_point _last_growth;
+        uint64_t _offset;
+        bool _ended;
+#ifdef __linux__
+        int _inotify;
+#endif
+    };
+
+    /// event_stream bundles an Event Stream header and a followed file positioned after the header.
+    struct event_stream {
+        sepia::header header;
+        std::unique_ptr<follow::file> file;
+    };
+
+    /// open_event_stream opens a file which is still being written, and waits for its header.
+    /// Blocked containers are not supported, since their blocks are only written once full.
+    inline event_stream open_event_stream(const std::string& filename, std::chrono::milliseconds idle) {
+        std::unique_ptr<follow::file> input(new follow::file(filename, idle));
+        std::vector<uint8_t> bytes;
+        const auto read_exactly = [&](std::size_t size) {
+            while (bytes.size() < size) {
+                std::array<uint8_t, 20> buffer;
+                const auto count =
+                    input->read(buffer.data(), size - bytes.size(), std::chrono::steady_clock::now() + poll_interval);
+                if (input->ended()) {
+                    throw std::runtime_error("'" + filename + "' does not contain a complete header");
+                }
+                bytes.insert(bytes.end(), buffer.begin(), std::next(buffer.begin(), count));
+            }
+        };
+        // the header has 16 bytes (signature, version and type), followed by the sensor size for non-generic types
+        read_exactly(16);
+        if (std::equal(bytes.begin(), bytes.end(), blocked::signature.begin())) {
+            throw std::runtime_error("--follow does not support blocked Event Streams");
+        }
+        if (std::string(bytes.begin(), std::next(bytes.begin(), 12)) == "Event Stream"
+            && static_cast<sepia::type>(bytes[15]) != sepia::type::generic) {
+            read_exactly(20);
+        }
+        std::istringstream header_stream(std::string(bytes.begin(), bytes.end()));
+        return {sepia::read_header(header_stream), std::move(input)};
+    }
+
+    /// join_observable dispatches the events of a followed file until it ends, see file::ended.
+    /// handle_tick is called every interval (whether or not events were dispatched) and once more before returning,
+    /// which lets tools report running values and flush their outputs.
+    /// handle_event can throw sepia::end_of_file to stop reading.
+    template <sepia::type event_stream_type, typename HandleEvent, typename HandleTick>
+    inline void join_observable(
+        event_stream input,
+        std::chrono::milliseconds interval,
+        HandleEvent&& handle_event,
+        HandleTick&& handle_tick) {
+        sepia::handle_byte<event_stream_type> handle_byte(input.header.width, input.header.height);
+        sepia::event<event_stream_type> event;
+        std::vector<uint8_t> bytes(chunk_size);
+        auto next_tick = std::chrono::steady_clock::now() + interval;
+        try {
+            while (!input.file->ended()) {
+                const auto size = input.file->read(bytes.data(), bytes.size(), next_tick);
+                for (std::size_t index = 0; index < size; ++index) {
+                    if (handle_byte(bytes[index], event)) {
+                        handle_event(event);
+                    }
+                }
+                const auto now = std::chrono::steady_clock::now();
+                if (now >= next_tick) {
+                    handle_tick();
+                    next_tick = now + interval;
+                }
+            }
+        } catch (const sepia::end_of_file&) {
+        }
+        handle_tick();
+    }
+
+    /// observe dispatches the events of a plain or blocked Event Stream, see io::join_observable.
+    /// It has the same signature as the overload for followed files, so that tools can handle both inputs with
+    /// the same code. handle_tick is not called.
+    template <sepia::type event_stream_type, typename KeepBlock, typename HandleEvent, typename HandleTick>
+    inline void observe(io::event_stream input, KeepBlock keep_block, HandleEvent&& handle_event, HandleTick&&) {
+        io::join_observable<event_stream_type>(
+            std::move(input), std::move(keep_block), std::forward<HandleEvent>(handle_event));
+    }
+
+    /// observe dispatches the events of a followed file, and calls handle_tick every poll_interval.
+    /// keep_block is not called, since followed files are not blocked.
+    template <sepia::type event_stream_type, typename KeepBlock, typename HandleEvent, typename HandleTick>
+    inline void observe(event_stream input, KeepBlock, HandleEvent&& handle_event, HandleTick&& handle_tick) {
+        join_observable<event_stream_type>(
+            std::move(input),
+            poll_interval,
+            std::forward<HandleEvent>(handle_event),
+            std::forward<HandleTick>(handle_tick));
+    }
+
+    /// parse_milliseconds reads a duration option in milliseconds, and returns the default value if it is absent.
+    inline std::chrono::milliseconds
+    parse_milliseconds(const pontella::command& command, const std::string& name, std::chrono::milliseconds value) {
+        const auto name_and_argument = command.options.find(name);
+        if (name_and_argument != command.options.end()) {
+            value = std::chrono::milliseconds(std::stoull(name_and_argument->second));
+        }
+        return value;
+    }
+}
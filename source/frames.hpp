@@ -0,0 +1,101 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+
+namespace frames {
+    /// pixel_index returns the index of a pixel's first channel in a frame with interleaved channels.
+    /// The frame's origin is the top-left corner, whereas the event's origin is the bottom-left corner.
+    inline std::size_t pixel_index(uint16_t width, uint16_t height, uint16_t x, uint16_t y, std::size_t channels) {
+        return (static_cast<std::size_t>(x) + static_cast<std::size_t>(width) * (height - 1 - y)) * channels;
+    }
+
+    /// set_pixel writes a color event to an RGBA frame.
+    inline void
+    set_pixel(std::vector<uint8_t>& frame, uint16_t width, uint16_t height, sepia::color_event color_event) {
+        const auto index = pixel_index(width, height, color_event.x, color_event.y, 4);
+        frame[index] = color_event.r;
+        frame[index + 1] = color_event.g;
+        frame[index + 2] = color_event.b;
+        frame[index + 3] = 255;
+    }
+
+    /// generator accumulates color events into RGBA frames, starting from the base frame.
+    /// A new frame is started every frametime microseconds, and each frame is passed to the handler
+    /// once complete, hence only one frame is held in memory.
+    template <typename HandleFrame>
+    class generator {
+        public:
+        generator(
+            std::vector<uint8_t> base_frame,
+            uint16_t width,
+            uint16_t height,
+            uint64_t begin_t,
+            uint64_t end_t,
+            uint64_t frametime,
+            HandleFrame handle_frame) :
+            _frame(std::move(base_frame)),
+            _width(width),
+            _height(height),
+            _begin_t(begin_t),
+            _end_t(end_t),
+            _frametime(frametime),
+            _handle_frame(std::move(handle_frame)),
+            _frames(1),
+            _done(frametime == 0) {}
+        generator(const generator&) = delete;
+        generator(generator&&) = default;
+        generator& operator=(const generator&) = delete;
+        generator& operator=(generator&&) = default;
+        virtual ~generator() {}
+
+        /// operator() handles a color event.
+        virtual void operator()(sepia::color_event color_event) {
+            if (_done) {
+                return;
+            }
+            if (color_event.t - _begin_t > _frametime * (_frames - 1)) {
+                if (_frametime * _frames >= _end_t) {
+                    _done = true;
+                    return;
+                }
+                _handle_frame(static_cast<const std::vector<uint8_t>&>(_frame));
+                ++_frames;
+            }
+            set_pixel(_frame, _width, _height, color_event);
+        }
+
+        /// close passes the last frame to the handler.
+        virtual void close() {
+            if (_frametime > 0) {
+                _handle_frame(static_cast<const std::vector<uint8_t>&>(_frame));
+                _frametime = 0;
+                _done = true;
+            }
+        }
+
+        protected:
+        std::vector<uint8_t> _frame;
+        const uint16_t _width;
+        const uint16_t _height;
+        const uint64_t _begin_t;
+        const uint64_t _end_t;
+        uint64_t _frametime;
+        HandleFrame _handle_frame;
+        uint64_t _frames;
+        bool _done;
+    };
+
+    /// make_generator creates a frame generator from a handler.
+    template <typename HandleFrame>
+    inline generator<HandleFrame> make_generator(
+        std::vector<uint8_t> base_frame,
+        uint16_t width,
+        uint16_t height,
+        uint64_t begin_t,
+        uint64_t end_t,
+        uint64_t frametime,
+        HandleFrame handle_frame) {
+        return generator<HandleFrame>(
+            std::move(base_frame), width, height, begin_t, end_t, frametime, std::move(handle_frame));
+    }
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "cpu.hpp"
+#include <algorithm>
+#include <array>
 #include <cctype>
 #include <fstream>
 #include <functional>
@@ -10,47 +13,198 @@
 #include <vector>
 
 namespace html {
+    /// base64_character returns the base64 character of a 6-bit value.
+    /// The offsets are selected with sign masks ((threshold - value) >> 8 is -1 if value > threshold, 0 otherwise)
+    /// rather than a table lookup or comparisons, which compilers turn into branches.
+    CPU_INLINE uint8_t base64_character(uint32_t value) {
+        const auto signed_value = static_cast<int32_t>(value);
+        return static_cast<uint8_t>(
+            signed_value + 65 + (((25 - signed_value) >> 8) & 6) - (((51 - signed_value) >> 8) & 75)
+            - (((61 - signed_value) >> 8) & 15) + (((62 - signed_value) >> 8) & 3));
+    }
+
+    /// encode_base64_kernel encodes groups of three bytes into groups of four base64 characters.
+    /// The loop has no table lookup and no branch, which lets the compiler process several groups per instruction.
+    CPU_INLINE void encode_base64_kernel(const uint8_t* bytes, std::size_t groups, char* characters) {
+        auto output = reinterpret_cast<uint8_t*>(characters);
+        for (std::size_t index = 0; index < groups; ++index) {
+            const uint32_t first = bytes[index * 3];
+            const uint32_t second = bytes[index * 3 + 1];
+            const uint32_t third = bytes[index * 3 + 2];
+            output[index * 4] = base64_character(first >> 2);
+            output[index * 4 + 1] = base64_character(((first & 3) << 4) | (second >> 4));
+            output[index * 4 + 2] = base64_character(((second & 15) << 2) | (third >> 6));
+            output[index * 4 + 3] = base64_character(third & 63);
+        }
+    }
+
+    /// encode_base64_* are the instruction set variants of encode_base64_kernel.
+    inline void encode_base64_scalar(const uint8_t* bytes, std::size_t groups, char* characters) {
+        encode_base64_kernel(bytes, groups, characters);
+    }
+    CPU_TARGET("sse4.2")
+    inline void encode_base64_sse42(const uint8_t* bytes, std::size_t groups, char* characters) {
+        encode_base64_kernel(bytes, groups, characters);
+    }
+    CPU_TARGET("avx2")
+    inline void encode_base64_avx2(const uint8_t* bytes, std::size_t groups, char* characters) {
+        encode_base64_kernel(bytes, groups, characters);
+    }
+    CPU_TARGET("avx512f,avx512bw,avx512vl")
+    inline void encode_base64_avx512(const uint8_t* bytes, std::size_t groups, char* characters) {
+        encode_base64_kernel(bytes, groups, characters);
+    }
+
+    /// encode_base64 encodes groups of three bytes with the variant of the selected CPU level.
+    /// The characters array must hold groups * 4 characters.
+    inline void encode_base64(const uint8_t* bytes, std::size_t groups, char* characters) {
+        switch (cpu::selected()) {
+            case cpu::level::scalar:
+                encode_base64_scalar(bytes, groups, characters);
+                break;
+            case cpu::level::sse42:
+                encode_base64_sse42(bytes, groups, characters);
+                break;
+            case cpu::level::avx2:
+                encode_base64_avx2(bytes, groups, characters);
+                break;
+            case cpu::level::avx512:
+                encode_base64_avx512(bytes, groups, characters);
+                break;
+        }
+    }
+
     /// bytes_to_encoded_characters converts bytes to a URL-encoded string.
     /// It is equivalent to JavaScript's btoa function.
     inline std::string bytes_to_encoded_characters(const std::vector<uint8_t>& bytes) {
-        std::string output;
-        output.reserve(bytes.size() * 4);
+        const auto groups = bytes.size() / 3;
+        std::string output(((bytes.size() + 2) / 3) * 4, '=');
+        encode_base64(bytes.data(), groups, &output[0]);
         const std::string characters("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
-        std::size_t data = 0;
-        auto length = bytes.size();
-        for (; length > 2; length -= 3) {
-            data =
-                ((static_cast<std::size_t>(bytes[bytes.size() - length]) << 16)
-                 | (static_cast<std::size_t>(bytes[bytes.size() - length + 1]) << 8)
-                 | bytes[bytes.size() - length + 2]);
-            output.push_back(characters[(data & (63 << 18)) >> 18]);
-            output.push_back(characters[(data & (63 << 12)) >> 12]);
-            output.push_back(characters[(data & (63 << 6)) >> 6]);
-            output.push_back(characters[data & 63]);
-        }
-        if (length == 2) {
-            data = (static_cast<std::size_t>(bytes[bytes.size() - length]) << 16)
-                   | (static_cast<std::size_t>(bytes[bytes.size() - length + 1]) << 8);
-            output.push_back(characters[(data & (63 << 18)) >> 18]);
-            output.push_back(characters[(data & (63 << 12)) >> 12]);
-            output.push_back(characters[(data & (63 << 6)) >> 6]);
-            output.push_back('=');
-        } else if (length == 1) {
-            data = (static_cast<std::size_t>(bytes[bytes.size() - length]) << 16);
-            output.push_back(characters[(data & (63 << 18)) >> 18]);
-            output.push_back(characters[(data & (63 << 12)) >> 12]);
-            output.push_back('=');
-            output.push_back('=');
+        const auto length = bytes.size() - groups * 3;
+        if (length > 0) {
+            const auto data = (static_cast<std::size_t>(bytes[groups * 3]) << 16)
+                              | (length == 2 ? static_cast<std::size_t>(bytes[groups * 3 + 1]) << 8 : 0);
+            output[groups * 4] = characters[(data >> 18) & 63];
+            output[groups * 4 + 1] = characters[(data >> 12) & 63];
+            if (length == 2) {
+                output[groups * 4 + 2] = characters[(data >> 6) & 63];
+            }
         }
         return output;
     }
 
-    /// variable stores either text or a boolean.
+    /// base64_streambuf encodes the bytes written to it in base64, and writes the characters to another stream.
+    /// The first skip bytes are discarded, which lets a writer's header be dropped without buffering.
+    class base64_streambuf : public std::streambuf {
+        public:
+        base64_streambuf(std::ostream& target, std::size_t skip) : _target(target), _skip(skip), _size(0) {}
+        base64_streambuf(const base64_streambuf&) = delete;
+        base64_streambuf(base64_streambuf&&) = delete;
+        base64_streambuf& operator=(const base64_streambuf&) = delete;
+        base64_streambuf& operator=(base64_streambuf&&) = delete;
+        virtual ~base64_streambuf() {}
+
+        /// close writes the last characters and the padding.
+        virtual void close() {
+            if (_size == 0) {
+                return;
+            }
+            const auto data = (static_cast<std::size_t>(_bytes[0]) << 16)
+                              | (_size == 2 ? static_cast<std::size_t>(_bytes[1]) << 8 : 0);
+            std::array<char, 4> characters{{
+                encode((data >> 18) & 63),
+                encode((data >> 12) & 63),
+                _size == 2 ? encode((data >> 6) & 63) : '=',
+                '=',
+            }};
+            _target.write(characters.data(), characters.size());
+            _size = 0;
+        }
+
+        protected:
+        /// encode returns the base64 character of a 6-bit value.
+        static char encode(std::size_t value) {
+            return "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[value];
+        }
+
+        /// overflow encodes a single byte.
+        virtual int_type overflow(int_type character) override {
+            if (traits_type::eq_int_type(character, traits_type::eof())) {
+                return traits_type::not_eof(character);
+            }
+            const auto byte = traits_type::to_char_type(character);
+            xsputn(&byte, 1);
+            return character;
+        }
+
+        /// xsputn encodes bytes in groups of three, and keeps the remaining bytes for the next call.
+        /// The pending bytes are completed first, then the complete groups are encoded with encode_base64.
+        virtual std::streamsize xsputn(const char* bytes, std::streamsize count) override {
+            const auto skipped = std::min(static_cast<std::size_t>(count), _skip);
+            _skip -= skipped;
+            auto begin = reinterpret_cast<const uint8_t*>(bytes) + skipped;
+            const auto end = reinterpret_cast<const uint8_t*>(bytes) + count;
+            for (; _size > 0 && _size < 3 && begin != end; ++begin) {
+                _bytes[_size] = *begin;
+                ++_size;
+            }
+            const auto groups = static_cast<std::size_t>(end - begin) / 3;
+            _characters.resize(((_size == 3 ? 1 : 0) + groups) * 4);
+            if (_size == 3) {
+                encode_base64(_bytes.data(), 1, &_characters[0]);
+                _size = 0;
+            }
+            encode_base64(begin, groups, &_characters[_characters.size() - groups * 4]);
+            for (begin += groups * 3; begin != end; ++begin) {
+                _bytes[_size] = *begin;
+                ++_size;
+            }
+            _target.write(_characters.data(), static_cast<std::streamsize>(_characters.size()));
+            return count;
+        }
+
+        std::ostream& _target;
+        std::size_t _skip;
+        std::array<uint8_t, 3> _bytes;
+        std::size_t _size;
+        std::string _characters;
+    };
+
+    /// base64_ostream is an output stream encoding its bytes in base64, see base64_streambuf.
+    class base64_ostream : public std::ostream {
+        public:
+        base64_ostream(std::ostream& target, std::size_t skip = 0) :
+            std::ostream(nullptr),
+            _streambuf(target, skip) {
+            rdbuf(&_streambuf);
+        }
+        base64_ostream(const base64_ostream&) = delete;
+        base64_ostream(base64_ostream&&) = delete;
+        base64_ostream& operator=(const base64_ostream&) = delete;
+        base64_ostream& operator=(base64_ostream&&) = delete;
+        virtual ~base64_ostream() {}
+
+        /// close forwards to the stream buffer, see base64_streambuf::close.
+        virtual void close() {
+            _streambuf.close();
+        }
+
+        protected:
+        base64_streambuf _streambuf;
+    };
+
+    /// variable stores either text, a boolean, or a function which writes text directly to the output.
+    /// The latter lets large payloads be generated while rendering, instead of being held in memory.
     class variable {
         public:
         variable(bool boolean) : _boolean(boolean), _is_boolean(true) {}
         variable(const char* text) : _boolean(false), _text(text), _is_boolean(false) {}
         variable(const std::string& text) : _boolean(false), _text(text), _is_boolean(false) {}
+        variable(std::function<void(std::ostream&)> write) :
+            _boolean(false),
+            _is_boolean(false),
+            _write(std::move(write)) {}
         variable(const variable&) = default;
         variable(variable&&) = default;
         variable& operator=(const variable&) = default;
@@ -78,10 +232,20 @@ namespace html {
             return _is_boolean;
         }
 
+        /// write writes a text variable to a stream.
+        virtual void write(std::ostream& output) const {
+            if (_write) {
+                _write(output);
+            } else {
+                output << to_text();
+            }
+        }
+
         protected:
         bool _boolean;
         std::string _text;
         bool _is_boolean;
+        std::function<void(std::ostream&)> _write;
     };
 
     /// node represents a part of an HTML template.
@@ -456,7 +620,7 @@ namespace html {
                 if (name_and_variable->second.is_boolean()) {
                     throw std::logic_error("a boolean is assigned to the text variable '" + node->name + "'");
                 }
-                output << name_and_variable->second.to_text();
+                name_and_variable->second.write(output);
             } else if (const auto node = dynamic_cast<const conditional_node*>(generic_node.get())) {
                 const auto name_and_variable = name_to_variable.find(node->name);
                 if (name_and_variable == name_to_variable.end()) {
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+#include "blocked.hpp"
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace io {
+    /// replay_streambuf reads from another stream buffer, and records the bytes read until stop_recording is called.
+    /// While recording, the stream can be rewinded to its beginning, even if the source is a pipe.
+    /// This lets a tool parse a header from the standard input, then hand the whole stream to sepia.
+    class replay_streambuf : public std::streambuf {
+        public:
+        replay_streambuf(std::streambuf* source) : _source(source), _recording(true) {
+            setg(nullptr, nullptr, nullptr);
+        }
+        replay_streambuf(const replay_streambuf&) = delete;
+        replay_streambuf(replay_streambuf&&) = delete;
+        replay_streambuf& operator=(const replay_streambuf&) = delete;
+        replay_streambuf& operator=(replay_streambuf&&) = delete;
+        virtual ~replay_streambuf() {}
+
+        /// stop_recording releases the source once the recorded bytes have been replayed.
+        /// The stream cannot be rewinded afterwards.
+        virtual void stop_recording() {
+            _recording = false;
+        }
+
+        protected:
+        /// underflow reads a byte from the source, and records it if needed.
+        virtual int_type underflow() override {
+            if (gptr() < egptr()) {
+                return traits_type::to_int_type(*gptr());
+            }
+            if (_recording) {
+                const auto character = _source->sbumpc();
+                if (traits_type::eq_int_type(character, traits_type::eof())) {
+                    return character;
+                }
+                _recorded.push_back(traits_type::to_char_type(character));
+                setg(&_recorded.front(), &_recorded.back(), &_recorded.back() + 1);
+                return character;
+            }
+            return _source->sgetc();
+        }
+
+        /// uflow reads and consumes a byte.
+        virtual int_type uflow() override {
+            if (gptr() == egptr() && !_recording) {
+                return _source->sbumpc();
+            }
+            const auto character = underflow();
+            if (!traits_type::eq_int_type(character, traits_type::eof())) {
+                gbump(1);
+            }
+            return character;
+        }
+
+        /// xsgetn reads the remaining recorded bytes, then forwards bulk reads to the source.
+        virtual std::streamsize xsgetn(char_type* characters, std::streamsize count) override {
+            if (_recording) {
+                return std::streambuf::xsgetn(characters, count);
+            }
+            const auto replayed = std::min(count, static_cast<std::streamsize>(egptr() - gptr()));
+            if (replayed > 0) {
+                std::memcpy(characters, gptr(), static_cast<std::size_t>(replayed));
+                gbump(static_cast<int>(replayed));
+            }
+            if (replayed == count) {
+                return replayed;
+            }
+            return replayed + _source->sgetn(characters + replayed, count - replayed);
+        }
+
+        /// seekoff supports tellg, rewinding while recording, and forward seeks once recording has stopped.
+        virtual pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+            override {
+            if (offset == 0 && direction == std::ios_base::cur) {
+                if (_recording) {
+                    return pos_type(static_cast<off_type>(gptr() - eback()));
+                }
+                const auto position = _source->pubseekoff(0, std::ios_base::cur, mode);
+                if (position == pos_type(off_type(-1))) {
+                    return position;
+                }
+                return position - static_cast<off_type>(egptr() - gptr());
+            }
+            if (offset > 0 && direction == std::ios_base::cur && !_recording) {
+                const auto remaining = static_cast<off_type>(egptr() - gptr());
+                if (offset < remaining) {
+                    gbump(static_cast<int>(offset));
+                    return seekoff(0, std::ios_base::cur, mode);
+                }
+                const auto position = _source->pubseekoff(offset - remaining, std::ios_base::cur, mode);
+                if (position != pos_type(off_type(-1))) {
+                    setg(eback(), egptr(), egptr());
+                }
+                return position;
+            }
+            if (offset == 0 && direction == std::ios_base::beg) {
+                return seekpos(pos_type(0), mode);
+            }
+            return pos_type(off_type(-1));
+        }
+
+        /// seekpos rewinds the stream to its beginning while recording.
+        virtual pos_type seekpos(pos_type position, std::ios_base::openmode) override {
+            if (!_recording || position != pos_type(0)) {
+                return pos_type(off_type(-1));
+            }
+            if (!_recorded.empty()) {
+                setg(&_recorded.front(), &_recorded.front(), &_recorded.back() + 1);
+            }
+            return position;
+        }
+
+        std::streambuf* _source;
+        bool _recording;
+        std::vector<char> _recorded;
+    };
+
+    /// replay_istream is an input stream reading from another stream through a replay_streambuf.
+    class replay_istream : public std::istream {
+        public:
+        replay_istream(std::unique_ptr<std::istream> source) :
+            std::istream(nullptr),
+            _source(std::move(source)),
+            _streambuf(_source->rdbuf()) {
+            rdbuf(&_streambuf);
+        }
+        replay_istream(const replay_istream&) = delete;
+        replay_istream(replay_istream&&) = delete;
+        replay_istream& operator=(const replay_istream&) = delete;
+        replay_istream& operator=(replay_istream&&) = delete;
+        virtual ~replay_istream() {}
+
+        /// stop_recording forwards to the stream buffer, see replay_streambuf::stop_recording.
+        virtual void stop_recording() {
+            _streambuf.stop_recording();
+        }
+
+        protected:
+        std::unique_ptr<std::istream> _source;
+        replay_streambuf _streambuf;
+    };
+
+    /// stdout_ostream writes to the standard output, and flushes it on destruction.
+    class stdout_ostream : public std::ostream {
+        public:
+        stdout_ostream() : std::ostream(std::cout.rdbuf()) {}
+        stdout_ostream(const stdout_ostream&) = delete;
+        stdout_ostream(stdout_ostream&&) = delete;
+        stdout_ostream& operator=(const stdout_ostream&) = delete;
+        stdout_ostream& operator=(stdout_ostream&&) = delete;
+        virtual ~stdout_ostream() {
+            flush();
+        }
+    };
+
+    /// is_standard returns true if the filename designates the standard input or output.
+    inline bool is_standard(const std::string& filename) {
+        return filename == "-";
+    }
+
+    /// open_stream opens a file, or the standard input if the filename is "-".
+    inline std::unique_ptr<std::istream> open_stream(const std::string& filename) {
+        if (is_standard(filename)) {
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            return std::unique_ptr<std::istream>(new std::istream(std::cin.rdbuf()));
+        }
+        return sepia::filename_to_ifstream(filename);
+    }
+
+    /// open_input opens a file, or the standard input if the filename is "-".
+    /// The returned stream records its bytes until stop_recording is called.
+    inline std::unique_ptr<replay_istream> open_input(const std::string& filename) {
+        return std::unique_ptr<replay_istream>(new replay_istream(open_stream(filename)));
+    }
+
+    /// open_output opens a file, or the standard output if the filename is "-".
+    inline std::unique_ptr<std::ostream> open_output(const std::string& filename) {
+        if (is_standard(filename)) {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            return std::unique_ptr<std::ostream>(new stdout_ostream());
+        }
+        return sepia::filename_to_ofstream(filename);
+    }
+
+    /// event_stream bundles an Event Stream header and a stream positioned before the header.
+    struct event_stream {
+        sepia::header header;
+        std::unique_ptr<std::istream> stream;
+
+        /// is_blocked is true if the stream reads a blocked container (see blocked.hpp) instead of a plain stream.
+        bool is_blocked;
+    };
+
+    /// open_event_stream reads an Event Stream header from a stream.
+    /// The header is read once from the returned stream, which is rewinded so that it can be passed as is
+    /// to sepia::join_observable.
+    /// Blocked containers are presented as plain Event Streams, unless keep_blocks is true.
+    inline event_stream open_event_stream(std::unique_ptr<std::istream> source, bool keep_blocks = false) {
+        std::unique_ptr<replay_istream> stream(new replay_istream(std::move(source)));
+        const auto is_blocked = blocked::has_signature(*stream);
+        stream->clear();
+        stream->seekg(0);
+        if (is_blocked) {
+            if (keep_blocks) {
+                std::istringstream header_stream(blocked::read_header(*stream));
+                const auto header = sepia::read_header(header_stream);
+                stream->seekg(0);
+                stream->stop_recording();
+                return {header, std::move(stream), true};
+            }
+            stream->stop_recording();
+            stream.reset(
+                new replay_istream(std::unique_ptr<std::istream>(new blocked::plain_istream(std::move(stream)))));
+        }
+        const auto header = sepia::read_header(*stream);
+        stream->seekg(0);
+        stream->stop_recording();
+        return {header, std::move(stream), false};
+    }
+
+    /// open_event_stream opens an Event Stream file (or the standard input) and reads its header.
+    inline event_stream open_event_stream(const std::string& filename, bool keep_blocks = false) {
+        return open_event_stream(open_stream(filename), keep_blocks);
+    }
+
+    /// join_observable dispatches the events of a plain or blocked Event Stream.
+    /// The blocks for which keep_block returns false are skipped without being decoded,
+    /// keep_block is ignored for plain Event Streams.
+    template <sepia::type event_stream_type, typename KeepBlock, typename HandleEvent>
+    inline void join_observable(event_stream input, KeepBlock keep_block, HandleEvent&& handle_event) {
+        if (input.is_blocked) {
+            blocked::join_observable<event_stream_type>(
+                std::move(input.stream), std::move(keep_block), std::forward<HandleEvent>(handle_event));
+        } else {
+            sepia::join_observable<event_stream_type>(std::move(input.stream), std::forward<HandleEvent>(handle_event));
+        }
+    }
+
+    /// check_different throws if an input and an output designate the same file.
+    /// Reading from the standard input and writing to the standard output is allowed.
+    inline void check_different(const std::string& input, const std::string& output, const std::string& message) {
+        if (input == output && !is_standard(input)) {
+            throw std::runtime_error(message);
+        }
+    }
+
+    /// create_directory creates a directory if it does not exist yet (its parent must exist).
+    inline void create_directory(const std::string& path) {
+        struct stat status;
+        if (stat(path.c_str(), &status) == 0) {
+            if ((status.st_mode & S_IFMT) != S_IFDIR) {
+                throw std::runtime_error("'" + path + "' exists and is not a directory");
+            }
+            return;
+        }
+#ifdef _WIN32
+        const auto result = _mkdir(path.c_str());
+#else
+        const auto result = mkdir(path.c_str(), 0755);
+#endif
+        if (result != 0) {
+            throw std::runtime_error("the directory '" + path + "' could not be created");
+        }
+    }
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "async.hpp"
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// merkle implements a chunk-parallel content hash.
+/// A byte stream is split into fixed-size chunks hashed independently (the leaves),
+/// and the leaves are combined pairwise into a binary tree whose root fingerprints the stream.
+/// Chunks can be hashed on all cores, a sub-range can be verified against stored leaves,
+/// and appending to a file only changes the leaves after the last complete chunk.
+/// The hash is a non-cryptographic 128-bit hash with four independent 64-bit lanes (in the spirit of xxHash),
+/// which the compiler can interleave or vectorize. It is specific to this project.
+namespace merkle {
+    /// chunk_size is the number of bytes per leaf.
+    constexpr std::size_t chunk_size = 1 << 20;
+
+    /// digest is a 128-bit hash, with the same layout as tarsier's hashes (low bits first).
+    typedef std::pair<uint64_t, uint64_t> digest;
+
+    constexpr uint64_t prime_0 = 0x9e3779b185ebca87ull;
+    constexpr uint64_t prime_1 = 0xc2b2ae3d27d4eb4full;
+    constexpr uint64_t prime_2 = 0x165667b19e3779f9ull;
+    constexpr uint64_t prime_3 = 0x85ebca77c2b2ae63ull;
+
+    /// leaf_seed and node_seed separate the leaves' domain from the internal nodes' domain.
+    constexpr uint64_t leaf_seed = 0;
+    constexpr uint64_t node_seed = 1;
+
+    /// rotate_left rotates the bits of a 64-bit word.
+    inline uint64_t rotate_left(uint64_t value, int shift) {
+        return (value << shift) | (value >> (64 - shift));
+    }
+
+    /// read_word reads a little-endian 64-bit word.
+    inline uint64_t read_word(const uint8_t* bytes) {
+        return static_cast<uint64_t>(bytes[0]) | (static_cast<uint64_t>(bytes[1]) << 8)
+               | (static_cast<uint64_t>(bytes[2]) << 16) | (static_cast<uint64_t>(bytes[3]) << 24)
+               | (static_cast<uint64_t>(bytes[4]) << 32) | (static_cast<uint64_t>(bytes[5]) << 40)
+               | (static_cast<uint64_t>(bytes[6]) << 48) | (static_cast<uint64_t>(bytes[7]) << 56);
+    }
+
+    /// avalanche mixes the bits of a 64-bit word.
+    inline uint64_t avalanche(uint64_t value) {
+        value ^= value >> 33;
+        value *= prime_1;
+        value ^= value >> 29;
+        value *= prime_2;
+        value ^= value >> 32;
+        return value;
+    }
+
+    /// hash calculates the 128-bit hash of a byte array.
+    /// Each lane consumes one 64-bit word per 32-byte stripe, and the last partial stripe is zero-padded.
+    inline digest hash(const uint8_t* bytes, std::size_t size, uint64_t seed) {
+        std::array<uint64_t, 4> lanes{{seed + prime_0 + prime_1, seed + prime_1, seed, seed - prime_0}};
+        const auto stripe = [&](const uint8_t* stripe_bytes) {
+            for (std::size_t lane = 0; lane < 4; ++lane) {
+                lanes[lane] = rotate_left(lanes[lane] + read_word(stripe_bytes + lane * 8) * prime_1, 31) * prime_0;
+            }
+        };
+        std::size_t offset = 0;
+        for (; offset + 32 <= size; offset += 32) {
+            stripe(bytes + offset);
+        }
+        if (offset < size) {
+            std::array<uint8_t, 32> last_stripe{};
+            std::copy(bytes + offset, bytes + size, last_stripe.begin());
+            stripe(last_stripe.data());
+        }
+        const auto low = avalanche(
+            (rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12)
+             + rotate_left(lanes[3], 18))
+            ^ (static_cast<uint64_t>(size) * prime_3));
+        const auto high = avalanche(
+            (lanes[0] ^ rotate_left(lanes[1], 17) ^ rotate_left(lanes[2], 29) ^ rotate_left(lanes[3], 43)) + low
+            + static_cast<uint64_t>(size) * prime_2);
+        return {low, high};
+    }
+
+    /// combine calculates the hash of an internal node.
+    inline digest combine(digest left, digest right) {
+        std::array<uint8_t, 32> bytes;
+        const std::array<uint64_t, 4> words{{left.first, left.second, right.first, right.second}};
+        for (std::size_t index = 0; index < 32; ++index) {
+            bytes[index] = static_cast<uint8_t>(words[index / 8] >> ((index % 8) * 8));
+        }
+        return hash(bytes.data(), bytes.size(), node_seed);
+    }
+
+    /// root combines leaves into the tree's root, a level's last node is promoted if it has no sibling.
+    /// The root of an empty stream is the hash of zero bytes.
+    inline digest root(std::vector<digest> nodes) {
+        if (nodes.empty()) {
+            return hash(nullptr, 0, leaf_seed);
+        }
+        while (nodes.size() > 1) {
+            std::vector<digest> parents;
+            parents.reserve((nodes.size() + 1) / 2);
+            for (std::size_t index = 0; index + 1 < nodes.size(); index += 2) {
+                parents.push_back(combine(nodes[index], nodes[index + 1]));
+            }
+            if (nodes.size() % 2 == 1) {
+                parents.push_back(nodes.back());
+            }
+            nodes.swap(parents);
+        }
+        return nodes.front();
+    }
+
+    /// hash_chunks reads up to maximum_size bytes from a stream, and appends the hashes of their chunks to leaves.
+    /// The last chunk is partial if the stream ends or maximum_size is reached before its end, hence a chunk which
+    /// was partial when the leaves were written can be hashed again by passing the size they describe.
+    /// Batches of chunks are read on the calling thread and hashed in parallel, one chunk per thread.
+    /// The function returns the number of bytes read.
+    inline uint64_t
+    hash_chunks(std::istream& stream, std::size_t threads, uint64_t maximum_size, std::vector<digest>& leaves) {
+        uint64_t size = 0;
+        std::vector<std::vector<uint8_t>> chunks(threads, std::vector<uint8_t>(chunk_size));
+        std::vector<digest> batch_leaves(threads);
+        while (size < maximum_size) {
+            std::size_t batch_size = 0;
+            auto end_of_stream = false;
+            for (; batch_size < threads && size < maximum_size && !end_of_stream; ++batch_size) {
+                auto& chunk = chunks[batch_size];
+                const auto expected_count =
+                    static_cast<std::size_t>(std::min(static_cast<uint64_t>(chunk_size), maximum_size - size));
+                chunk.resize(expected_count);
+                const auto count = stream.rdbuf()->sgetn(
+                    reinterpret_cast<char*>(chunk.data()), static_cast<std::streamsize>(expected_count));
+                if (count <= 0) {
+                    end_of_stream = true;
+                    break;
+                }
+                chunk.resize(static_cast<std::size_t>(count));
+                size += static_cast<uint64_t>(count);
+                end_of_stream = chunk.size() < expected_count;
+            }
+            async::parallel_for(batch_size, [&](std::size_t index) {
+                batch_leaves[index] = hash(chunks[index].data(), chunks[index].size(), leaf_seed);
+            });
+            leaves.insert(leaves.end(), batch_leaves.begin(), batch_leaves.begin() + batch_size);
+            if (end_of_stream || batch_size == 0) {
+                break;
+            }
+        }
+        return size;
+    }
+
+    /// digest_to_hex converts a digest to 32 hexadecimal digits (high bits first).
+    inline std::string digest_to_hex(digest value) {
+        std::stringstream stream;
+        stream << std::hex << std::setfill('0') << std::setw(16) << value.second << std::setw(16) << value.first;
+        return stream.str();
+    }
+
+    /// hex_to_digest parses 32 hexadecimal digits.
+    inline digest hex_to_digest(const std::string& hex) {
+        if (hex.size() != 32) {
+            throw std::runtime_error("a leaf hash must have 32 hexadecimal digits");
+        }
+        return {std::stoull(hex.substr(16, 16), nullptr, 16), std::stoull(hex.substr(0, 16), nullptr, 16)};
+    }
+
+    /// write_leaves writes a leaves file: the stream's size on the first line, then one leaf per line.
+    inline void write_leaves(const std::string& filename, uint64_t size, const std::vector<digest>& leaves) {
+        std::ofstream output(filename);
+        if (!output.good()) {
+            throw std::runtime_error("'" + filename + "' could not be open for writing");
+        }
+        output << size << "\n";
+        for (const auto& leaf : leaves) {
+            output << digest_to_hex(leaf) << "\n";
+        }
+        if (!output.good()) {
+            throw std::runtime_error("writing '" + filename + "' failed");
+        }
+    }
+
+    /// read_leaves reads a leaves file, and returns false if the file does not exist.
+    inline bool read_leaves(const std::string& filename, uint64_t& size, std::vector<digest>& leaves) {
+        std::ifstream input(filename);
+        if (!input.good()) {
+            return false;
+        }
+        if (!(input >> size)) {
+            throw std::runtime_error("'" + filename + "' is not a leaves file");
+        }
+        leaves.clear();
+        for (std::string hex; input >> hex;) {
+            leaves.push_back(hex_to_digest(hex));
+        }
+        if (leaves.size() != (size + chunk_size - 1) / chunk_size) {
+            throw std::runtime_error("'" + filename + "' does not have the expected number of leaves");
+        }
+        return true;
+    }
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include "../third_party/pontella/source/pontella.hpp"
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#endif
+
+namespace profile {
+    /// sampling_mask determines the sampling period of sampled stages (one call out of sampling_mask + 1).
+    constexpr uint64_t sampling_mask = (1 << 10) - 1;
+
+    /// stage accumulates the wall time spent in a part of a tool.
+    /// Sampled stages only time a fraction of their calls, and their duration is extrapolated.
+    struct stage {
+        std::string name;
+        double duration;
+        uint64_t calls;
+        uint64_t samples;
+
+        /// estimated_duration returns the measured duration, extrapolated to all the calls for sampled stages.
+        double estimated_duration() const {
+            if (samples == 0) {
+                return duration;
+            }
+            return duration * static_cast<double>(calls) / static_cast<double>(samples);
+        }
+    };
+
+    /// peak_rss returns the peak resident set size in bytes.
+    inline uint64_t peak_rss() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return static_cast<uint64_t>(counters.PeakWorkingSetSize);
+        }
+        return 0;
+#else
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    /// file_size returns the size of a file in bytes, or 0 if the file cannot be read.
+    inline uint64_t file_size(const std::string& filename) {
+        std::ifstream stream(filename, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+        if (!stream.good()) {
+            return 0;
+        }
+        return static_cast<uint64_t>(stream.tellg());
+    }
+
+    /// session gathers the profiling information of a tool run.
+    class session {
+        public:
+        session() :
+            enabled(false),
+            events_in(0),
+            events_out(0),
+            clock_overhead(0.0),
+            _begin(std::chrono::steady_clock::now()) {}
+        session(const session&) = delete;
+        session(session&&) = delete;
+        session& operator=(const session&) = delete;
+        session& operator=(session&&) = delete;
+        virtual ~session() {}
+
+        /// enabled is true if the tool was called with the profile flag.
+        bool enabled;
+
+        /// events_in counts the events read by the tool.
+        uint64_t events_in;
+
+        /// events_out counts the events written by the tool.
+        uint64_t events_out;
+
+        /// clock_overhead is the duration (in seconds) of a clock read, subtracted from sampled measurements.
+        double clock_overhead;
+
+        /// start calibrates the clock overhead and resets the session clock.
+        virtual void start() {
+            clock_overhead = std::numeric_limits<double>::infinity();
+            for (std::size_t index = 0; index < 64; ++index) {
+                const auto begin = std::chrono::steady_clock::now();
+                const auto overhead =
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                if (overhead < clock_overhead) {
+                    clock_overhead = overhead;
+                }
+            }
+            _begin = std::chrono::steady_clock::now();
+        }
+
+        /// find_stage returns the stage with the given name, and creates it if needed.
+        /// The returned reference stays valid for the session's lifetime.
+        virtual profile::stage& find_stage(const std::string& name) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto& stage : _stages) {
+                if (stage.name == name) {
+                    return stage;
+                }
+            }
+            _stages.push_back({name, 0.0, 0, 0});
+            return _stages.back();
+        }
+
+        /// record adds a scope's duration to a stage.
+        /// Scopes can be used on several threads, in which case the stage's duration is the sum of the threads' times.
+        virtual void record(profile::stage& stage, double duration) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            stage.duration += duration;
+            ++stage.calls;
+        }
+
+        /// record_sample adds a sampled call's duration to a stage, the sample stands for sampling_mask + 1 calls.
+        /// Sampled stages and scopes can share a stage, and be used on several threads.
+        virtual void record_sample(profile::stage& stage, double duration) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            stage.duration += duration;
+            stage.calls += sampling_mask + 1;
+            ++stage.samples;
+        }
+
+        /// input registers a file read by the tool.
+        virtual void input(const std::string& filename) {
+            _inputs.push_back(filename);
+        }
+
+        /// output registers a file written by the tool.
+        virtual void output(const std::string& filename) {
+            _outputs.push_back(filename);
+        }
+
+        /// property adds a tool-specific value (a JSON literal) to the report.
+        virtual void property(const std::string& name, const std::string& value) {
+            _properties.emplace_back(name, value);
+        }
+
+        /// to_json returns the profiling report.
+        /// The throughput is calculated from the input events, or from the output events for generators.
+        /// File sizes are read when the report is generated, after the tool has closed its files.
+        /// The stages are read under the session's lock, since worker threads may still record samples.
+        virtual std::string to_json() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            const auto duration =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - _begin).count();
+            uint64_t bytes_read = 0;
+            for (const auto& filename : _inputs) {
+                bytes_read += file_size(filename);
+            }
+            uint64_t bytes_written = 0;
+            for (const auto& filename : _outputs) {
+                bytes_written += file_size(filename);
+            }
+            std::stringstream stream;
+            stream << std::fixed << std::setprecision(6) << "{\n    \"duration\": " << duration
+                   << ",\n    \"stages\": [";
+            for (auto stage_iterator = _stages.begin(); stage_iterator != _stages.end(); ++stage_iterator) {
+                stream << (stage_iterator == _stages.begin() ? "\n" : ",\n") << "        {\"name\": \""
+                       << stage_iterator->name << "\", \"duration\": " << stage_iterator->estimated_duration()
+                       << ", \"sampled\": " << (stage_iterator->samples > 0 ? "true" : "false") << "}";
+            }
+            const auto events = events_in > 0 ? events_in : events_out;
+            stream << (_stages.empty() ? "]" : "\n    ]") << ",\n    \"bytes_read\": " << bytes_read
+                   << ",\n    \"bytes_written\": " << bytes_written << ",\n    \"events_in\": " << events_in
+                   << ",\n    \"events_out\": " << events_out << ",\n    \"events_per_second\": "
+                   << (duration > 0 ? events / duration : 0.0) << ",\n    \"peak_rss\": " << peak_rss();
+            for (const auto& name_and_value : _properties) {
+                stream << ",\n    \"" << name_and_value.first << "\": " << name_and_value.second;
+            }
+            stream << "\n}";
+            return stream.str();
+        }
+
+        protected:
+        std::chrono::steady_clock::time_point _begin;
+        std::deque<profile::stage> _stages;
+        mutable std::mutex _mutex;
+        std::vector<std::string> _inputs;
+        std::vector<std::string> _outputs;
+        std::vector<std::pair<std::string, std::string>> _properties;
+    };
+
+    /// current returns the process-wide profiling session.
+    inline session& current() {
+        static session global_session;
+        return global_session;
+    }
+
+    /// scope measures the wall time between its construction and its destruction.
+    /// It is meant for coarse stages (whole passes, frames...), not for individual events.
+    class scope {
+        public:
+        scope(const std::string& name) :
+            _stage(current().enabled ? &current().find_stage(name) : nullptr),
+            _begin(std::chrono::steady_clock::now()) {}
+        scope(const scope&) = delete;
+        scope(scope&&) = delete;
+        scope& operator=(const scope&) = delete;
+        scope& operator=(scope&&) = delete;
+        virtual ~scope() {
+            if (_stage) {
+                current().record(
+                    *_stage, std::chrono::duration<double>(std::chrono::steady_clock::now() - _begin).count());
+            }
+        }
+
+        protected:
+        profile::stage* _stage;
+        const std::chrono::steady_clock::time_point _begin;
+    };
+
+    /// sampled wraps an event handler and times one call out of sampling_mask + 1.
+    /// Its overhead is a counter increment per event (samples are recorded under the session's lock,
+    /// once every sampling_mask + 1 calls), hence it can wrap per-event stages such as hashes.
+    /// The duration of a sampled stage is included in the duration of the enclosing scope.
+    template <typename Event, typename HandleEvent>
+    class sampled {
+        public:
+        sampled(const std::string& name, HandleEvent handle_event) :
+            _stage(current().enabled ? &current().find_stage(name) : nullptr),
+            _handle_event(std::move(handle_event)),
+            _count(0) {}
+        sampled(const sampled&) = default;
+        sampled(sampled&&) = default;
+        sampled& operator=(const sampled&) = default;
+        sampled& operator=(sampled&&) = default;
+        virtual ~sampled() {}
+
+        /// operator() handles an event.
+        void operator()(Event event) {
+            if (_stage && (++_count & sampling_mask) == 0) {
+                const auto begin = std::chrono::steady_clock::now();
+                _handle_event(event);
+                const auto duration =
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count()
+                    - current().clock_overhead;
+                current().record_sample(*_stage, duration > 0.0 ? duration : 0.0);
+            } else {
+                _handle_event(event);
+            }
+        }
+
+        protected:
+        profile::stage* _stage;
+        HandleEvent _handle_event;
+        uint64_t _count;
+    };
+
+    /// make_sampled creates a sampled stage from a handler.
+    template <typename Event, typename HandleEvent>
+    inline sampled<Event, HandleEvent> make_sampled(const std::string& name, HandleEvent handle_event) {
+        return sampled<Event, HandleEvent>(name, std::move(handle_event));
+    }
+
+    /// wrap enables profiling if the command has the profile flag, calls the handler,
+    /// and prints the profiling report on the standard error once the handler returns.
+    template <typename HandleCommand>
+    inline std::function<void(pontella::command)> wrap(HandleCommand handle_command) {
+        return [=](pontella::command command) {
+            auto& session = current();
+            session.enabled = command.flags.find("profile") != command.flags.end();
+            session.start();
+            handle_command(std::move(command));
+            if (session.enabled) {
+                std::cerr << session.to_json() << std::endl;
+            }
+        };
+    }
+}
@@ -2,8 +2,12 @@
 #include "../third_party/pontella/source/pontella.hpp"
 #include "../third_party/sepia/source/sepia.hpp"
 #include "../third_party/tarsier/source/stitch.hpp"
+#include "async.hpp"
+#include "frames.hpp"
 #include "html.hpp"
-#include <numeric>
+#include "io.hpp"
+#include "merkle.hpp"
+#include "profile.hpp"
 
 /// exposure_measurement represents an exposure measurement as a time delta.
 SEPIA_PACK(struct exposure_measurement {
@@ -19,10 +23,756 @@ std::string filename_to_string(const std::string& filename) {
     return std::string(std::istreambuf_iterator<char>(*stream), std::istreambuf_iterator<char>());
 }
 
+/// write_bytes writes bytes to a file.
+void write_bytes(const std::string& filename, const std::vector<uint8_t>& bytes) {
+    auto output = io::open_output(filename);
+    output->write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!output->good()) {
+        throw sepia::unwritable_file(filename);
+    }
+}
+
+/// frame_filename returns the name of a frame asset.
+std::string frame_filename(const std::string& stem, std::size_t index) {
+    std::stringstream stream;
+    stream << stem << "_frame_" << std::setfill('0') << std::setw(6) << index << ".png";
+    return stream.str();
+}
+
+/// delta_t_histogram counts exposure measurements in logarithmic bins, so that the tone mapping's quantiles
+/// can be estimated with a constant memory footprint.
+/// Values below exact_bins have their own bin, and larger values are binned with 8 bits of mantissa
+/// (the relative error on a quantile is below 0.4 %).
+class delta_t_histogram {
+    public:
+    /// exact_bins is the number of values with their own bin.
+    static constexpr uint64_t exact_bins = 512;
+
+    delta_t_histogram() :
+        _bins(exact_bins + 55 * (exact_bins / 2), 0),
+        _size(0),
+        _minimum(std::numeric_limits<uint64_t>::max()),
+        _maximum(0) {}
+    delta_t_histogram(const delta_t_histogram&) = default;
+    delta_t_histogram(delta_t_histogram&&) = default;
+    delta_t_histogram& operator=(const delta_t_histogram&) = default;
+    delta_t_histogram& operator=(delta_t_histogram&&) = default;
+    virtual ~delta_t_histogram() {}
+
+    /// add counts a measurement.
+    virtual void add(uint64_t delta_t) {
+        ++_bins[index(delta_t)];
+        ++_size;
+        _minimum = std::min(_minimum, delta_t);
+        _maximum = std::max(_maximum, delta_t);
+    }
+
+    /// size returns the number of measurements.
+    virtual uint64_t size() const {
+        return _size;
+    }
+
+    /// minimum returns the smallest measurement.
+    virtual uint64_t minimum() const {
+        return _minimum;
+    }
+
+    /// maximum returns the largest measurement.
+    virtual uint64_t maximum() const {
+        return _maximum;
+    }
+
+    /// smallest estimates the rank-th smallest measurement (rank starts at 1).
+    virtual uint64_t smallest(uint64_t rank) const {
+        uint64_t count = 0;
+        for (std::size_t bin = 0; bin < _bins.size(); ++bin) {
+            count += _bins[bin];
+            if (count >= rank) {
+                return std::min(std::max(lower_bound(bin), _minimum), _maximum);
+            }
+        }
+        return _maximum;
+    }
+
+    /// largest estimates the rank-th largest measurement (rank starts at 1).
+    virtual uint64_t largest(uint64_t rank) const {
+        return smallest(_size - rank + 1);
+    }
+
+    protected:
+    /// index returns the bin of a value.
+    static std::size_t index(uint64_t value) {
+        if (value < exact_bins) {
+            return static_cast<std::size_t>(value);
+        }
+        std::size_t shift = 0;
+        for (; value >= exact_bins; value >>= 1) {
+            ++shift;
+        }
+        return static_cast<std::size_t>(exact_bins + (shift - 1) * (exact_bins / 2) + (value - exact_bins / 2));
+    }
+
+    /// lower_bound returns the smallest value of a bin.
+    static uint64_t lower_bound(std::size_t bin) {
+        if (bin < exact_bins) {
+            return bin;
+        }
+        const auto shift = (bin - exact_bins) / (exact_bins / 2) + 1;
+        return static_cast<uint64_t>((bin - exact_bins) % (exact_bins / 2) + exact_bins / 2) << shift;
+    }
+
+    std::vector<uint64_t> _bins;
+    uint64_t _size;
+    uint64_t _minimum;
+    uint64_t _maximum;
+};
+
+/// tone_mapping converts exposure measurements to gray levels with a logarithmic mapping.
+struct tone_mapping {
+    double slope;
+    double intercept;
+
+    /// operator() returns the gray level of an exposure measurement.
+    uint8_t operator()(uint64_t delta_t) const {
+        const auto exposure_candidate = slope * std::log(delta_t) + intercept;
+        return static_cast<uint8_t>(
+            exposure_candidate > 255 ? 255 : (exposure_candidate < 0 ? 0 : exposure_candidate));
+    }
+};
+
+/// histogram_to_tone_mapping maps the ratio-th quantile to white and the (1 - ratio)-th quantile to black.
+tone_mapping histogram_to_tone_mapping(const delta_t_histogram& histogram, double ratio) {
+    tone_mapping mapping{0.0, 128.0};
+    if (histogram.size() == 0) {
+        return mapping;
+    }
+    const auto rank = std::max(static_cast<uint64_t>(histogram.size() * ratio), static_cast<uint64_t>(1));
+    auto white_discard = histogram.smallest(rank);
+    auto black_discard = histogram.largest(rank);
+    if (black_discard <= white_discard) {
+        white_discard = histogram.minimum();
+        black_discard = histogram.maximum();
+    }
+    if (black_discard > white_discard) {
+        const auto delta = std::log(static_cast<double>(black_discard) / static_cast<double>(white_discard));
+        mapping.slope = -255.0 / delta;
+        mapping.intercept = 255.0 * std::log(static_cast<double>(black_discard)) / delta;
+    }
+    return mapping;
+}
+
+/// color_observable dispatches the window's color events to a handler.
+/// It can be called several times, and dispatches the same events every time.
+typedef std::function<void(const std::function<void(sepia::color_event)>&)> color_observable;
+
+/// stitch_window dispatches the exposure measurements of an ATIS stream, and stops at the end of the window.
+/// The blocks of a blocked input which end before first_t are skipped without being decoded.
+template <typename HandleExposureMeasurement>
+void stitch_window(
+    io::event_stream input,
+    uint64_t first_t,
+    uint64_t end_t,
+    HandleExposureMeasurement handle_exposure_measurement) {
+    const auto header = input.header;
+    io::join_observable<sepia::type::atis>(
+        std::move(input),
+        [&](const blocked::zone_map& zone_map) {
+            if (zone_map.begin_t >= end_t) {
+                throw sepia::end_of_file();
+            }
+            return zone_map.end_t >= first_t;
+        },
+        sepia::make_split<sepia::type::atis>(
+            [](sepia::dvs_event) {},
+            profile::make_sampled<sepia::threshold_crossing>(
+                "stitch",
+                tarsier::make_stitch<sepia::threshold_crossing, exposure_measurement>(
+                    header.width,
+                    header.height,
+                    [](sepia::threshold_crossing threshold_crossing, uint64_t delta_t) -> exposure_measurement {
+                        return {threshold_crossing.t, delta_t, threshold_crossing.x, threshold_crossing.y};
+                    },
+                    [&](exposure_measurement exposure_measurement) {
+                        if (exposure_measurement.t >= end_t) {
+                            throw sepia::end_of_file();
+                        }
+                        handle_exposure_measurement(exposure_measurement);
+                    }))));
+}
+
+/// render_parameters bundles the rendering options shared by the windows.
+struct render_parameters {
+    /// is_frametime_auto is true if the frametime is calculated from the number of events.
+    bool is_frametime_auto;
+
+    /// frametime is the time between two frames, 0 disables the frames (ignored if is_frametime_auto is true).
+    uint64_t frametime;
+
+    /// has_assets is true if the payloads are written to separate files instead of being inlined.
+    bool has_assets;
+
+    /// assets_path is the assets directory, and assets_reference its URL relative to the HTML outputs.
+    std::string assets_path;
+    std::string assets_reference;
+
+    /// x3dom is the content of the x3dom library, and x3dom_filename its name in the assets directory.
+    std::string x3dom;
+    std::string x3dom_filename;
+};
+
+/// split_output retrieves the directory of an output, and its filename without extension.
+/// The standard output is treated as a file named 'rainmaker' in the working directory.
+void split_output(const std::string& filename, std::string& directory, std::string& stem) {
+    directory = ".";
+    stem = "rainmaker";
+    if (!io::is_standard(filename)) {
+        const auto separator = filename.find_last_of("/\\");
+        if (separator != std::string::npos) {
+            directory = filename.substr(0, separator);
+        }
+        stem = filename.substr(separator == std::string::npos ? 0 : separator + 1);
+        const auto dot = stem.rfind('.');
+        if (dot != std::string::npos && dot > 0) {
+            stem = stem.substr(0, dot);
+        }
+    }
+}
+
+/// window_filename inserts a window's index before the output's extension.
+std::string window_filename(const std::string& filename, std::size_t index) {
+    std::stringstream suffix;
+    suffix << "_" << std::setfill('0') << std::setw(6) << index;
+    const auto separator = filename.find_last_of("/\\");
+    const auto dot = filename.rfind('.');
+    if (dot == std::string::npos || (separator != std::string::npos && dot < separator + 2) || dot == 0) {
+        return filename + suffix.str();
+    }
+    return filename.substr(0, dot) + suffix.str() + filename.substr(dot);
+}
+
+/// render_window writes the HTML output of a window, and returns the number of events in the output.
+/// The observable is called once for the frames and once for the events.
+/// The function only reads shared state, hence several windows can be rendered in parallel.
+uint64_t render_window(
+    const std::vector<std::unique_ptr<html::node>>& nodes,
+    const render_parameters& parameters,
+    const sepia::header& header,
+    uint64_t begin_t,
+    uint64_t end_t,
+    uint64_t events,
+    const std::vector<uint8_t>& base_frame,
+    const color_observable& observable,
+    const std::string& filename) {
+    // retrieve the frametime
+    uint64_t frametime = 0;
+    if (header.event_stream_type != sepia::type::dvs) {
+        if (parameters.is_frametime_auto) {
+            frametime = (end_t - begin_t)
+                        / std::max(events / (header.height * header.width), static_cast<uint64_t>(1));
+            if (frametime == 0) {
+                frametime = 1;
+            }
+        } else {
+            frametime = parameters.frametime;
+        }
+    }
+
+    // encode the base frame
+    std::vector<uint8_t> png_bytes;
+    {
+        profile::scope scope("png");
+        if (lodepng::encode(png_bytes, base_frame, header.width, header.height) != 0) {
+            throw std::logic_error("encoding the base frame failed");
+        }
+    }
+    std::size_t event_stream_header_size = 0;
+    {
+        std::ostringstream event_stream_header;
+        sepia::write_to_reference<sepia::type::color> write(event_stream_header, header.width, header.height);
+        event_stream_header_size = event_stream_header.str().size();
+    }
+    uint64_t written = 0;
+    std::unordered_map<std::string, html::variable> name_to_variable{
+        {"title", html::variable("rainmaker")},
+        {"x_max",
+         html::variable(std::to_string(
+             header.width > header.height ? 1.0 : static_cast<double>(header.width) / header.height))},
+        {"y_max",
+         html::variable(std::to_string(
+             header.width > header.height ? static_cast<double>(header.height) / header.width : 1.0))},
+        {"z_max", html::variable(std::to_string(1.0))},
+        {"width", html::variable(std::to_string(header.width))},
+        {"height", html::variable(std::to_string(header.height))},
+        {"begin_t", html::variable(std::to_string(begin_t))},
+        {"end_t", html::variable(std::to_string(end_t))},
+        {"has_frames", html::variable(frametime > 0)},
+        {"frametime", html::variable(std::to_string(frametime))},
+        {"events_offset", html::variable(std::to_string(event_stream_header_size))},
+        {"has_assets", html::variable(parameters.has_assets)},
+    };
+    if (parameters.has_assets) {
+        // write the payloads to files in the assets directory
+        std::string directory;
+        std::string stem;
+        split_output(filename, directory, stem);
+        const auto& path = parameters.assets_path;
+        const auto& reference = parameters.assets_reference;
+        write_bytes(sepia::join({path, stem + "_base_frame.png"}), png_bytes);
+        std::string frames_as_string;
+        {
+            profile::scope scope("frames");
+            std::size_t index = 0;
+            auto frame_generator = frames::make_generator(
+                base_frame,
+                header.width,
+                header.height,
+                begin_t,
+                end_t,
+                frametime,
+                [&](const std::vector<uint8_t>& frame) {
+                    std::vector<uint8_t> frame_png_bytes;
+                    {
+                        profile::scope scope("png");
+                        if (lodepng::encode(frame_png_bytes, frame, header.width, header.height) != 0) {
+                            throw std::logic_error("encoding a PNG frame failed");
+                        }
+                    }
+                    write_bytes(sepia::join({path, frame_filename(stem, index)}), frame_png_bytes);
+                    frames_as_string.append(index == 0 ? "'" : ", '");
+                    frames_as_string.append(reference + frame_filename(stem, index) + "'");
+                    ++index;
+                });
+            observable([&](sepia::color_event color_event) { frame_generator(color_event); });
+            frame_generator.close();
+        }
+        {
+            profile::scope scope("encode");
+            async::write_behind_ostream output(io::open_output(sepia::join({path, stem + ".es"})));
+            {
+                sepia::write_to_reference<sepia::type::color> write(output, header.width, header.height);
+                observable([&](sepia::color_event color_event) {
+                    ++written;
+                    write(color_event);
+                });
+            }
+            output.close();
+        }
+        name_to_variable.insert({"base_frame", html::variable(reference + stem + "_base_frame.png")});
+        name_to_variable.insert({"frames", html::variable(frames_as_string)});
+        name_to_variable.insert({"events", html::variable(reference + stem + ".es")});
+        name_to_variable.insert({"x3dom", html::variable(reference + parameters.x3dom_filename)});
+    } else {
+        // inline the payloads in the HTML output
+        // the frames and the events are generated while rendering, and written directly to the output
+        {
+            profile::scope scope("base64");
+            name_to_variable.insert(
+                {"base_frame",
+                 html::variable("data:image/png;base64," + html::bytes_to_encoded_characters(png_bytes))});
+        }
+        name_to_variable.insert(
+            {"frames", html::variable(std::function<void(std::ostream&)>([&](std::ostream& output) {
+                 profile::scope scope("frames");
+                 auto first = true;
+                 auto frame_generator = frames::make_generator(
+                     base_frame,
+                     header.width,
+                     header.height,
+                     begin_t,
+                     end_t,
+                     frametime,
+                     [&](const std::vector<uint8_t>& frame) {
+                         std::vector<uint8_t> frame_png_bytes;
+                         {
+                             profile::scope scope("png");
+                             if (lodepng::encode(frame_png_bytes, frame, header.width, header.height) != 0) {
+                                 throw std::logic_error("encoding a PNG frame failed");
+                             }
+                         }
+                         profile::scope scope("base64");
+                         output << (first ? "'" : ", '") << "data:image/png;base64,";
+                         first = false;
+                         html::base64_ostream encoded_output(output);
+                         encoded_output.write(
+                             reinterpret_cast<const char*>(frame_png_bytes.data()),
+                             static_cast<std::streamsize>(frame_png_bytes.size()));
+                         encoded_output.close();
+                         output << "'";
+                     });
+                 observable([&](sepia::color_event color_event) { frame_generator(color_event); });
+                 frame_generator.close();
+             }))});
+        name_to_variable.insert(
+            {"events", html::variable(std::function<void(std::ostream&)>([&](std::ostream& output) {
+                 profile::scope scope("encode");
+                 html::base64_ostream encoded_output(output, event_stream_header_size);
+                 {
+                     sepia::write_to_reference<sepia::type::color> write(encoded_output, header.width, header.height);
+                     observable([&](sepia::color_event color_event) {
+                         ++written;
+                         write(color_event);
+                     });
+                 }
+                 encoded_output.close();
+             }))});
+        name_to_variable.insert({"x3dom", html::variable(parameters.x3dom)});
+    }
+
+    // render the HTML output
+    profile::scope scope("render");
+    html::render(io::open_output(filename), nodes, name_to_variable);
+    return written;
+}
+
+/// window_schedule lists the beginnings of the windows rendered in batch mode.
+/// The windows are either listed explicitly (in chronological order),
+/// or start every period from the first beginning, until the end of the input.
+struct window_schedule {
+    std::vector<uint64_t> begins;
+    uint64_t every;
+    uint64_t duration;
+
+    /// has returns false if the schedule does not have a window with the given index.
+    bool has(std::size_t index) const {
+        return every > 0 || index < begins.size();
+    }
+
+    /// begin returns the beginning of a window.
+    uint64_t begin(std::size_t index) const {
+        return every > 0 ? begins.front() + index * every : begins[index];
+    }
+
+    /// end returns the end of the last window, or the largest timestamp if the windows are periodic.
+    uint64_t end() const {
+        return every > 0 ? std::numeric_limits<uint64_t>::max() : begins.back() + duration;
+    }
+};
+
+/// sliding_windows splits a stream of samples (exposure measurements or color events) into windows,
+/// so that any number of windows can be rendered with a single pass over the input.
+/// The samples of the open windows are buffered (overlapping windows share the buffer),
+/// and a running frame holding the latest sample per pixel provides each window's base frame when it opens.
+/// A window is handed over once a sample past its end arrives, or when the stream ends.
+/// Windows without samples are skipped.
+template <typename Sample, typename Pixel, typename UpdatePixel, typename HandleWindow>
+class sliding_windows {
+    public:
+    sliding_windows(
+        uint16_t width,
+        uint16_t height,
+        bool has_base_frame,
+        window_schedule schedule,
+        UpdatePixel update_pixel,
+        HandleWindow handle_window) :
+        _width(width),
+        _height(height),
+        _schedule(std::move(schedule)),
+        _next(0),
+        _frame(has_base_frame ? static_cast<std::size_t>(width) * height : 0),
+        _update_pixel(std::move(update_pixel)),
+        _handle_window(std::move(handle_window)) {}
+    sliding_windows(const sliding_windows&) = default;
+    sliding_windows(sliding_windows&&) = default;
+    sliding_windows& operator=(const sliding_windows&) = default;
+    sliding_windows& operator=(sliding_windows&&) = default;
+    virtual ~sliding_windows() {}
+
+    /// operator() handles a sample.
+    virtual void operator()(Sample sample) {
+        const uint64_t t = sample.t;
+        while (!_windows.empty() && _windows.front().begin_t + _schedule.duration <= t) {
+            close_front();
+        }
+        for (; _schedule.has(_next) && _schedule.begin(_next) <= t; ++_next) {
+            if (_schedule.begin(_next) + _schedule.duration > t) {
+                _windows.push_back({_next, _schedule.begin(_next), _frame});
+            }
+        }
+        if (!_windows.empty()) {
+            _samples.push_back(sample);
+        }
+        if (!_frame.empty()) {
+            const auto index =
+                static_cast<std::size_t>(sample.x) + static_cast<std::size_t>(_width) * (_height - 1 - sample.y);
+            _update_pixel(_frame[index], sample);
+        }
+    }
+
+    /// is_done returns true once every window has been handed over.
+    virtual bool is_done() const {
+        return _windows.empty() && !_schedule.has(_next);
+    }
+
+    /// close hands over the open windows, truncated to the end of the stream.
+    virtual void close() {
+        while (!_windows.empty()) {
+            close_front();
+        }
+    }
+
+    protected:
+    /// window represents an open window.
+    struct window {
+        std::size_t index;
+        uint64_t begin_t;
+        std::vector<Pixel> base_frame;
+    };
+
+    /// close_front hands over the oldest open window, and drops the samples that no open window needs.
+    /// The buffer starts at the oldest window's beginning, hence it contains exactly its samples.
+    void close_front() {
+        auto& front = _windows.front();
+        if (!_samples.empty()) {
+            _handle_window(
+                front.index,
+                front.begin_t,
+                std::move(front.base_frame),
+                std::vector<Sample>(_samples.begin(), _samples.end()));
+        }
+        _windows.pop_front();
+        while (!_samples.empty() && (_windows.empty() || _samples.front().t < _windows.front().begin_t)) {
+            _samples.pop_front();
+        }
+    }
+
+    const uint16_t _width;
+    const uint16_t _height;
+    const window_schedule _schedule;
+    std::size_t _next;
+    std::vector<Pixel> _frame;
+    std::deque<window> _windows;
+    std::deque<Sample> _samples;
+    UpdatePixel _update_pixel;
+    HandleWindow _handle_window;
+};
+
+/// make_sliding_windows creates sliding windows from a schedule and handlers.
+template <typename Sample, typename Pixel, typename UpdatePixel, typename HandleWindow>
+sliding_windows<Sample, Pixel, UpdatePixel, HandleWindow> make_sliding_windows(
+    uint16_t width,
+    uint16_t height,
+    bool has_base_frame,
+    window_schedule schedule,
+    UpdatePixel update_pixel,
+    HandleWindow handle_window) {
+    return sliding_windows<Sample, Pixel, UpdatePixel, HandleWindow>(
+        width, height, has_base_frame, std::move(schedule), std::move(update_pixel), std::move(handle_window));
+}
+
+/// window_job holds the data needed to render a window.
+/// ATIS windows hold the raw exposure measurements and base frame instead of color events,
+/// since their tone mapping depends on the whole window (see tone_map_job).
+struct window_job {
+    std::size_t index;
+    uint64_t begin_t;
+    std::vector<uint8_t> base_frame;
+    std::vector<sepia::color_event> color_events;
+    std::vector<uint64_t> delta_t_base_frame;
+    std::vector<exposure_measurement> exposure_measurements;
+};
+
+/// tone_map_job converts an ATIS window's exposure measurements and base frame to color events and an RGBA frame.
+void tone_map_job(window_job& job, double ratio) {
+    profile::scope scope("tone map");
+    delta_t_histogram histogram;
+    for (auto exposure_measurement : job.exposure_measurements) {
+        histogram.add(exposure_measurement.delta_t);
+    }
+    for (auto delta_t : job.delta_t_base_frame) {
+        if (delta_t > 0 && delta_t < std::numeric_limits<uint64_t>::max()) {
+            histogram.add(delta_t);
+        }
+    }
+    const auto delta_t_to_exposure = histogram_to_tone_mapping(histogram, ratio);
+    job.base_frame.resize(job.delta_t_base_frame.size() * 4);
+    for (std::size_t pixel = 0; pixel < job.delta_t_base_frame.size(); ++pixel) {
+        const auto exposure = delta_t_to_exposure(job.delta_t_base_frame[pixel]);
+        job.base_frame[pixel * 4] = exposure;
+        job.base_frame[pixel * 4 + 1] = exposure;
+        job.base_frame[pixel * 4 + 2] = exposure;
+        job.base_frame[pixel * 4 + 3] = 255;
+    }
+    job.color_events.reserve(job.exposure_measurements.size());
+    for (auto exposure_measurement : job.exposure_measurements) {
+        const auto exposure = delta_t_to_exposure(exposure_measurement.delta_t);
+        job.color_events.push_back(
+            {exposure_measurement.t,
+             exposure_measurement.x,
+             exposure_measurement.y,
+             exposure,
+             exposure,
+             exposure});
+    }
+    job.delta_t_base_frame.clear();
+    job.exposure_measurements.clear();
+}
+
+/// render_windows decodes the input once, and writes one HTML output per window of the schedule.
+/// Completed windows are rendered in batches, one thread per window, ATIS windows are tone mapped by the same threads.
+void render_windows(
+    io::event_stream input,
+    const std::vector<std::unique_ptr<html::node>>& nodes,
+    const render_parameters& parameters,
+    const window_schedule& schedule,
+    double ratio,
+    const std::string& filename) {
+    auto& session = profile::current();
+    const auto header = input.header;
+    const auto batch_size = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<window_job> jobs;
+    const auto flush = [&]() {
+        std::vector<uint64_t> written(jobs.size(), 0);
+        async::parallel_for(jobs.size(), [&](std::size_t index) {
+            auto& job = jobs[index];
+            if (header.event_stream_type == sepia::type::atis) {
+                tone_map_job(job, ratio);
+            }
+            written[index] = render_window(
+                nodes,
+                parameters,
+                header,
+                job.begin_t,
+                job.begin_t + schedule.duration,
+                job.color_events.size(),
+                job.base_frame,
+                [&](const std::function<void(sepia::color_event)>& handle_color_event) {
+                    for (auto color_event : job.color_events) {
+                        handle_color_event(color_event);
+                    }
+                },
+                window_filename(filename, job.index));
+        });
+        for (std::size_t index = 0; index < jobs.size(); ++index) {
+            session.output(window_filename(filename, jobs[index].index));
+            session.events_out += written[index];
+        }
+        jobs.clear();
+    };
+    const auto push = [&](window_job job) {
+        jobs.push_back(std::move(job));
+        if (jobs.size() == batch_size) {
+            flush();
+        }
+    };
+    const auto keep_block = [&](const blocked::zone_map& zone_map) {
+        if (zone_map.begin_t >= schedule.end()) {
+            throw sepia::end_of_file();
+        }
+        return true;
+    };
+    switch (header.event_stream_type) {
+        case sepia::type::generic: {
+            throw std::runtime_error("generic events are not compatible with this application");
+            break;
+        }
+        case sepia::type::dvs: {
+            auto windows = make_sliding_windows<sepia::color_event, uint8_t>(
+                header.width,
+                header.height,
+                false,
+                schedule,
+                [](uint8_t&, sepia::color_event) {},
+                [&](std::size_t index,
+                    uint64_t begin_t,
+                    std::vector<uint8_t>,
+                    std::vector<sepia::color_event> color_events) {
+                    push({index,
+                          begin_t,
+                          std::vector<uint8_t>(header.width * header.height * 4, 0),
+                          std::move(color_events),
+                          {},
+                          {}});
+                });
+            {
+                profile::scope scope("decode");
+                io::join_observable<sepia::type::dvs>(std::move(input), keep_block, [&](sepia::dvs_event dvs_event) {
+                    ++session.events_in;
+                    if (dvs_event.is_increase) {
+                        windows({dvs_event.t, dvs_event.x, dvs_event.y, 0x00, 0x8c, 0xff});
+                    } else {
+                        windows({dvs_event.t, dvs_event.x, dvs_event.y, 0x33, 0x4d, 0x5c});
+                    }
+                    if (windows.is_done()) {
+                        throw sepia::end_of_file();
+                    }
+                });
+            }
+            windows.close();
+            break;
+        }
+        case sepia::type::atis: {
+            // the tone mapping depends on the whole window, hence color events are generated when it is rendered
+            auto windows = make_sliding_windows<exposure_measurement, uint64_t>(
+                header.width,
+                header.height,
+                true,
+                schedule,
+                [](uint64_t& delta_t, exposure_measurement exposure_measurement) {
+                    delta_t = exposure_measurement.delta_t;
+                },
+                [&](std::size_t index,
+                    uint64_t begin_t,
+                    std::vector<uint64_t> delta_t_base_frame,
+                    std::vector<exposure_measurement> exposure_measurements) {
+                    push({index, begin_t, {}, {}, std::move(delta_t_base_frame), std::move(exposure_measurements)});
+                });
+            {
+                profile::scope scope("decode");
+                stitch_window(
+                    std::move(input), 0, schedule.end(), [&](exposure_measurement exposure_measurement) {
+                        ++session.events_in;
+                        windows(exposure_measurement);
+                        if (windows.is_done()) {
+                            throw sepia::end_of_file();
+                        }
+                    });
+            }
+            windows.close();
+            break;
+        }
+        case sepia::type::color: {
+            auto windows = make_sliding_windows<sepia::color_event, std::array<uint8_t, 4>>(
+                header.width,
+                header.height,
+                true,
+                schedule,
+                [](std::array<uint8_t, 4>& pixel, sepia::color_event color_event) {
+                    pixel = {{color_event.r, color_event.g, color_event.b, 255}};
+                },
+                [&](std::size_t index,
+                    uint64_t begin_t,
+                    std::vector<std::array<uint8_t, 4>> pixels,
+                    std::vector<sepia::color_event> color_events) {
+                    window_job job{
+                        index, begin_t, std::vector<uint8_t>(pixels.size() * 4), std::move(color_events), {}, {}};
+                    for (std::size_t pixel = 0; pixel < pixels.size(); ++pixel) {
+                        std::copy(pixels[pixel].begin(), pixels[pixel].end(), job.base_frame.begin() + pixel * 4);
+                    }
+                    push(std::move(job));
+                });
+            {
+                profile::scope scope("decode");
+                io::join_observable<sepia::type::color>(
+                    std::move(input), keep_block, [&](sepia::color_event color_event) {
+                        ++session.events_in;
+                        windows(color_event);
+                        if (windows.is_done()) {
+                            throw sepia::end_of_file();
+                        }
+                    });
+            }
+            windows.close();
+            break;
+        }
+    }
+    flush();
+}
+
 int main(int argc, char* argv[]) {
     return pontella::main(
         {"rainmaker generates a standalone HTML file containing a 3D representation of events",
          "Syntax: ./rainmaker [options] /path/to/input.es /path/to/output.html",
+         "    The string '-' (without quotes) can be used for the standard input and output",
          "Available options:",
          "    -t [timestamp], --timestamp [timestamp]    sets the initial timestamp for the point cloud",
          "                                                   default to 0",
@@ -39,6 +789,21 @@ int main(int argc, char* argv[]) {
          "                                                   a duration in microseconds can be provided instead,",
          "                                                   'none' disables the frames,",
          "                                                   ignored if the file contains DVS events",
+         "    -a [directory], --assets [directory]       writes the events, the frames and x3dom to separate files",
+         "                                                   in the given directory (relative to the output),",
+         "                                                   instead of inlining them in the HTML file,",
+         "                                                   the HTML file must be served over HTTP",
+         "    -e [duration], --every [duration]          renders a window every [duration] microseconds",
+         "                                                   from the initial timestamp to the end of the file,",
+         "                                                   the input is decoded once, and the outputs are",
+         "                                                   numbered (output_000000.html, output_000001.html...)",
+         "                                                   windows without events are skipped",
+         "    -w [timestamps], --windows [timestamps]    renders a window for each of the given comma-separated",
+         "                                                   initial timestamps, with the same numbering as --every",
+         "    -c [level], --cpu [level]                  sets the instruction set of the encoding kernels",
+         "                                                   (scalar, sse4.2, avx2 or avx512),",
+         "                                                   defaults to the best level supported by the processor",
+         "    -p, --profile                              prints a JSON profiling report on the standard error",
          "    -h, --help                                 shows this help message"},
         argc,
         argv,
@@ -48,9 +813,16 @@ int main(int argc, char* argv[]) {
             {"duration", {"d"}},
             {"ratio", {"r"}},
             {"frametime", {"f"}},
+            {"assets", {"a"}},
+            {"every", {"e"}},
+            {"windows", {"w"}},
+            {"cpu", {"c"}},
         },
-        {},
-        [](pontella::command command) {
+        {{"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            cpu::select_from_command(command);
+            auto& session = profile::current();
+            session.input(command.arguments[0]);
             const auto nodes = html::parse(filename_to_string(sepia::join({SEPIA_DIRNAME, "rainmaker.html"})));
             uint64_t begin_t = 0;
             {
@@ -59,22 +831,114 @@ int main(int argc, char* argv[]) {
                     begin_t = std::stoull(name_and_argument->second);
                 }
             }
-            auto end_t = begin_t + 1000000;
+            uint64_t duration = 1000000;
             {
                 const auto name_and_argument = command.options.find("duration");
                 if (name_and_argument != command.options.end()) {
-                    const auto duration = std::stoull(name_and_argument->second);
-                    end_t = begin_t + duration;
+                    duration = std::stoull(name_and_argument->second);
+                }
+            }
+            const auto end_t = begin_t + duration;
+            auto ratio = 0.05;
+            {
+                const auto name_and_argument = command.options.find("ratio");
+                if (name_and_argument != command.options.end()) {
+                    ratio = std::stod(name_and_argument->second);
                 }
             }
+            render_parameters parameters{true, 0, false, "", "", "", ""};
             {
-                std::ofstream output(command.arguments[1]);
-                if (!output.good()) {
-                    throw sepia::unwritable_file(command.arguments[1]);
+                const auto name_and_argument = command.options.find("frametime");
+                if (name_and_argument != command.options.end() && name_and_argument->second != "auto") {
+                    parameters.is_frametime_auto = false;
+                    if (name_and_argument->second != "none") {
+                        parameters.frametime = std::stoull(name_and_argument->second);
+                    }
+                }
+            }
+            window_schedule schedule{{}, 0, duration};
+            {
+                const auto name_and_argument = command.options.find("every");
+                if (name_and_argument != command.options.end()) {
+                    schedule.every = std::stoull(name_and_argument->second);
+                    if (schedule.every == 0) {
+                        throw std::runtime_error("[every] must be larger than 0");
+                    }
+                    schedule.begins.push_back(begin_t);
+                }
+            }
+            {
+                const auto name_and_argument = command.options.find("windows");
+                if (name_and_argument != command.options.end()) {
+                    if (schedule.every > 0) {
+                        throw std::runtime_error("--every and --windows cannot be used together");
+                    }
+                    std::istringstream stream(name_and_argument->second);
+                    for (std::string value; std::getline(stream, value, ',');) {
+                        schedule.begins.push_back(std::stoull(value));
+                    }
+                    if (schedule.begins.empty()) {
+                        throw std::runtime_error("[windows] must contain at least one timestamp");
+                    }
+                    std::sort(schedule.begins.begin(), schedule.begins.end());
+                }
+            }
+            const auto is_batch = !schedule.begins.empty();
+            if (is_batch) {
+                if (io::is_standard(command.arguments[1])) {
+                    throw std::runtime_error("the output cannot be the standard output with --every or --windows");
+                }
+            } else {
+                session.output(command.arguments[1]);
+                if (!io::is_standard(command.arguments[1])) {
+                    std::ofstream output(command.arguments[1]);
+                    if (!output.good()) {
+                        throw sepia::unwritable_file(command.arguments[1]);
+                    }
+                }
+            }
+            parameters.x3dom =
+                filename_to_string(sepia::join({sepia::dirname(SEPIA_DIRNAME), "third_party", "x3dom.js"}));
+            {
+                const auto name_and_argument = command.options.find("assets");
+                if (name_and_argument != command.options.end()) {
+                    // the assets directory is relative to the output's directory, and x3dom is shared between outputs
+                    std::string directory;
+                    std::string stem;
+                    split_output(command.arguments[1], directory, stem);
+                    parameters.has_assets = true;
+                    parameters.assets_reference = name_and_argument->second + "/";
+                    parameters.assets_path =
+                        (name_and_argument->second.front() == '/' ? "" : directory + "/") + name_and_argument->second;
+                    io::create_directory(parameters.assets_path);
+                    const auto x3dom_digest = merkle::hash(
+                        reinterpret_cast<const uint8_t*>(parameters.x3dom.data()),
+                        parameters.x3dom.size(),
+                        merkle::leaf_seed);
+                    parameters.x3dom_filename = "x3dom." + merkle::digest_to_hex(x3dom_digest).substr(0, 16) + ".js";
+                    const auto x3dom_path = sepia::join({parameters.assets_path, parameters.x3dom_filename});
+                    if (!std::ifstream(x3dom_path).good()) {
+                        write_bytes(x3dom_path, std::vector<uint8_t>(parameters.x3dom.begin(), parameters.x3dom.end()));
+                    }
                 }
             }
             std::vector<sepia::color_event> color_events;
-            const auto header = sepia::read_header(sepia::filename_to_ifstream(command.arguments[0]));
+            std::vector<exposure_measurement> exposure_measurements;
+            color_observable observable = [&](const std::function<void(sepia::color_event)>& handle_color_event) {
+                for (auto color_event : color_events) {
+                    handle_color_event(color_event);
+                }
+            };
+            uint64_t events = 0;
+            auto input = io::open_event_stream(command.arguments[0], true);
+            const auto header = input.header;
+            if (header.event_stream_type == sepia::type::atis && (ratio < 0 || ratio >= 1)) {
+                throw std::runtime_error("[ratio] must be a real number in the range [0, 1[");
+            }
+            if (is_batch) {
+                render_windows(std::move(input), nodes, parameters, schedule, ratio, command.arguments[1]);
+                return;
+            }
             std::vector<uint8_t> base_frame(header.width * header.height * 4, 0);
             switch (header.event_stream_type) {
                 case sepia::type::generic: {
@@ -82,266 +946,150 @@ int main(int argc, char* argv[]) {
                     break;
                 }
                 case sepia::type::dvs: {
-                    sepia::join_observable<sepia::type::dvs>(
-                        sepia::filename_to_ifstream(command.arguments[0]), [&](sepia::dvs_event dvs_event) {
-                            if (dvs_event.t >= end_t) {
-                                throw sepia::end_of_file();
-                            }
-                            if (dvs_event.t >= begin_t) {
-                                if (dvs_event.is_increase) {
-                                    color_events.push_back({dvs_event.t, dvs_event.x, dvs_event.y, 0x00, 0x8c, 0xff});
-                                } else {
-                                    color_events.push_back({dvs_event.t, dvs_event.x, dvs_event.y, 0x33, 0x4d, 0x5c});
+                    {
+                        profile::scope scope("decode");
+                        io::join_observable<sepia::type::dvs>(
+                            std::move(input),
+                            [&](const blocked::zone_map& zone_map) {
+                                if (zone_map.begin_t >= end_t) {
+                                    throw sepia::end_of_file();
                                 }
-                            }
-                        });
+                                return zone_map.end_t >= begin_t;
+                            },
+                            [&](sepia::dvs_event dvs_event) {
+                                if (dvs_event.t >= end_t) {
+                                    throw sepia::end_of_file();
+                                }
+                                if (dvs_event.t >= begin_t) {
+                                    if (dvs_event.is_increase) {
+                                        color_events.push_back(
+                                            {dvs_event.t, dvs_event.x, dvs_event.y, 0x00, 0x8c, 0xff});
+                                    } else {
+                                        color_events.push_back(
+                                            {dvs_event.t, dvs_event.x, dvs_event.y, 0x33, 0x4d, 0x5c});
+                                    }
+                                }
+                            });
+                    }
                     if (color_events.empty()) {
                         throw std::runtime_error("there are no DVS events in the given file and range");
                     }
+                    events = color_events.size();
                     break;
                 }
                 case sepia::type::atis: {
-                    auto ratio = 0.05;
+                    // first pass: build the base frame and the histogram of the window's measurements
+                    // the measurements are kept in memory only if the input cannot be read twice
+                    const auto is_replayable = !io::is_standard(command.arguments[0]);
+                    delta_t_histogram histogram;
+                    std::vector<uint64_t> delta_t_base_frame(header.width * header.height, 0);
+                    auto first_t = std::numeric_limits<uint64_t>::max();
                     {
-                        const auto name_and_argument = command.options.find("ratio");
-                        if (name_and_argument != command.options.end()) {
-                            ratio = std::stod(name_and_argument->second);
-                        }
-                        if (ratio < 0 || ratio >= 1) {
-                            throw std::runtime_error("[ratio] must be a real number in the range [0, 1[");
-                        }
+                        profile::scope scope("decode");
+                        stitch_window(std::move(input), 0, end_t, [&](exposure_measurement exposure_measurement) {
+                            if (exposure_measurement.t >= begin_t) {
+                                histogram.add(exposure_measurement.delta_t);
+                                first_t = std::min(first_t, exposure_measurement.t - exposure_measurement.delta_t);
+                                if (!is_replayable) {
+                                    exposure_measurements.push_back(exposure_measurement);
+                                }
+                            } else {
+                                delta_t_base_frame
+                                    [exposure_measurement.x
+                                     + header.width * (header.height - 1 - exposure_measurement.y)] =
+                                        exposure_measurement.delta_t;
+                            }
+                        });
                     }
-                    std::vector<exposure_measurement> exposure_measurements;
-                    std::vector<uint64_t> delta_t_base_frame(header.width * header.height, 0);
-                    sepia::join_observable<sepia::type::atis>(
-                        sepia::filename_to_ifstream(command.arguments[0]),
-                        sepia::make_split<sepia::type::atis>(
-                            [](sepia::dvs_event) {},
-                            tarsier::make_stitch<sepia::threshold_crossing, exposure_measurement>(
-                                header.width,
-                                header.height,
-                                [](sepia::threshold_crossing threshold_crossing,
-                                   uint64_t delta_t) -> exposure_measurement {
-                                    return {threshold_crossing.t, delta_t, threshold_crossing.x, threshold_crossing.y};
-                                },
-                                [&](exposure_measurement exposure_measurement) {
-                                    if (exposure_measurement.t >= end_t) {
-                                        throw sepia::end_of_file();
-                                    } else if (exposure_measurement.t >= begin_t) {
-                                        exposure_measurements.push_back(exposure_measurement);
-                                    } else {
-                                        delta_t_base_frame
-                                            [exposure_measurement.x
-                                             + header.width * (header.height - 1 - exposure_measurement.y)] =
-                                                exposure_measurement.delta_t;
-                                    }
-                                })));
-                    if (exposure_measurements.empty()) {
+                    if (histogram.size() == 0) {
                         throw std::runtime_error("there are no ATIS events in the given file and range");
                     }
-                    auto slope = 0.0;
-                    auto intercept = 128.0;
+                    events = histogram.size();
+                    tone_mapping delta_t_to_exposure;
                     {
-                        std::vector<uint64_t> delta_ts;
-                        delta_ts.resize(exposure_measurements.size());
-                        std::transform(
-                            exposure_measurements.begin(),
-                            exposure_measurements.end(),
-                            delta_ts.begin(),
-                            [](exposure_measurement exposure_measurement) { return exposure_measurement.delta_t; });
-
-                        // @DEBUG {
-                        {
-                            std::ofstream debug("/Users/Alex/idv/libraries/utilities/build/debug/delta_ts.log");
-                            for (auto delta_t : delta_ts) {
-                                debug << delta_t << "\n";
-                            }
-                        }
-                        // }
-
-                        delta_ts.reserve(delta_ts.size() + delta_t_base_frame.size());
+                        profile::scope scope("tone map");
                         for (auto delta_t : delta_t_base_frame) {
                             if (delta_t > 0 && delta_t < std::numeric_limits<uint64_t>::max()) {
-                                delta_ts.push_back(delta_t);
+                                histogram.add(delta_t);
                             }
                         }
-                        auto discarded_delta_ts =
-                            std::vector<uint64_t>(static_cast<std::size_t>(delta_ts.size() * ratio));
-                        std::partial_sort_copy(
-                            delta_ts.begin(), delta_ts.end(), discarded_delta_ts.begin(), discarded_delta_ts.end());
-                        auto white_discard = discarded_delta_ts.back();
-                        const auto white_discard_fallback = discarded_delta_ts.front();
-                        std::partial_sort_copy(
-                            delta_ts.begin(),
-                            delta_ts.end(),
-                            discarded_delta_ts.begin(),
-                            discarded_delta_ts.end(),
-                            std::greater<uint64_t>());
-                        auto black_discard = discarded_delta_ts.back();
-                        const auto black_discard_fallback = discarded_delta_ts.front();
-                        if (black_discard <= white_discard) {
-                            white_discard = white_discard_fallback;
-                            black_discard = black_discard_fallback;
-                        }
-                        if (black_discard > white_discard) {
-                            const auto delta =
-                                std::log(static_cast<double>(black_discard) / static_cast<double>(white_discard));
-                            slope = -255.0 / delta;
-                            intercept = 255.0 * std::log(static_cast<double>(black_discard)) / delta;
+                        delta_t_to_exposure = histogram_to_tone_mapping(histogram, ratio);
+                        for (std::size_t index = 0; index < delta_t_base_frame.size(); ++index) {
+                            const auto exposure = delta_t_to_exposure(delta_t_base_frame[index]);
+                            base_frame[index * 4] = exposure;
+                            base_frame[index * 4 + 1] = exposure;
+                            base_frame[index * 4 + 2] = exposure;
+                            base_frame[index * 4 + 3] = 255;
                         }
                     }
-                    auto delta_t_to_exposure = [&](uint64_t delta_t) -> uint8_t {
-                        const auto exposure_candidate = slope * std::log(delta_t) + intercept;
-                        return static_cast<uint8_t>(
-                            exposure_candidate > 255 ? 255 : (exposure_candidate < 0 ? 0 : exposure_candidate));
+
+                    // second pass: convert the measurements to color events while rendering
+                    // the input is decoded again from the first block which contains a window measurement
+                    const auto filename = command.arguments[0];
+                    observable = [=, &exposure_measurements](
+                                     const std::function<void(sepia::color_event)>& handle_color_event) {
+                        const auto handle_exposure_measurement = [&](exposure_measurement exposure_measurement) {
+                            if (exposure_measurement.t >= begin_t) {
+                                const auto exposure = delta_t_to_exposure(exposure_measurement.delta_t);
+                                handle_color_event(
+                                    {exposure_measurement.t,
+                                     exposure_measurement.x,
+                                     exposure_measurement.y,
+                                     exposure,
+                                     exposure,
+                                     exposure});
+                            }
+                        };
+                        if (is_replayable) {
+                            stitch_window(
+                                io::open_event_stream(filename, true), first_t, end_t, handle_exposure_measurement);
+                        } else {
+                            for (auto exposure_measurement : exposure_measurements) {
+                                handle_exposure_measurement(exposure_measurement);
+                            }
+                        }
                     };
-                    for (auto delta_t_iterator = delta_t_base_frame.begin();
-                         delta_t_iterator != delta_t_base_frame.end();
-                         ++delta_t_iterator) {
-                        const auto exposure = delta_t_to_exposure(*delta_t_iterator);
-                        const std::size_t index = std::distance(delta_t_base_frame.begin(), delta_t_iterator) * 4;
-                        base_frame[index] = exposure;
-                        base_frame[index + 1] = exposure;
-                        base_frame[index + 2] = exposure;
-                        base_frame[index + 3] = 255;
-                    }
-                    color_events.resize(exposure_measurements.size());
-                    std::transform(
-                        exposure_measurements.begin(),
-                        exposure_measurements.end(),
-                        color_events.begin(),
-                        [&](exposure_measurement exposure_measurement) -> sepia::color_event {
-                            const auto exposure = delta_t_to_exposure(exposure_measurement.delta_t);
-                            return {exposure_measurement.t,
-                                    exposure_measurement.x,
-                                    exposure_measurement.y,
-                                    exposure,
-                                    exposure,
-                                    exposure};
-                        });
                     break;
                 }
                 case sepia::type::color: {
-                    sepia::join_observable<sepia::type::color>(
-                        sepia::filename_to_ifstream(command.arguments[0]), [&](sepia::color_event color_event) {
-                            if (color_event.t >= end_t) {
-                                throw sepia::end_of_file();
-                            }
-                            if (color_event.t >= begin_t) {
-                                color_events.push_back(color_event);
-                            } else {
-                                const auto index =
-                                    (color_event.x + header.width * (header.height - 1 - color_event.y)) * 4;
-                                base_frame[index] = color_event.r;
-                                base_frame[index + 1] = color_event.g;
-                                base_frame[index + 2] = color_event.b;
-                                base_frame[index + 3] = 255;
-                            }
-                        });
+                    {
+                        profile::scope scope("decode");
+                        io::join_observable<sepia::type::color>(
+                            std::move(input),
+                            [&](const blocked::zone_map& zone_map) {
+                                if (zone_map.begin_t >= end_t) {
+                                    throw sepia::end_of_file();
+                                }
+                                return true;
+                            },
+                            [&](sepia::color_event color_event) {
+                                if (color_event.t >= end_t) {
+                                    throw sepia::end_of_file();
+                                }
+                                if (color_event.t >= begin_t) {
+                                    color_events.push_back(color_event);
+                                } else {
+                                    const auto index =
+                                        (color_event.x + header.width * (header.height - 1 - color_event.y)) * 4;
+                                    base_frame[index] = color_event.r;
+                                    base_frame[index + 1] = color_event.g;
+                                    base_frame[index + 2] = color_event.b;
+                                    base_frame[index + 3] = 255;
+                                }
+                            });
+                    }
                     if (color_events.empty()) {
                         throw std::runtime_error("there are no color events in the given file and range");
                     }
+                    events = color_events.size();
                     break;
                 }
             }
 
-            // retrieve the frametime
-            uint64_t frametime = 0;
-            if (header.event_stream_type != sepia::type::dvs) {
-                const auto name_and_argument = command.options.find("frametime");
-                if (name_and_argument == command.options.end() || name_and_argument->second == "auto") {
-                    frametime = (end_t - begin_t) / (color_events.size() / (header.height * header.width));
-                    if (frametime == 0) {
-                        frametime = 1;
-                    }
-                } else if (name_and_argument != command.options.end() && name_and_argument->second != "none") {
-                    frametime = std::stoull(name_and_argument->second);
-                }
-            }
-
-            // generate the frames
-            std::vector<std::vector<uint8_t>> frames;
-            if (frametime > 0) {
-                frames.push_back(base_frame);
-                for (auto color_event : color_events) {
-                    if (color_event.t - begin_t > frametime * (frames.size() - 1)) {
-                        if (frametime * frames.size() >= end_t) {
-                            break;
-                        } else {
-                            frames.push_back(frames.back());
-                        }
-                    }
-                    const auto index = (color_event.x + header.width * (header.height - 1 - color_event.y)) * 4;
-                    frames.back()[index] = color_event.r;
-                    frames.back()[index + 1] = color_event.g;
-                    frames.back()[index + 2] = color_event.b;
-                    frames.back()[index + 3] = 255;
-                }
-            }
-
-            // encode the events
-            std::vector<uint8_t> events_bytes;
-            {
-                std::stringstream event_stream;
-                sepia::write_to_reference<sepia::type::color> write(event_stream, header.width, header.height);
-                for (auto color_event : color_events) {
-                    write(color_event);
-                }
-                sepia::read_header(event_stream);
-                const auto event_stream_as_string = event_stream.str();
-                events_bytes.assign(
-                    std::next(
-                        event_stream_as_string.begin(),
-                        static_cast<std::iterator_traits<std::vector<uint8_t>::iterator>::difference_type>(
-                            event_stream.tellg())),
-                    event_stream_as_string.end());
-            }
-
-            // encode the base frame
-            std::vector<uint8_t> png_bytes;
-            {
-                if (lodepng::encode(png_bytes, base_frame, header.width, header.height) != 0) {
-                    throw std::logic_error("encoding the base frame failed");
-                }
-            }
-
-            // render the HTML output
-            html::render(
-                sepia::filename_to_ofstream(command.arguments[1]),
-                nodes,
-                {
-                    {"title", html::variable("rainmaker")},
-                    {"x_max",
-                     html::variable(std::to_string(
-                         header.width > header.height ? 1.0 : static_cast<double>(header.width) / header.height))},
-                    {"y_max",
-                     html::variable(std::to_string(
-                         header.width > header.height ? static_cast<double>(header.height) / header.width : 1.0))},
-                    {"z_max", html::variable(std::to_string(1.0))},
-                    {"width", html::variable(std::to_string(header.width))},
-                    {"height", html::variable(std::to_string(header.height))},
-                    {"begin_t", html::variable(std::to_string(begin_t))},
-                    {"end_t", html::variable(std::to_string(end_t))},
-                    {"has_frames", html::variable(!frames.empty())},
-                    {"frametime", html::variable(std::to_string(frametime))},
-                    {"base_frame", html::variable(html::bytes_to_encoded_characters(png_bytes))},
-                    {"frames",
-                     html::variable(std::accumulate(
-                         frames.begin(),
-                         frames.end(),
-                         std::string(),
-                         [&](const std::string& frames_as_string, const std::vector<uint8_t>& frame) {
-                             std::vector<uint8_t> png_bytes;
-                             if (lodepng::encode(png_bytes, frame, header.width, header.height) != 0) {
-                                 throw std::logic_error("encoding a PNG frame failed");
-                             }
-                             return (frames_as_string.empty() ? std::string() : frames_as_string + ", ") + "'"
-                                    + html::bytes_to_encoded_characters(png_bytes) + "'";
-                         }))},
-                    {"events", html::variable(html::bytes_to_encoded_characters(events_bytes))},
-                    {"x3dom",
-                     html::variable(
-                         filename_to_string(sepia::join({sepia::dirname(SEPIA_DIRNAME), "third_party", "x3dom.js"})))},
-                });
-        });
+            // render the window
+            const auto written = render_window(
+                nodes, parameters, header, begin_t, end_t, events, base_frame, observable, command.arguments[1]);
+            session.events_in += written;
+            session.events_out += written;
+        }));
 }
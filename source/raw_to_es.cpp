@@ -0,0 +1,42 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "async.hpp"
+#include "evt.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {"raw_to_es converts a Prophesee raw file (EVT 2.0 or EVT 3.0) into an Event Stream file",
+         "Syntax: ./raw_to_es [options] /path/to/input.raw /path/to/output.es",
+         "    The string '-' (without quotes) can be used for the standard input and output",
+         "Available options:",
+         "    -p, --profile    prints a JSON profiling report on the standard error",
+         "    -h, --help       shows this help message"},
+        argc,
+        argv,
+        2,
+        {},
+        {{"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            io::check_different(
+                command.arguments[0],
+                command.arguments[1],
+                "The raw input and the Event Stream output must be different files");
+            auto& session = profile::current();
+            session.input(command.arguments[0]);
+            session.output(command.arguments[1]);
+            auto stream = async::make_prefetch(io::open_stream(command.arguments[0]));
+            const auto header = evt::read_header(*stream);
+            async::write_behind_ostream output(io::open_output(command.arguments[1]));
+            {
+                sepia::write_to_reference<sepia::type::dvs> write(output, header.width, header.height);
+                profile::scope scope("decode");
+                evt::observable(*stream, header, [&](sepia::dvs_event dvs_event) {
+                    ++session.events_out;
+                    write(dvs_event);
+                });
+            }
+            session.events_in = session.events_out;
+            output.close();
+        }));
+}
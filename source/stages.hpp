@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+
+namespace stages {
+    /// cut propagates only the events from the time range [begin, end[.
+    /// Events are sorted by timestamp, hence it throws sepia::end_of_file on the first event after the range,
+    /// which stops the observable without reading the rest of the file.
+    template <typename Event, typename HandleEvent>
+    class cut {
+        public:
+        cut(uint64_t begin, uint64_t end, HandleEvent handle_event) :
+            _begin(begin),
+            _end(end),
+            _handle_event(std::move(handle_event)) {}
+        cut(const cut&) = default;
+        cut(cut&&) = default;
+        cut& operator=(const cut&) = default;
+        cut& operator=(cut&&) = default;
+        virtual ~cut() {}
+
+        /// operator() handles an event.
+        virtual void operator()(Event event) {
+            if (event.t >= _begin) {
+                if (event.t < _end) {
+                    _handle_event(event);
+                } else {
+                    throw sepia::end_of_file();
+                }
+            }
+        }
+
+        protected:
+        uint64_t _begin;
+        uint64_t _end;
+        HandleEvent _handle_event;
+    };
+
+    /// make_cut creates a cut from a time range and a handler.
+    template <typename Event, typename HandleEvent>
+    inline cut<Event, HandleEvent> make_cut(uint64_t begin, uint64_t end, HandleEvent handle_event) {
+        return cut<Event, HandleEvent>(begin, end, std::move(handle_event));
+    }
+
+    /// crop propagates only the events from the region [left, left + width[ x [bottom, bottom + height[.
+    /// If keep_offset is false, the events coordinates are shifted so that the region's origin becomes (0, 0).
+    template <typename Event, typename HandleEvent>
+    class crop {
+        public:
+        crop(
+            uint16_t left,
+            uint16_t bottom,
+            uint16_t width,
+            uint16_t height,
+            bool keep_offset,
+            HandleEvent handle_event) :
+            _left(left),
+            _bottom(bottom),
+            _right(left + width),
+            _top(bottom + height),
+            _keep_offset(keep_offset),
+            _handle_event(std::move(handle_event)) {}
+        crop(const crop&) = default;
+        crop(crop&&) = default;
+        crop& operator=(const crop&) = default;
+        crop& operator=(crop&&) = default;
+        virtual ~crop() {}
+
+        /// operator() handles an event.
+        virtual void operator()(Event event) {
+            if (event.x >= _left && event.x < _right && event.y >= _bottom && event.y < _top) {
+                if (!_keep_offset) {
+                    event.x -= _left;
+                    event.y -= _bottom;
+                }
+                _handle_event(event);
+            }
+        }
+
+        protected:
+        uint16_t _left;
+        uint16_t _bottom;
+        uint16_t _right;
+        uint16_t _top;
+        bool _keep_offset;
+        HandleEvent _handle_event;
+    };
+
+    /// make_crop creates a crop from a region and a handler.
+    template <typename Event, typename HandleEvent>
+    inline crop<Event, HandleEvent> make_crop(
+        uint16_t left,
+        uint16_t bottom,
+        uint16_t width,
+        uint16_t height,
+        bool keep_offset,
+        HandleEvent handle_event) {
+        return crop<Event, HandleEvent>(left, bottom, width, height, keep_offset, std::move(handle_event));
+    }
+
+    /// string_to_keep_offset parses crop's offset argument.
+    inline bool string_to_keep_offset(const std::string& argument) {
+        if (argument == "true") {
+            return true;
+        }
+        if (argument == "false") {
+            return false;
+        }
+        throw std::runtime_error("Please specify if keeps offset (true) or not (false)");
+    }
+}
@@ -3,6 +3,10 @@
 #include "../third_party/tarsier/source/convert.hpp"
 #include "../third_party/tarsier/source/hash.hpp"
 #include "../third_party/tarsier/source/replicate.hpp"
+#include "follow.hpp"
+#include "io.hpp"
+#include "merkle.hpp"
+#include "profile.hpp"
 #include <iomanip>
 #include <sstream>
 
@@ -40,21 +44,355 @@ std::string properties_to_json(const std::vector<std::pair<std::string, std::str
     return json;
 }
 
+/// properties_to_json_line converts a list of properties to single-line JSON.
+std::string properties_to_json_line(const std::vector<std::pair<std::string, std::string>>& properties) {
+    std::string json("{");
+    for (std::size_t index = 0; index < properties.size(); ++index) {
+        json += std::string(index > 0 ? ", " : "") + "\"" + properties[index].first + "\": " + properties[index].second;
+    }
+    json += "}";
+    return json;
+}
+
+/// running_counts holds the properties which are known before the end of the stream.
+struct running_counts {
+    uint64_t begin_t;
+    uint64_t end_t;
+    uint64_t events;
+    uint64_t dvs_events;
+    uint64_t increase_events;
+    uint64_t second_events;
+};
+
+/// update_counts adds an event to running counts.
+void update_counts(running_counts& counts, const sepia::generic_event& generic_event) {
+    if (counts.events == 0) {
+        counts.begin_t = generic_event.t;
+    }
+    counts.end_t = generic_event.t;
+    ++counts.events;
+}
+void update_counts(running_counts& counts, sepia::dvs_event dvs_event) {
+    if (counts.events == 0) {
+        counts.begin_t = dvs_event.t;
+    }
+    counts.end_t = dvs_event.t;
+    ++counts.events;
+    if (dvs_event.is_increase) {
+        ++counts.increase_events;
+    }
+}
+void update_counts(running_counts& counts, sepia::atis_event atis_event) {
+    if (counts.events == 0) {
+        counts.begin_t = atis_event.t;
+    }
+    counts.end_t = atis_event.t;
+    ++counts.events;
+    if (!atis_event.is_threshold_crossing) {
+        ++counts.dvs_events;
+    }
+    if (atis_event.polarity) {
+        if (atis_event.is_threshold_crossing) {
+            ++counts.second_events;
+        } else {
+            ++counts.increase_events;
+        }
+    }
+}
+void update_counts(running_counts& counts, sepia::color_event color_event) {
+    if (counts.events == 0) {
+        counts.begin_t = color_event.t;
+    }
+    counts.end_t = color_event.t;
+    ++counts.events;
+}
+
+/// follow_to_properties prints the running properties of a file which is still being written,
+/// as one JSON line per interval (and a last line when the file ends).
+/// The counts are updated as the bytes arrive, hence the file is never read twice.
+template <sepia::type event_stream_type>
+void follow_to_properties(
+    follow::event_stream input,
+    std::chrono::milliseconds interval,
+    const std::vector<std::pair<std::string, std::string>>& header_properties) {
+    auto& session = profile::current();
+    const auto& file = *input.file;
+    running_counts counts{};
+    uint64_t previous_events = 0;
+    auto previous_tick = std::chrono::steady_clock::now();
+    profile::scope scope("decode");
+    follow::join_observable<event_stream_type>(
+        std::move(input),
+        interval,
+        [&](const sepia::event<event_stream_type>& event) { update_counts(counts, event); },
+        [&]() {
+            const auto now = std::chrono::steady_clock::now();
+            const auto elapsed = std::chrono::duration<double>(now - previous_tick).count();
+            auto properties = header_properties;
+            properties.emplace_back("size", std::to_string(file.offset()));
+            if (counts.events > 0) {
+                properties.emplace_back("begin_t", std::to_string(counts.begin_t));
+                properties.emplace_back("end_t", std::to_string(counts.end_t));
+            }
+            properties.emplace_back("events", std::to_string(counts.events));
+            if (event_stream_type == sepia::type::atis) {
+                properties.emplace_back("dvs_events", std::to_string(counts.dvs_events));
+            }
+            if (event_stream_type == sepia::type::dvs || event_stream_type == sepia::type::atis) {
+                properties.emplace_back("increase_events", std::to_string(counts.increase_events));
+            }
+            if (event_stream_type == sepia::type::atis) {
+                properties.emplace_back("second_events", std::to_string(counts.second_events));
+            }
+            properties.emplace_back(
+                "event_rate",
+                std::to_string(elapsed > 0 ? static_cast<double>(counts.events - previous_events) / elapsed : 0.0));
+            std::cout << properties_to_json_line(properties) << std::endl;
+            session.events_in = counts.events;
+            previous_events = counts.events;
+            previous_tick = now;
+        });
+}
+
+/// zone_maps_to_properties aggregates the zone maps of a blocked Event Stream.
+void zone_maps_to_properties(
+    std::istream& stream,
+    sepia::type event_stream_type,
+    std::vector<std::pair<std::string, std::string>>& properties) {
+    auto& session = profile::current();
+    blocked::zone_map total{};
+    auto first = true;
+    profile::scope scope("zone_maps");
+    blocked::observe_zone_maps(stream, [&](const blocked::zone_map& zone_map) {
+        if (first) {
+            first = false;
+            total.begin_t = zone_map.begin_t;
+        }
+        total.end_t = zone_map.end_t;
+        total.events += zone_map.events;
+        total.dvs_events += zone_map.dvs_events;
+        total.increase_events += zone_map.increase_events;
+        total.second_events += zone_map.second_events;
+    });
+    if (first) {
+        throw std::runtime_error("The blocked Event Stream does not contain events");
+    }
+    properties.emplace_back("begin_t", std::to_string(total.begin_t));
+    properties.emplace_back("end_t", std::to_string(total.end_t));
+    properties.emplace_back("events", std::to_string(total.events));
+    session.events_in = total.events;
+    if (event_stream_type == sepia::type::atis) {
+        properties.emplace_back("dvs_events", std::to_string(total.dvs_events));
+    }
+    if (event_stream_type == sepia::type::dvs || event_stream_type == sepia::type::atis) {
+        properties.emplace_back("increase_events", std::to_string(total.increase_events));
+    }
+    if (event_stream_type == sepia::type::atis) {
+        properties.emplace_back("second_events", std::to_string(total.second_events));
+    }
+}
+
+/// skip_bytes moves a stream forward, seeking if the stream supports it.
+void skip_bytes(std::istream& stream, uint64_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    if (stream.tellg() != std::istream::pos_type(-1)) {
+        stream.seekg(static_cast<std::istream::off_type>(bytes), std::istream::cur);
+        if (stream.good()) {
+            return;
+        }
+        stream.clear();
+    }
+    for (uint64_t remaining = bytes; remaining > 0;) {
+        const auto count = static_cast<std::streamsize>(
+            std::min(remaining, static_cast<uint64_t>(std::numeric_limits<std::streamsize>::max())));
+        stream.ignore(count);
+        if (stream.gcount() != count) {
+            throw std::runtime_error("The input is smaller than expected");
+        }
+        remaining -= static_cast<uint64_t>(count);
+    }
+}
+
+/// merkle_to_properties calculates the tree hash of the input's bytes.
+/// If a leaves file exists, the leaves of the complete chunks it describes are reused, so that only the bytes
+/// appended since are hashed. The last reused chunk is hashed again to detect a rewritten file, but the chunks
+/// before it are not re-verified (a range covering them does). With a range, only the chunks overlapping
+/// the range are hashed (up to the size described by the leaves file) and compared with the leaves file.
+void merkle_to_properties(
+    std::istream& stream,
+    const pontella::command& command,
+    std::vector<std::pair<std::string, std::string>>& properties) {
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    {
+        const auto name_and_argument = command.options.find("threads");
+        if (name_and_argument != command.options.end()) {
+            threads = std::stoull(name_and_argument->second);
+            if (threads == 0) {
+                throw std::runtime_error("[threads] must be strictly positive");
+            }
+        }
+    }
+    const auto leaves_and_filename = command.options.find("leaves");
+    uint64_t previous_size = 0;
+    std::vector<merkle::digest> leaves;
+    const auto has_leaves = leaves_and_filename != command.options.end()
+                            && merkle::read_leaves(leaves_and_filename->second, previous_size, leaves);
+    profile::scope scope("merkle");
+    const auto range_and_argument = command.options.find("range");
+    if (range_and_argument != command.options.end()) {
+        if (!has_leaves) {
+            throw std::runtime_error("The range option requires an existing leaves file");
+        }
+        const auto separator = range_and_argument->second.find(',');
+        if (separator == std::string::npos) {
+            throw std::runtime_error("[range] must have the format 'begin,end'");
+        }
+        const uint64_t begin = std::stoull(range_and_argument->second.substr(0, separator));
+        const uint64_t end = std::stoull(range_and_argument->second.substr(separator + 1));
+        if (begin >= end || end > previous_size) {
+            throw std::runtime_error("[range] must be a non-empty byte range within the leaves file's size");
+        }
+        const auto first_chunk = static_cast<std::size_t>(begin / merkle::chunk_size);
+        const auto last_chunk = static_cast<std::size_t>((end - 1) / merkle::chunk_size);
+        const auto first_byte = static_cast<uint64_t>(first_chunk) * merkle::chunk_size;
+        skip_bytes(stream, first_byte);
+        std::vector<merkle::digest> range_leaves;
+        merkle::hash_chunks(
+            stream,
+            threads,
+            std::min(static_cast<uint64_t>(last_chunk + 1) * merkle::chunk_size, previous_size) - first_byte,
+            range_leaves);
+        const auto is_valid = std::equal(range_leaves.begin(), range_leaves.end(), leaves.begin() + first_chunk)
+                              && range_leaves.size() == last_chunk - first_chunk + 1;
+        properties.emplace_back("merkle_chunk_size", std::to_string(merkle::chunk_size));
+        properties.emplace_back("merkle_chunks", std::to_string(leaves.size()));
+        properties.emplace_back("merkle_root", std::string("\"") + merkle::digest_to_hex(merkle::root(leaves)) + "\"");
+        properties.emplace_back("range_first_chunk", std::to_string(first_chunk));
+        properties.emplace_back("range_last_chunk", std::to_string(last_chunk));
+        properties.emplace_back("range_valid", is_valid ? "true" : "false");
+        return;
+    }
+    const auto reused_chunks = static_cast<std::size_t>(previous_size / merkle::chunk_size);
+    leaves.resize(reused_chunks);
+    if (reused_chunks > 0) {
+        skip_bytes(stream, static_cast<uint64_t>(reused_chunks - 1) * merkle::chunk_size);
+        std::vector<merkle::digest> last_leaf;
+        merkle::hash_chunks(stream, threads, merkle::chunk_size, last_leaf);
+        if (last_leaf.size() != 1 || last_leaf.front() != leaves.back()) {
+            throw std::runtime_error("The input's bytes differ from the stream described by the leaves file");
+        }
+    }
+    const auto size = static_cast<uint64_t>(reused_chunks) * merkle::chunk_size
+                      + merkle::hash_chunks(stream, threads, std::numeric_limits<uint64_t>::max(), leaves);
+    if (size < previous_size) {
+        throw std::runtime_error("The input is smaller than the stream described by the leaves file");
+    }
+    if (leaves_and_filename != command.options.end()) {
+        merkle::write_leaves(leaves_and_filename->second, size, leaves);
+    }
+    properties.emplace_back("size", std::to_string(size));
+    properties.emplace_back("merkle_chunk_size", std::to_string(merkle::chunk_size));
+    properties.emplace_back("merkle_chunks", std::to_string(leaves.size()));
+    if (has_leaves) {
+        properties.emplace_back("merkle_reused_chunks", std::to_string(reused_chunks));
+    }
+    properties.emplace_back("merkle_root", std::string("\"") + merkle::digest_to_hex(merkle::root(leaves)) + "\"");
+}
+
 int main(int argc, char* argv[]) {
     return pontella::main(
         {
             "statistics retrieves the event stream's properties and outputs them in JSON format.",
             "Syntax: ./statistics [options] /path/to/input.es",
+            "    The string '-' (without quotes) can be used for the standard input",
             "Available options:",
-            "    -h, --help    shows this help message",
+            "    -z, --zone-maps                      reads the properties of a blocked Event Stream",
+            "                                             from its zone maps, the payloads are not decoded,",
+            "                                             hence the hashes are not computed",
+            "    -m, --merkle                         replaces the event hashes with a tree hash",
+            "                                             of the file's bytes, calculated on all the cores",
+            "    -j [threads], --threads [threads]    sets the number of hashing threads for the tree hash",
+            "                                             defaults to the number of hardware threads",
+            "    -l [path], --leaves [path]           reads and writes the tree hash's leaves in a file,",
+            "                                             if the file exists, only the bytes appended since",
+            "                                             it was written are hashed (the last complete chunk",
+            "                                             is checked, the previous ones are not re-verified)",
+            "    -r [begin,end], --range [begin,end]  verifies the bytes [begin, end[ against the leaves file,",
+            "                                             without hashing the rest of the file",
+            "    -f, --follow                         follows a file which is still being written,",
+            "                                             and prints the running properties (without hashes)",
+            "                                             as a JSON line per interval",
+            "    -u [interval], --update [interval]   sets the interval between lines in follow mode",
+            "                                             (in milliseconds), defaults to 1000",
+            "    -i [duration], --idle [duration]     stops following once the file has not grown",
+            "                                             for [duration] (in milliseconds), defaults to 0",
+            "                                             (follows until interrupted)",
+            "    -p, --profile                        prints a JSON profiling report on the standard error",
+            "    -h, --help                           shows this help message",
         },
         argc,
         argv,
         1,
-        {},
-        {},
-        [](pontella::command command) {
-            const auto header = sepia::read_header(sepia::filename_to_ifstream(command.arguments[0]));
+        {
+            {"threads", {"j"}},
+            {"leaves", {"l"}},
+            {"range", {"r"}},
+            {"update", {"u"}},
+            {"idle", {"i"}},
+        },
+        {{"zone-maps", {"z"}}, {"merkle", {"m"}}, {"follow", {"f"}}, {"profile", {"p"}}},
+        profile::wrap([](pontella::command command) {
+            auto& session = profile::current();
+            session.input(command.arguments[0]);
+            const auto zone_maps = command.flags.find("zone-maps") != command.flags.end();
+            const auto tree_hash = command.flags.find("merkle") != command.flags.end();
+            if (zone_maps && tree_hash) {
+                throw std::runtime_error("The zone-maps and merkle options cannot be combined");
+            }
+            if (command.flags.find("follow") != command.flags.end()) {
+                if (zone_maps || tree_hash) {
+                    throw std::runtime_error("The follow option cannot be combined with zone-maps or merkle");
+                }
+                if (io::is_standard(command.arguments[0])) {
+                    throw std::runtime_error("The follow option requires a file");
+                }
+                const auto interval = follow::parse_milliseconds(command, "update", std::chrono::milliseconds(1000));
+                if (interval.count() == 0) {
+                    throw std::runtime_error("[interval] must be strictly positive");
+                }
+                follow::handle_signals();
+                auto input = follow::open_event_stream(
+                    command.arguments[0], follow::parse_milliseconds(command, "idle", std::chrono::milliseconds(0)));
+                std::vector<std::pair<std::string, std::string>> properties{
+                    {"type", std::string("\"") + type_to_string(input.header.event_stream_type) + "\""},
+                };
+                if (input.header.event_stream_type != sepia::type::generic) {
+                    properties.emplace_back("width", std::to_string(input.header.width));
+                    properties.emplace_back("height", std::to_string(input.header.height));
+                }
+                switch (input.header.event_stream_type) {
+                    case sepia::type::generic:
+                        follow_to_properties<sepia::type::generic>(std::move(input), interval, properties);
+                        break;
+                    case sepia::type::dvs:
+                        follow_to_properties<sepia::type::dvs>(std::move(input), interval, properties);
+                        break;
+                    case sepia::type::atis:
+                        follow_to_properties<sepia::type::atis>(std::move(input), interval, properties);
+                        break;
+                    case sepia::type::color:
+                        follow_to_properties<sepia::type::color>(std::move(input), interval, properties);
+                        break;
+                }
+                return;
+            }
+            auto input = io::open_event_stream(command.arguments[0], zone_maps || tree_hash);
+            if (zone_maps && !input.is_blocked) {
+                throw std::runtime_error("The zone-maps option requires a blocked Event Stream");
+            }
+            const auto header = input.header;
             std::vector<std::pair<std::string, std::string>> properties{
                 {"version",
                  std::string("\"") + std::to_string(static_cast<uint32_t>(std::get<0>(header.version))) + "."
@@ -66,6 +404,16 @@ int main(int argc, char* argv[]) {
                 properties.emplace_back("width", std::to_string(header.width));
                 properties.emplace_back("height", std::to_string(header.height));
             }
+            if (tree_hash) {
+                merkle_to_properties(*input.stream, command, properties);
+                std::cout << properties_to_json(properties) << std::endl;
+                return;
+            }
+            if (zone_maps) {
+                zone_maps_to_properties(*input.stream, header.event_stream_type, properties);
+                std::cout << properties_to_json(properties) << std::endl;
+                return;
+            }
             switch (header.event_stream_type) {
                 case sepia::type::generic: {
                     auto first = true;
@@ -75,10 +423,11 @@ int main(int argc, char* argv[]) {
                     std::string t_hash;
                     std::string bytes_hash;
                     {
+                        profile::scope scope("decode");
                         auto hash = tarsier::make_hash<uint8_t>(
                             [&](std::pair<uint64_t, uint64_t> hash_value) { bytes_hash = hash_to_string(hash_value); });
                         sepia::join_observable<sepia::type::generic>(
-                            sepia::filename_to_ifstream(command.arguments[0]),
+                            std::move(input.stream),
                             tarsier::make_replicate<sepia::generic_event>(
                                 [&](sepia::generic_event generic_event) {
                                     if (first) {
@@ -91,15 +440,18 @@ int main(int argc, char* argv[]) {
                                         hash(character);
                                     }
                                 },
-                                tarsier::make_convert<sepia::generic_event>(
-                                    [](sepia::generic_event generic_event) -> uint64_t { return generic_event.t; },
-                                    tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                        t_hash = hash_to_string(hash_value);
-                                    }))));
+                                profile::make_sampled<sepia::generic_event>(
+                                    "t_hash",
+                                    tarsier::make_convert<sepia::generic_event>(
+                                        [](sepia::generic_event generic_event) -> uint64_t { return generic_event.t; },
+                                        tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                            t_hash = hash_to_string(hash_value);
+                                        })))));
                     }
                     properties.emplace_back("begin_t", std::to_string(begin_t));
                     properties.emplace_back("end_t", std::to_string(end_t));
                     properties.emplace_back("events", std::to_string(events));
+                    session.events_in = events;
                     properties.emplace_back("t_hash", t_hash);
                     properties.emplace_back("bytes_hash", bytes_hash);
                     std::cout << properties_to_json(properties) << std::endl;
@@ -114,8 +466,9 @@ int main(int argc, char* argv[]) {
                     std::string t_hash;
                     std::string x_hash;
                     std::string y_hash;
+                    profile::scope scope("decode");
                     sepia::join_observable<sepia::type::dvs>(
-                        sepia::filename_to_ifstream(command.arguments[0]),
+                        std::move(input.stream),
                         tarsier::make_replicate<sepia::dvs_event>(
                             [&](sepia::dvs_event dvs_event) {
                                 if (first) {
@@ -128,24 +481,31 @@ int main(int argc, char* argv[]) {
                                     ++increase_events;
                                 }
                             },
-                            tarsier::make_convert<sepia::dvs_event>(
-                                [](sepia::dvs_event dvs_event) -> uint64_t { return dvs_event.t; },
-                                tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    t_hash = hash_to_string(hash_value);
-                                })),
-                            tarsier::make_convert<sepia::dvs_event>(
-                                [](sepia::dvs_event dvs_event) -> uint16_t { return dvs_event.x; },
-                                tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    x_hash = hash_to_string(hash_value);
-                                })),
-                            tarsier::make_convert<sepia::dvs_event>(
-                                [](sepia::dvs_event dvs_event) -> uint16_t { return dvs_event.y; },
-                                tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    y_hash = hash_to_string(hash_value);
-                                }))));
+                            profile::make_sampled<sepia::dvs_event>(
+                                "t_hash",
+                                tarsier::make_convert<sepia::dvs_event>(
+                                    [](sepia::dvs_event dvs_event) -> uint64_t { return dvs_event.t; },
+                                    tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        t_hash = hash_to_string(hash_value);
+                                    }))),
+                            profile::make_sampled<sepia::dvs_event>(
+                                "x_hash",
+                                tarsier::make_convert<sepia::dvs_event>(
+                                    [](sepia::dvs_event dvs_event) -> uint16_t { return dvs_event.x; },
+                                    tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        x_hash = hash_to_string(hash_value);
+                                    }))),
+                            profile::make_sampled<sepia::dvs_event>(
+                                "y_hash",
+                                tarsier::make_convert<sepia::dvs_event>(
+                                    [](sepia::dvs_event dvs_event) -> uint16_t { return dvs_event.y; },
+                                    tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        y_hash = hash_to_string(hash_value);
+                                    })))));
                     properties.emplace_back("begin_t", std::to_string(begin_t));
                     properties.emplace_back("end_t", std::to_string(end_t));
                     properties.emplace_back("events", std::to_string(events));
+                    session.events_in = events;
                     properties.emplace_back("increase_events", std::to_string(increase_events));
                     properties.emplace_back("t_hash", t_hash);
                     properties.emplace_back("x_hash", x_hash);
@@ -164,8 +524,9 @@ int main(int argc, char* argv[]) {
                     std::string t_hash;
                     std::string x_hash;
                     std::string y_hash;
+                    profile::scope scope("decode");
                     sepia::join_observable<sepia::type::atis>(
-                        sepia::filename_to_ifstream(command.arguments[0]),
+                        std::move(input.stream),
                         tarsier::make_replicate<sepia::atis_event>(
                             [&](sepia::atis_event atis_event) {
                                 if (first) {
@@ -185,24 +546,31 @@ int main(int argc, char* argv[]) {
                                     }
                                 }
                             },
-                            tarsier::make_convert<sepia::atis_event>(
-                                [](sepia::atis_event atis_event) -> uint64_t { return atis_event.t; },
-                                tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    t_hash = hash_to_string(hash_value);
-                                })),
-                            tarsier::make_convert<sepia::atis_event>(
-                                [](sepia::atis_event atis_event) -> uint16_t { return atis_event.x; },
-                                tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    x_hash = hash_to_string(hash_value);
-                                })),
-                            tarsier::make_convert<sepia::atis_event>(
-                                [](sepia::atis_event atis_event) -> uint16_t { return atis_event.y; },
-                                tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    y_hash = hash_to_string(hash_value);
-                                }))));
+                            profile::make_sampled<sepia::atis_event>(
+                                "t_hash",
+                                tarsier::make_convert<sepia::atis_event>(
+                                    [](sepia::atis_event atis_event) -> uint64_t { return atis_event.t; },
+                                    tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        t_hash = hash_to_string(hash_value);
+                                    }))),
+                            profile::make_sampled<sepia::atis_event>(
+                                "x_hash",
+                                tarsier::make_convert<sepia::atis_event>(
+                                    [](sepia::atis_event atis_event) -> uint16_t { return atis_event.x; },
+                                    tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        x_hash = hash_to_string(hash_value);
+                                    }))),
+                            profile::make_sampled<sepia::atis_event>(
+                                "y_hash",
+                                tarsier::make_convert<sepia::atis_event>(
+                                    [](sepia::atis_event atis_event) -> uint16_t { return atis_event.y; },
+                                    tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        y_hash = hash_to_string(hash_value);
+                                    })))));
                     properties.emplace_back("begin_t", std::to_string(begin_t));
                     properties.emplace_back("end_t", std::to_string(end_t));
                     properties.emplace_back("events", std::to_string(events));
+                    session.events_in = events;
                     properties.emplace_back("dvs_events", std::to_string(dvs_events));
                     properties.emplace_back("increase_events", std::to_string(increase_events));
                     properties.emplace_back("second_events", std::to_string(second_events));
@@ -224,8 +592,9 @@ int main(int argc, char* argv[]) {
                     std::string r_hash;
                     std::string g_hash;
                     std::string b_hash;
+                    profile::scope scope("decode");
                     sepia::join_observable<sepia::type::color>(
-                        sepia::filename_to_ifstream(command.arguments[0]),
+                        std::move(input.stream),
                         tarsier::make_replicate<sepia::color_event>(
                             [&](sepia::color_event color_event) {
                                 if (first) {
@@ -235,39 +604,52 @@ int main(int argc, char* argv[]) {
                                 end_t = color_event.t;
                                 ++events;
                             },
-                            tarsier::make_convert<sepia::color_event>(
-                                [](sepia::color_event color_event) -> uint64_t { return color_event.t; },
-                                tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    t_hash = hash_to_string(hash_value);
-                                })),
-                            tarsier::make_convert<sepia::color_event>(
-                                [](sepia::color_event color_event) -> uint16_t { return color_event.x; },
-                                tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    x_hash = hash_to_string(hash_value);
-                                })),
-                            tarsier::make_convert<sepia::color_event>(
-                                [](sepia::color_event color_event) -> uint16_t { return color_event.y; },
-                                tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    y_hash = hash_to_string(hash_value);
-                                })),
-                            tarsier::make_convert<sepia::color_event>(
-                                [](sepia::color_event color_event) -> uint8_t { return color_event.r; },
-                                tarsier::make_hash<uint8_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    r_hash = hash_to_string(hash_value);
-                                })),
-                            tarsier::make_convert<sepia::color_event>(
-                                [](sepia::color_event color_event) -> uint8_t { return color_event.g; },
-                                tarsier::make_hash<uint8_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    g_hash = hash_to_string(hash_value);
-                                })),
-                            tarsier::make_convert<sepia::color_event>(
-                                [](sepia::color_event color_event) -> uint8_t { return color_event.b; },
-                                tarsier::make_hash<uint8_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
-                                    b_hash = hash_to_string(hash_value);
-                                }))));
+                            profile::make_sampled<sepia::color_event>(
+                                "t_hash",
+                                tarsier::make_convert<sepia::color_event>(
+                                    [](sepia::color_event color_event) -> uint64_t { return color_event.t; },
+                                    tarsier::make_hash<uint64_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        t_hash = hash_to_string(hash_value);
+                                    }))),
+                            profile::make_sampled<sepia::color_event>(
+                                "x_hash",
+                                tarsier::make_convert<sepia::color_event>(
+                                    [](sepia::color_event color_event) -> uint16_t { return color_event.x; },
+                                    tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        x_hash = hash_to_string(hash_value);
+                                    }))),
+                            profile::make_sampled<sepia::color_event>(
+                                "y_hash",
+                                tarsier::make_convert<sepia::color_event>(
+                                    [](sepia::color_event color_event) -> uint16_t { return color_event.y; },
+                                    tarsier::make_hash<uint16_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        y_hash = hash_to_string(hash_value);
+                                    }))),
+                            profile::make_sampled<sepia::color_event>(
+                                "r_hash",
+                                tarsier::make_convert<sepia::color_event>(
+                                    [](sepia::color_event color_event) -> uint8_t { return color_event.r; },
+                                    tarsier::make_hash<uint8_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        r_hash = hash_to_string(hash_value);
+                                    }))),
+                            profile::make_sampled<sepia::color_event>(
+                                "g_hash",
+                                tarsier::make_convert<sepia::color_event>(
+                                    [](sepia::color_event color_event) -> uint8_t { return color_event.g; },
+                                    tarsier::make_hash<uint8_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        g_hash = hash_to_string(hash_value);
+                                    }))),
+                            profile::make_sampled<sepia::color_event>(
+                                "b_hash",
+                                tarsier::make_convert<sepia::color_event>(
+                                    [](sepia::color_event color_event) -> uint8_t { return color_event.b; },
+                                    tarsier::make_hash<uint8_t>([&](std::pair<uint64_t, uint64_t> hash_value) {
+                                        b_hash = hash_to_string(hash_value);
+                                    })))));
                     properties.emplace_back("begin_t", std::to_string(begin_t));
                     properties.emplace_back("end_t", std::to_string(end_t));
                     properties.emplace_back("events", std::to_string(events));
+                    session.events_in = events;
                     properties.emplace_back("t_hash", t_hash);
                     properties.emplace_back("x_hash", x_hash);
                     properties.emplace_back("y_hash", y_hash);
@@ -278,6 +660,6 @@ int main(int argc, char* argv[]) {
                     break;
                 }
             }
-        });
+        }));
     return 0;
 }
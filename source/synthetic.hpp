@@ -0,0 +1,299 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+#include <cmath>
+#include <queue>
+
+namespace synthetic {
+    /// random is a splitmix64 pseudo-random generator.
+    /// Unlike the standard library distributions, its output does not depend on the platform,
+    /// hence a given seed always yields the same recording.
+    class random {
+        public:
+        random(uint64_t seed) : _state(seed) {}
+        random(const random&) = default;
+        random(random&&) = default;
+        random& operator=(const random&) = default;
+        random& operator=(random&&) = default;
+        virtual ~random() {}
+
+        /// operator() returns 64 random bits.
+        virtual uint64_t operator()() {
+            _state += 0x9e3779b97f4a7c15ull;
+            auto value = _state;
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+            return value ^ (value >> 31);
+        }
+
+        /// below returns an integer in the range [0, maximum[.
+        virtual uint64_t below(uint64_t maximum) {
+            return (*this)() % maximum;
+        }
+
+        /// real returns a real number in the range [0, 1[.
+        virtual double real() {
+            return static_cast<double>((*this)() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        /// exponential returns a real number drawn from an exponential distribution with the given rate.
+        virtual double exponential(double rate) {
+            return -std::log(1.0 - real()) / rate;
+        }
+
+        protected:
+        uint64_t _state;
+    };
+
+    /// make_event creates an event at the given timestamp with random content.
+    template <sepia::type event_stream_type>
+    inline sepia::event<event_stream_type> make_event(random& random, uint64_t t, uint16_t width, uint16_t height);
+    template <>
+    inline sepia::generic_event make_event<sepia::type::generic>(random& random, uint64_t t, uint16_t, uint16_t) {
+        sepia::generic_event generic_event{t, std::vector<uint8_t>(1 + random.below(8))};
+        for (auto& byte : generic_event.bytes) {
+            byte = static_cast<uint8_t>(random.below(256));
+        }
+        return generic_event;
+    }
+    template <>
+    inline sepia::dvs_event make_event<sepia::type::dvs>(random& random, uint64_t t, uint16_t width, uint16_t height) {
+        const auto x = static_cast<uint16_t>(random.below(width));
+        const auto y = static_cast<uint16_t>(random.below(height));
+        return {t, x, y, random.below(2) == 1};
+    }
+    template <>
+    inline sepia::atis_event
+    make_event<sepia::type::atis>(random& random, uint64_t t, uint16_t width, uint16_t height) {
+        const auto x = static_cast<uint16_t>(random.below(width));
+        const auto y = static_cast<uint16_t>(random.below(height));
+        const auto bits = random.below(4);
+        return {t, x, y, (bits & 1) == 1, (bits & 0b10) == 0b10};
+    }
+    template <>
+    inline sepia::color_event
+    make_event<sepia::type::color>(random& random, uint64_t t, uint16_t width, uint16_t height) {
+        const auto x = static_cast<uint16_t>(random.below(width));
+        const auto y = static_cast<uint16_t>(random.below(height));
+        const auto rgb = random();
+        return {t,
+                x,
+                y,
+                static_cast<uint8_t>(rgb & 0xff),
+                static_cast<uint8_t>((rgb >> 8) & 0xff),
+                static_cast<uint8_t>((rgb >> 16) & 0xff)};
+    }
+
+    /// poisson dispatches uniformly distributed events with Poisson arrival times.
+    /// rate is expressed in events per microsecond.
+    template <sepia::type event_stream_type, typename HandleEvent>
+    inline void poisson(
+        uint64_t number_of_events,
+        uint16_t width,
+        uint16_t height,
+        double rate,
+        uint64_t seed,
+        HandleEvent handle_event) {
+        random generator(seed);
+        auto t = 0.0;
+        for (uint64_t index = 0; index < number_of_events; ++index) {
+            t += generator.exponential(rate);
+            handle_event(make_event<event_stream_type>(generator, static_cast<uint64_t>(t), width, height));
+        }
+    }
+
+    /// model enumerates the available workload models.
+    enum class model {
+        poisson,
+        edge,
+        hot_pixels,
+        burst,
+    };
+
+    /// string_to_model parses a model name.
+    inline model string_to_model(const std::string& name) {
+        if (name == "poisson") {
+            return model::poisson;
+        }
+        if (name == "edge") {
+            return model::edge;
+        }
+        if (name == "hot_pixels") {
+            return model::hot_pixels;
+        }
+        if (name == "burst") {
+            return model::burst;
+        }
+        throw std::runtime_error("unknown model '" + name + "' (expected poisson, edge, hot_pixels or burst)");
+    }
+
+    /// scene holds the parameters shared by every chunk of a recording.
+    struct scene {
+        model workload;
+        uint16_t width;
+        uint16_t height;
+        double rate;
+        uint64_t seed;
+        std::vector<std::pair<uint16_t, uint16_t>> hot_pixels;
+    };
+
+    /// make_scene creates a scene, the rate is expressed in events per microsecond.
+    /// The hot pixels (one per thousand pixels) only depend on the seed.
+    inline scene make_scene(model workload, uint16_t width, uint16_t height, double rate, uint64_t seed) {
+        scene result{workload, width, height, rate, seed, {}};
+        if (workload == model::hot_pixels) {
+            random generator(seed ^ 0x5bd1e9955bd1e995ull);
+            result.hot_pixels.resize(
+                std::max(static_cast<std::size_t>(1), width * static_cast<std::size_t>(height) / 1000));
+            for (auto& hot_pixel : result.hot_pixels) {
+                hot_pixel.first = static_cast<uint16_t>(generator.below(width));
+                hot_pixel.second = static_cast<uint16_t>(generator.below(height));
+            }
+        }
+        return result;
+    }
+
+    /// chunk_seed derives an independent seed for each chunk.
+    /// Chunks can be generated in any order, hence the output does not depend on the number of threads.
+    inline uint64_t chunk_seed(uint64_t seed, uint64_t chunk_index) {
+        random generator(seed ^ (chunk_index * 0xd1b54a32d192ed03ull));
+        return generator();
+    }
+
+    /// edge_period is the time (in microseconds) taken by the edge to cross the sensor.
+    constexpr uint64_t edge_period = 1000000;
+
+    /// burst_period is the time (in microseconds) between the beginning of two bursts.
+    constexpr uint64_t burst_period = 100000;
+
+    /// burst_duration is the duration (in microseconds) of a burst.
+    constexpr uint64_t burst_duration = 10000;
+
+    /// burst_factor is the ratio between the rate during a burst and the quiet rate.
+    constexpr double burst_factor = 10.0;
+
+    /// generate_td dispatches polarized events in the range [begin_t, end_t[ following the scene's model.
+    /// The average rate is the scene's rate for every model.
+    template <typename HandleEvent>
+    inline void
+    generate_td(const scene& scene, random& generator, uint64_t begin_t, uint64_t end_t, HandleEvent handle_event) {
+        const auto quiet_rate = scene.rate * burst_period
+                                / (burst_duration * burst_factor + (burst_period - burst_duration));
+        const auto maximum_rate = scene.workload == model::burst ? quiet_rate * burst_factor : scene.rate;
+        auto t = static_cast<double>(begin_t);
+        for (;;) {
+            t += generator.exponential(maximum_rate);
+            if (t >= static_cast<double>(end_t)) {
+                break;
+            }
+            const auto integer_t = static_cast<uint64_t>(t);
+            switch (scene.workload) {
+                case model::poisson:
+                    break;
+                case model::edge: {
+                    const auto position = static_cast<double>(integer_t % edge_period) / edge_period * scene.width;
+                    const auto offset = (generator.real() + generator.real() + generator.real() - 1.5) * 4.0;
+                    const auto x = position + offset;
+                    if (x >= 0 && x < scene.width) {
+                        handle_event(sepia::dvs_event{integer_t,
+                                                      static_cast<uint16_t>(x),
+                                                      static_cast<uint16_t>(generator.below(scene.height)),
+                                                      offset >= 0});
+                    }
+                    continue;
+                }
+                case model::hot_pixels:
+                    if (generator.below(2) == 0) {
+                        const auto& hot_pixel = scene.hot_pixels[generator.below(scene.hot_pixels.size())];
+                        handle_event(
+                            sepia::dvs_event{integer_t, hot_pixel.first, hot_pixel.second, generator.below(2) == 1});
+                        continue;
+                    }
+                    break;
+                case model::burst:
+                    if (integer_t % burst_period >= burst_duration && generator.real() * burst_factor >= 1.0) {
+                        continue;
+                    }
+                    break;
+            }
+            handle_event(make_event<sepia::type::dvs>(generator, integer_t, scene.width, scene.height));
+        }
+    }
+
+    /// exposure_delta_t returns a plausible exposure measurement duration (in microseconds) for the given pixel.
+    /// Each pixel has a stable intensity, log-uniformly distributed between 100 us and 100 ms, jittered by 10 %.
+    inline uint64_t exposure_delta_t(const scene& scene, random& generator, uint16_t x, uint16_t y) {
+        random pixel_generator(scene.seed ^ ((static_cast<uint64_t>(x) << 16 | y) * 0x9e3779b97f4a7c15ull));
+        return static_cast<uint64_t>(
+            100.0 * std::pow(1000.0, pixel_generator.real()) * (0.9 + 0.2 * generator.real()));
+    }
+
+    /// workload generates a chunk of events of the given type.
+    template <sepia::type event_stream_type>
+    struct workload;
+    template <>
+    struct workload<sepia::type::generic> {
+        template <typename HandleEvent>
+        static void
+        generate(const scene& scene, random& generator, uint64_t begin_t, uint64_t end_t, HandleEvent handle_event) {
+            generate_td(scene, generator, begin_t, end_t, [&](sepia::dvs_event dvs_event) {
+                handle_event(make_event<sepia::type::generic>(generator, dvs_event.t, scene.width, scene.height));
+            });
+        }
+    };
+    template <>
+    struct workload<sepia::type::dvs> {
+        template <typename HandleEvent>
+        static void
+        generate(const scene& scene, random& generator, uint64_t begin_t, uint64_t end_t, HandleEvent handle_event) {
+            generate_td(scene, generator, begin_t, end_t, handle_event);
+        }
+    };
+    template <>
+    struct workload<sepia::type::atis> {
+        /// generate dispatches TD events, each followed by an exposure measurement (a pair of threshold crossings).
+        /// Measurements which would end after end_t are skipped, so that chunks do not overlap.
+        template <typename HandleEvent>
+        static void
+        generate(const scene& scene, random& generator, uint64_t begin_t, uint64_t end_t, HandleEvent handle_event) {
+            auto later = [](sepia::atis_event first, sepia::atis_event second) { return first.t > second.t; };
+            std::priority_queue<sepia::atis_event, std::vector<sepia::atis_event>, decltype(later)> second_crossings(
+                later);
+            generate_td(scene, generator, begin_t, end_t, [&](sepia::dvs_event dvs_event) {
+                while (!second_crossings.empty() && second_crossings.top().t <= dvs_event.t) {
+                    handle_event(second_crossings.top());
+                    second_crossings.pop();
+                }
+                handle_event(sepia::atis_event{dvs_event.t, dvs_event.x, dvs_event.y, false, dvs_event.is_increase});
+                const auto delta_t = exposure_delta_t(scene, generator, dvs_event.x, dvs_event.y);
+                if (dvs_event.t + delta_t < end_t) {
+                    handle_event(sepia::atis_event{dvs_event.t, dvs_event.x, dvs_event.y, true, false});
+                    second_crossings.push(
+                        sepia::atis_event{dvs_event.t + delta_t, dvs_event.x, dvs_event.y, true, true});
+                }
+            });
+            while (!second_crossings.empty()) {
+                handle_event(second_crossings.top());
+                second_crossings.pop();
+            }
+        }
+    };
+    template <>
+    struct workload<sepia::type::color> {
+        /// generate dispatches color events, bright for increases and dark for decreases.
+        template <typename HandleEvent>
+        static void
+        generate(const scene& scene, random& generator, uint64_t begin_t, uint64_t end_t, HandleEvent handle_event) {
+            generate_td(scene, generator, begin_t, end_t, [&](sepia::dvs_event dvs_event) {
+                const auto rgb = generator();
+                const auto base = dvs_event.is_increase ? 128 : 0;
+                handle_event(sepia::color_event{dvs_event.t,
+                                                dvs_event.x,
+                                                dvs_event.y,
+                                                static_cast<uint8_t>(base + (rgb & 0x7f)),
+                                                static_cast<uint8_t>(base + ((rgb >> 8) & 0x7f)),
+                                                static_cast<uint8_t>(base + ((rgb >> 16) & 0x7f))});
+            });
+        }
+    };
+}
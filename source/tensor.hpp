@@ -0,0 +1,300 @@
+#pragma once
+
+#include "../third_party/sepia/source/sepia.hpp"
+#include "async.hpp"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <numeric>
+#include <sstream>
+
+/// tensor converts windows of change detections to dense tensors for machine learning pipelines,
+/// and writes them in NumPy's .npy format (which numpy.load can memory-map).
+/// A voxel grid spreads each event over the two nearest time bins (linear interpolation in time),
+/// and a histogram counts the events per pixel and polarity.
+/// Voxel grids have the shape (bins, 2, height, width) and histograms the shape (2, height, width).
+/// The polarity axis lists decreases first, and rows use a top-left origin (as images).
+namespace tensor {
+    /// representation enumerates the tensor layouts.
+    enum class representation {
+        voxel_grid,
+        histogram,
+    };
+
+    /// dtype enumerates the value types.
+    enum class dtype {
+        float32,
+        float16,
+    };
+
+    /// parameters bundles the properties shared by the tensors of a recording.
+    struct parameters {
+        uint16_t width;
+        uint16_t height;
+        tensor::representation representation;
+        uint64_t bins;
+        uint64_t duration;
+        tensor::dtype dtype;
+
+        /// channels returns the number of values per pixel.
+        std::size_t channels() const {
+            return representation == tensor::representation::voxel_grid ? static_cast<std::size_t>(bins) * 2 : 2;
+        }
+
+        /// size returns the number of values in a tensor.
+        std::size_t size() const {
+            return static_cast<std::size_t>(width) * height * channels();
+        }
+
+        /// bytes_per_value returns the size of a value in bytes.
+        std::size_t bytes_per_value() const {
+            return dtype == tensor::dtype::float32 ? 4 : 2;
+        }
+
+        /// shape returns the tensor's dimensions, from the slowest to the fastest varying.
+        std::vector<uint64_t> shape() const {
+            if (representation == tensor::representation::voxel_grid) {
+                return {bins, 2, height, width};
+            }
+            return {2, height, width};
+        }
+    };
+
+    /// accumulate adds events to an accumulator, given the beginning of their window.
+    /// The accumulator interleaves the channels (the values of a pixel are contiguous),
+    /// so that the two bins updated by an event share a cache line. encode converts it to the planar layout.
+    /// The accumulator must hold parameters.size() values, and is not cleared.
+    template <typename Iterator>
+    inline void accumulate(
+        const tensor::parameters& parameters,
+        uint64_t begin_t,
+        Iterator first,
+        Iterator last,
+        std::vector<float>& accumulator) {
+        const auto channels = parameters.channels();
+        const auto scale = parameters.bins > 1 ? static_cast<double>(parameters.bins - 1) / parameters.duration : 0.0;
+        for (; first != last; ++first) {
+            const sepia::dvs_event& dvs_event = *first;
+            auto values = accumulator.data()
+                          + (static_cast<std::size_t>(dvs_event.x)
+                             + static_cast<std::size_t>(parameters.width) * (parameters.height - 1 - dvs_event.y))
+                                * channels
+                          + (dvs_event.is_increase ? 1 : 0);
+            if (parameters.representation == representation::histogram) {
+                values[0] += 1.0f;
+            } else {
+                const auto position = static_cast<double>(dvs_event.t - begin_t) * scale;
+                const auto lower = static_cast<std::size_t>(position);
+                const auto weight = static_cast<float>(position - static_cast<double>(lower));
+                values[lower * 2] += 1.0f - weight;
+                if (lower + 1 < parameters.bins) {
+                    values[(lower + 1) * 2] += weight;
+                }
+            }
+        }
+    }
+
+    /// float_to_half converts a float to IEEE 754 half precision.
+    /// Values are rounded to the nearest even, overflows become infinities and underflows zeros.
+    inline uint16_t float_to_half(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        const auto exponent = static_cast<int32_t>((bits >> 23) & 0xff);
+        auto mantissa = bits & 0x7fffff;
+        if (exponent == 0xff) {
+            return sign | 0x7c00 | (mantissa == 0 ? 0 : 0x200);
+        }
+        const auto half_exponent = exponent - 127 + 15;
+        if (half_exponent >= 31) {
+            return sign | 0x7c00;
+        }
+        uint32_t shift = 13;
+        uint32_t result = 0;
+        if (half_exponent <= 0) {
+            if (half_exponent < -10) {
+                return sign;
+            }
+            mantissa |= 0x800000;
+            shift = static_cast<uint32_t>(14 - half_exponent);
+        } else {
+            result = static_cast<uint32_t>(half_exponent) << 10;
+        }
+        result |= mantissa >> shift;
+        const auto remainder = mantissa & ((1u << shift) - 1);
+        const auto halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (result & 1) == 1)) {
+            ++result; // a carry moves to the exponent, which yields the correct value (or an infinity)
+        }
+        return static_cast<uint16_t>(sign | result);
+    }
+
+    /// encode converts an interleaved accumulator to the planar tensor layout, with little-endian values.
+    inline void
+    encode(const tensor::parameters& parameters, const std::vector<float>& accumulator, std::string& bytes) {
+        const auto channels = parameters.channels();
+        const auto pixels = static_cast<std::size_t>(parameters.width) * parameters.height;
+        bytes.resize(parameters.size() * parameters.bytes_per_value());
+        auto output = reinterpret_cast<uint8_t*>(&bytes[0]);
+        for (std::size_t channel = 0; channel < channels; ++channel) {
+            for (std::size_t pixel = 0; pixel < pixels; ++pixel) {
+                const auto value = accumulator[pixel * channels + channel];
+                if (parameters.dtype == dtype::float32) {
+                    uint32_t bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    output[0] = static_cast<uint8_t>(bits & 0xff);
+                    output[1] = static_cast<uint8_t>((bits >> 8) & 0xff);
+                    output[2] = static_cast<uint8_t>((bits >> 16) & 0xff);
+                    output[3] = static_cast<uint8_t>((bits >> 24) & 0xff);
+                    output += 4;
+                } else {
+                    const auto half = float_to_half(value);
+                    output[0] = static_cast<uint8_t>(half & 0xff);
+                    output[1] = static_cast<uint8_t>((half >> 8) & 0xff);
+                    output += 2;
+                }
+            }
+        }
+    }
+
+    /// npy_header returns the header of a C-ordered .npy array (format version 1.0).
+    /// The header is padded with spaces to at least minimum_size bytes (and to a multiple of 64),
+    /// so that it can be rewritten in place once the number of tensors is known.
+    inline std::string npy_header(tensor::dtype dtype, const std::vector<uint64_t>& shape, std::size_t minimum_size) {
+        std::stringstream dictionary;
+        dictionary << "{'descr': '" << (dtype == tensor::dtype::float32 ? "<f4" : "<f2")
+                   << "', 'fortran_order': False, 'shape': (";
+        for (std::size_t index = 0; index < shape.size(); ++index) {
+            dictionary << (index > 0 ? ", " : "") << shape[index];
+        }
+        dictionary << (shape.size() == 1 ? ",), }" : "), }");
+        auto text = dictionary.str();
+        auto size = std::max(static_cast<std::size_t>(10) + text.size() + 1, minimum_size);
+        size = (size + 63) / 64 * 64;
+        text.append(size - 10 - 1 - text.size(), ' ');
+        text.push_back('\n');
+        std::string header("\x93NUMPY\x01\x00", 8);
+        header.push_back(static_cast<char>(text.size() & 0xff));
+        header.push_back(static_cast<char>((text.size() >> 8) & 0xff));
+        return header + text;
+    }
+
+    /// windows buffers the change detections of the open windows, and converts completed windows to tensors.
+    /// Window n covers [begin_t + n * stride, begin_t + n * stride + duration[. A window is complete once an event
+    /// past its end arrives, and the windows which start before the last event are completed when the stream ends.
+    /// Completed windows are converted in batches, one thread per window, and each thread owns an accumulator
+    /// reused across batches. The tensors are handed over in order on the calling thread.
+    template <typename HandleTensor>
+    class windows {
+        public:
+        windows(
+            tensor::parameters parameters,
+            uint64_t begin_t,
+            uint64_t stride,
+            std::size_t threads,
+            HandleTensor handle_tensor) :
+            _parameters(parameters),
+            _begin_t(begin_t),
+            _stride(stride),
+            _next(0),
+            _completed(0),
+            _accumulators(threads, std::vector<float>(parameters.size())),
+            _tensors(threads),
+            _events_out(threads),
+            _handle_tensor(std::move(handle_tensor)) {}
+        windows(const windows&) = delete;
+        windows(windows&&) = default;
+        windows& operator=(const windows&) = delete;
+        windows& operator=(windows&&) = default;
+        virtual ~windows() {}
+
+        /// operator() handles a change detection.
+        virtual void operator()(sepia::dvs_event dvs_event) {
+            while (window_begin(_next + _completed) + _parameters.duration <= dvs_event.t) {
+                complete();
+            }
+            if (dvs_event.t >= window_begin(_next)) {
+                _events.push_back(dvs_event);
+            }
+        }
+
+        /// close completes the windows which start before the last event, and hands over the pending tensors.
+        /// The last timestamp is read before the loop, since completing a batch drops the buffered events.
+        virtual void close() {
+            if (!_events.empty()) {
+                const auto last_t = _events.back().t;
+                while (window_begin(_next + _completed) <= last_t) {
+                    complete();
+                }
+            }
+            flush();
+        }
+
+        /// events_out returns the number of events written to the tensors
+        /// (events in overlapping windows count twice).
+        virtual uint64_t events_out() const {
+            return std::accumulate(_events_out.begin(), _events_out.end(), static_cast<uint64_t>(0));
+        }
+
+        protected:
+        /// window_begin returns the beginning of a window.
+        uint64_t window_begin(std::size_t index) const {
+            return _begin_t + index * _stride;
+        }
+
+        /// complete marks the next window as complete, and flushes the batch once it is full.
+        void complete() {
+            ++_completed;
+            if (_completed == _accumulators.size()) {
+                flush();
+            }
+        }
+
+        /// flush converts the completed windows in parallel, hands them over,
+        /// and drops the events which belong to completed windows only.
+        /// The events are sorted, hence each window's events are found with a binary search.
+        void flush() {
+            const auto compare = [](const sepia::dvs_event& dvs_event, uint64_t t) { return dvs_event.t < t; };
+            async::parallel_for(_completed, [&](std::size_t index) {
+                const auto begin_t = window_begin(_next + index);
+                const auto first = std::lower_bound(_events.begin(), _events.end(), begin_t, compare);
+                const auto last = std::lower_bound(first, _events.end(), begin_t + _parameters.duration, compare);
+                auto& accumulator = _accumulators[index];
+                std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+                tensor::accumulate(_parameters, begin_t, first, last, accumulator);
+                tensor::encode(_parameters, accumulator, _tensors[index]);
+                _events_out[index] += static_cast<uint64_t>(std::distance(first, last));
+            });
+            for (std::size_t index = 0; index < _completed; ++index) {
+                _handle_tensor(_next + index, _tensors[index]);
+            }
+            _next += _completed;
+            _completed = 0;
+            while (!_events.empty() && _events.front().t < window_begin(_next)) {
+                _events.pop_front();
+            }
+        }
+
+        const tensor::parameters _parameters;
+        const uint64_t _begin_t;
+        const uint64_t _stride;
+        std::size_t _next;
+        std::size_t _completed;
+        std::deque<sepia::dvs_event> _events;
+        std::vector<std::vector<float>> _accumulators;
+        std::vector<std::string> _tensors;
+        std::vector<uint64_t> _events_out;
+        HandleTensor _handle_tensor;
+    };
+
+    /// make_windows creates tensor windows from parameters and a handler.
+    template <typename HandleTensor>
+    windows<HandleTensor> make_windows(
+        tensor::parameters parameters,
+        uint64_t begin_t,
+        uint64_t stride,
+        std::size_t threads,
+        HandleTensor handle_tensor) {
+        return windows<HandleTensor>(parameters, begin_t, stride, threads, std::move(handle_tensor));
+    }
+}
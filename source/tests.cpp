@@ -0,0 +1,192 @@
+#include "../third_party/pontella/source/pontella.hpp"
+#include "../third_party/sepia/source/sepia.hpp"
+#include "cpu.hpp"
+#include "csv.hpp"
+#include "dat.hpp"
+#include "html.hpp"
+#include "io.hpp"
+#include "synthetic.hpp"
+#include "tensor.hpp"
+#include <functional>
+
+/// check throws if a condition does not hold.
+void check(bool condition, const std::string& message) {
+    if (!condition) {
+        throw std::logic_error(message);
+    }
+}
+
+/// blocked_bytes writes events to a blocked container in memory, with small blocks so that several are written.
+template <sepia::type event_stream_type>
+std::string blocked_bytes(const std::vector<sepia::event<event_stream_type>>& events, uint16_t width, uint16_t height) {
+    std::ostringstream stream;
+    {
+        blocked::write_to_reference<event_stream_type> write(stream, width, height, 16);
+        for (const auto& event : events) {
+            write(event);
+        }
+    }
+    return stream.str();
+}
+
+/// csv_lines converts a blocked container to CSV lines with es_to_csv's block and event selection.
+template <sepia::type event_stream_type>
+std::string csv_lines(const std::string& bytes, uint32_t selected, const csv::region& roi, bool has_roi) {
+    auto input = io::open_event_stream(std::unique_ptr<std::istream>(new std::istringstream(bytes)), true);
+    check(input.is_blocked, "the container is not detected as blocked");
+    std::vector<sepia::event<event_stream_type>> events;
+    io::join_observable<event_stream_type>(
+        std::move(input),
+        [&](const blocked::zone_map& zone_map) { return csv::keep_block(zone_map, 0, roi, has_roi); },
+        [&](const sepia::event<event_stream_type>& event) {
+            if (csv::is_in_region(event, roi)) {
+                events.push_back(event);
+            }
+        });
+    std::string buffer;
+    csv::make_formatter<event_stream_type>(selected)(events, buffer);
+    return buffer;
+}
+
+/// test_csv_blocked_generic converts a blocked generic stream, whose zone maps have an empty bounding box.
+void test_csv_blocked_generic() {
+    std::vector<sepia::generic_event> events;
+    for (uint64_t t = 0; t < 100; ++t) {
+        events.push_back({t, {static_cast<uint8_t>(t)}});
+    }
+    const auto lines =
+        csv_lines<sepia::type::generic>(blocked_bytes<sepia::type::generic>(events, 0, 0), 1, {0, 0, 0, 0}, false);
+    check(
+        static_cast<std::size_t>(std::count(lines.begin(), lines.end(), '\n')) == events.size(),
+        "the CSV conversion of a blocked generic stream does not have a line per event");
+    check(lines.substr(0, 4) == "0\n1\n", "the CSV conversion of a blocked generic stream has unexpected lines");
+}
+
+/// test_csv_blocked_roi converts a blocked DVS stream with a region, which skips the blocks outside the region.
+void test_csv_blocked_roi() {
+    std::vector<sepia::dvs_event> events;
+    for (uint64_t t = 0; t < 100; ++t) {
+        events.push_back({t, static_cast<uint16_t>(t < 50 ? 1 : 30), static_cast<uint16_t>(t % 8), true});
+    }
+    const auto bytes = blocked_bytes<sepia::type::dvs>(events, 32, 8);
+    auto lines = csv_lines<sepia::type::dvs>(bytes, 1, {0, 0, 32, 8}, false);
+    check(
+        static_cast<std::size_t>(std::count(lines.begin(), lines.end(), '\n')) == events.size(),
+        "the CSV conversion of a blocked DVS stream does not have a line per event");
+    lines = csv_lines<sepia::type::dvs>(bytes, 1, {0, 0, 16, 8}, true);
+    check(
+        std::count(lines.begin(), lines.end(), '\n') == 50,
+        "the CSV conversion of a blocked DVS stream with a region does not have a line per event in the region");
+}
+
+/// random_bytes returns deterministic pseudo-random bytes.
+std::vector<uint8_t> random_bytes(std::size_t size) {
+    std::vector<uint8_t> bytes(size);
+    synthetic::random random(0);
+    for (auto& byte : bytes) {
+        byte = static_cast<uint8_t>(random.below(256));
+    }
+    return bytes;
+}
+
+/// for_each_level calls a function with every level supported by the machine, the scalar level first,
+/// and restores the selected level.
+template <typename HandleLevel>
+void for_each_level(HandleLevel handle_level) {
+    const auto selected = cpu::selected();
+    try {
+        for (const auto level : cpu::levels()) {
+            if (cpu::is_supported(level)) {
+                cpu::select(level);
+                handle_level(level);
+            }
+        }
+    } catch (...) {
+        cpu::select(selected);
+        throw;
+    }
+    cpu::select(selected);
+}
+
+/// test_kernels_decode_records checks that each variant of decode_records matches the scalar variant.
+/// The records are random bytes, hence both in-bounds and out-of-bounds records are compared,
+/// and the count is not a multiple of the vector widths.
+void test_kernels_decode_records() {
+    const std::size_t count = (1 << 12) + 7;
+    const auto bytes = random_bytes(count * 8);
+    for (const uint8_t version : {1, 2}) {
+        const dat::header header{version, 320, 240};
+        dat::records expected;
+        for_each_level([&](cpu::level level) {
+            dat::records records;
+            records.resize(count);
+            dat::decode_records(bytes.data(), count, header, records);
+            if (level == cpu::level::scalar) {
+                expected = std::move(records);
+            } else {
+                check(
+                    records.ts == expected.ts && records.xs == expected.xs && records.ys == expected.ys
+                        && records.is_increases == expected.is_increases,
+                    "the " + cpu::level_to_string(level) + " variant of decode_records (version "
+                        + std::to_string(version) + ") differs from the scalar variant");
+            }
+        });
+    }
+}
+
+/// test_kernels_encode_base64 checks that each variant of encode_base64 matches the scalar variant.
+void test_kernels_encode_base64() {
+    const std::size_t groups = (1 << 12) + 7;
+    const auto bytes = random_bytes(groups * 3);
+    std::string expected;
+    for_each_level([&](cpu::level level) {
+        std::string characters(groups * 4, '\0');
+        html::encode_base64(bytes.data(), groups, &characters[0]);
+        if (level == cpu::level::scalar) {
+            expected = characters;
+        } else {
+            check(
+                characters == expected,
+                "the " + cpu::level_to_string(level) + " variant of encode_base64 differs from the scalar variant");
+        }
+    });
+}
+
+/// test_tensor_windows_single_thread closes tensor windows with one thread, so that each completed window
+/// flushes the buffered events before the stream ends.
+void test_tensor_windows_single_thread() {
+    const tensor::parameters parameters{4, 4, tensor::representation::histogram, 1, 100, tensor::dtype::float32};
+    std::vector<std::size_t> indices;
+    auto windows = tensor::make_windows(
+        parameters, 0, 100, 1, [&](std::size_t index, const std::string&) { indices.push_back(index); });
+    windows(sepia::dvs_event{50, 1, 2, true});
+    windows.close();
+    check(indices == std::vector<std::size_t>{0}, "a single event does not produce a single window");
+    check(windows.events_out() == 1, "the single event is not written to its window");
+}
+
+int main(int argc, char* argv[]) {
+    return pontella::main(
+        {"tests runs the unit tests, and stops at the first failure",
+         "Syntax: ./tests [options]",
+         "Available options:",
+         "    -h, --help    shows this help message"},
+        argc,
+        argv,
+        0,
+        {},
+        {},
+        [](pontella::command) {
+            const std::vector<std::pair<std::string, std::function<void()>>> names_and_tests{
+                {"csv/blocked_generic", test_csv_blocked_generic},
+                {"csv/blocked_roi", test_csv_blocked_roi},
+                {"kernels/decode_records", test_kernels_decode_records},
+                {"kernels/encode_base64", test_kernels_encode_base64},
+                {"tensor/windows_single_thread", test_tensor_windows_single_thread},
+            };
+            for (const auto& name_and_test : names_and_tests) {
+                name_and_test.second();
+                std::cout << name_and_test.first << " passed" << std::endl;
+            }
+        });
+}
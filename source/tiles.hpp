@@ -0,0 +1,210 @@
+#pragma once
+
+#include "async.hpp"
+#include "blocked.hpp"
+#include <fstream>
+
+/// tiles implements a spatial index of blocked Event Streams, stored in a sidecar file.
+/// The sensor is divided into square tiles, and the index stores a bitmap per block, with a bit set
+/// for each tile which contains at least one of the block's events. Readers can skip the blocks without events
+/// in a region, even if the region is within the block's bounding box.
+/// A bitmap has one bit per tile (115 bytes for a 1280 x 720 sensor with 32 x 32 tiles, whereas a block of
+/// 65536 events takes about 200 kB), hence the sidecar is a small fraction of the indexed file.
+/// The sidecar starts with a signature, a version byte, the tile size, the number of columns and rows of tiles,
+/// and the number of blocks. It is followed by each block's payload size and number of events
+/// (used to check that the sidecar matches the file) and bitmap. Integers are little endian.
+namespace tiles {
+    /// signature starts every sidecar file.
+    const std::string signature = "Event Stream Tiles";
+
+    /// version is the sidecar version.
+    constexpr uint8_t version = 1;
+
+    /// default_tile_size is the width and height of a tile in pixels.
+    constexpr uint16_t default_tile_size = 32;
+
+    /// block summarizes a block of the indexed file.
+    struct block {
+        uint64_t payload_size;
+        uint64_t events;
+        std::vector<uint8_t> bitmap;
+    };
+
+    /// index is the spatial index of a blocked Event Stream.
+    struct index {
+        uint16_t tile_size;
+        uint16_t columns;
+        uint16_t rows;
+        std::vector<block> blocks;
+
+        /// bitmap_size returns the number of bytes of a bitmap.
+        std::size_t bitmap_size() const {
+            return (static_cast<std::size_t>(columns) * rows + 7) / 8;
+        }
+    };
+
+    /// make_index creates an index without blocks for the given sensor size.
+    inline index make_index(uint16_t width, uint16_t height, uint16_t tile_size = default_tile_size) {
+        return {
+            tile_size,
+            static_cast<uint16_t>((width + tile_size - 1) / tile_size),
+            static_cast<uint16_t>((height + tile_size - 1) / tile_size),
+            {}};
+    }
+
+    /// set_tile sets the bit of the tile which contains the given pixel, pixels outside the sensor are ignored.
+    inline void set_tile(const index& tiles_index, std::vector<uint8_t>& bitmap, uint16_t x, uint16_t y) {
+        const auto column = x / tiles_index.tile_size;
+        const auto row = y / tiles_index.tile_size;
+        if (column < tiles_index.columns && row < tiles_index.rows) {
+            const auto tile = static_cast<std::size_t>(column) + static_cast<std::size_t>(row) * tiles_index.columns;
+            bitmap[tile / 8] |= static_cast<uint8_t>(1 << (tile % 8));
+        }
+    }
+
+    /// region_mask returns a bitmap with the tiles which overlap the given region.
+    inline std::vector<uint8_t>
+    region_mask(const index& tiles_index, uint16_t left, uint16_t bottom, uint16_t width, uint16_t height) {
+        std::vector<uint8_t> mask(tiles_index.bitmap_size(), 0);
+        if (width == 0 || height == 0) {
+            return mask;
+        }
+        for (uint32_t y = bottom / tiles_index.tile_size; y <= (bottom + height - 1u) / tiles_index.tile_size;
+             ++y) {
+            for (uint32_t x = left / tiles_index.tile_size; x <= (left + width - 1u) / tiles_index.tile_size;
+                 ++x) {
+                set_tile(
+                    tiles_index,
+                    mask,
+                    static_cast<uint16_t>(x * tiles_index.tile_size),
+                    static_cast<uint16_t>(y * tiles_index.tile_size));
+            }
+        }
+        return mask;
+    }
+
+    /// intersects returns true if a block's bitmap and a region's mask have a tile in common.
+    inline bool intersects(const std::vector<uint8_t>& bitmap, const std::vector<uint8_t>& mask) {
+        for (std::size_t index = 0; index < bitmap.size(); ++index) {
+            if ((bitmap[index] & mask[index]) != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// matches returns true if an index's block describes the given zone map.
+    inline bool matches(const index& tiles_index, std::size_t block_index, const blocked::zone_map& zone_map) {
+        return block_index < tiles_index.blocks.size()
+               && tiles_index.blocks[block_index].payload_size == zone_map.payload_size
+               && tiles_index.blocks[block_index].events == zone_map.events;
+    }
+
+    /// build indexes a blocked container in a single pass.
+    /// Batches of blocks are read on the calling thread, and decoded in parallel, one block per thread.
+    template <sepia::type event_stream_type>
+    inline index build(std::istream& stream, uint16_t width, uint16_t height, std::size_t threads) {
+        auto tiles_index = make_index(width, height);
+        const auto header_bytes = blocked::read_header(stream);
+        std::vector<std::string> payloads(threads);
+        std::vector<blocked::zone_map> zone_maps(threads);
+        for (auto end_of_stream = false; !end_of_stream;) {
+            std::size_t batch_size = 0;
+            for (; batch_size < threads; ++batch_size) {
+                if (!blocked::read_zone_map(stream, zone_maps[batch_size])) {
+                    end_of_stream = true;
+                    break;
+                }
+                auto& payload = payloads[batch_size];
+                payload.assign(header_bytes);
+                payload.resize(header_bytes.size() + zone_maps[batch_size].payload_size);
+                stream.read(
+                    &payload[header_bytes.size()], static_cast<std::streamsize>(zone_maps[batch_size].payload_size));
+                if (stream.gcount() != static_cast<std::streamsize>(zone_maps[batch_size].payload_size)) {
+                    throw std::runtime_error("the blocked Event Stream is truncated");
+                }
+            }
+            const auto first_block = tiles_index.blocks.size();
+            for (std::size_t index = 0; index < batch_size; ++index) {
+                tiles_index.blocks.push_back({zone_maps[index].payload_size,
+                                              zone_maps[index].events,
+                                              std::vector<uint8_t>(tiles_index.bitmap_size(), 0)});
+            }
+            async::parallel_for(batch_size, [&](std::size_t index) {
+                auto& bitmap = tiles_index.blocks[first_block + index].bitmap;
+                sepia::join_observable<event_stream_type>(
+                    std::unique_ptr<std::istream>(new std::istringstream(payloads[index])),
+                    [&](sepia::event<event_stream_type> event) { set_tile(tiles_index, bitmap, event.x, event.y); });
+            });
+        }
+        return tiles_index;
+    }
+
+    /// write_index writes an index to a sidecar file.
+    inline void write_index(const std::string& filename, const index& tiles_index) {
+        std::ofstream output(filename, std::ofstream::out | std::ofstream::binary);
+        if (!output.good()) {
+            throw std::runtime_error("'" + filename + "' could not be open for writing");
+        }
+        const auto write_integer = [&](uint64_t value, std::size_t size) {
+            for (std::size_t index = 0; index < size; ++index) {
+                output.put(static_cast<char>((value >> (index * 8)) & 0xff));
+            }
+        };
+        output.write(signature.data(), signature.size());
+        output.put(static_cast<char>(version));
+        write_integer(tiles_index.tile_size, 2);
+        write_integer(tiles_index.columns, 2);
+        write_integer(tiles_index.rows, 2);
+        write_integer(tiles_index.blocks.size(), 8);
+        for (const auto& tiles_block : tiles_index.blocks) {
+            write_integer(tiles_block.payload_size, 8);
+            write_integer(tiles_block.events, 8);
+            output.write(reinterpret_cast<const char*>(tiles_block.bitmap.data()), tiles_block.bitmap.size());
+        }
+        if (!output.good()) {
+            throw std::runtime_error("writing '" + filename + "' failed");
+        }
+    }
+
+    /// read_index reads a sidecar file, and returns false if the file does not exist.
+    inline bool read_index(const std::string& filename, index& tiles_index) {
+        std::ifstream input(filename, std::ifstream::in | std::ifstream::binary);
+        if (!input.good()) {
+            return false;
+        }
+        const auto read_integer = [&](std::size_t size) {
+            uint64_t value = 0;
+            for (std::size_t index = 0; index < size; ++index) {
+                const auto byte = input.get();
+                if (byte == std::ifstream::traits_type::eof()) {
+                    throw std::runtime_error("'" + filename + "' is truncated");
+                }
+                value |= static_cast<uint64_t>(byte) << (index * 8);
+            }
+            return value;
+        };
+        std::string bytes(signature.size(), '\0');
+        input.read(&bytes[0], bytes.size());
+        if (bytes != signature || input.get() != version) {
+            throw std::runtime_error("'" + filename + "' is not a tiles index");
+        }
+        tiles_index.tile_size = static_cast<uint16_t>(read_integer(2));
+        tiles_index.columns = static_cast<uint16_t>(read_integer(2));
+        tiles_index.rows = static_cast<uint16_t>(read_integer(2));
+        if (tiles_index.tile_size == 0) {
+            throw std::runtime_error("'" + filename + "' is not a tiles index");
+        }
+        tiles_index.blocks.resize(static_cast<std::size_t>(read_integer(8)));
+        for (auto& tiles_block : tiles_index.blocks) {
+            tiles_block.payload_size = read_integer(8);
+            tiles_block.events = read_integer(8);
+            tiles_block.bitmap.resize(tiles_index.bitmap_size());
+            input.read(reinterpret_cast<char*>(tiles_block.bitmap.data()), tiles_block.bitmap.size());
+            if (input.gcount() != static_cast<std::streamsize>(tiles_block.bitmap.size())) {
+                throw std::runtime_error("'" + filename + "' is truncated");
+            }
+        }
+        return true;
+    }
+}